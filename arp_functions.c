@@ -11,6 +11,8 @@
 #include "ethernet_functions.h"
 #include "arp.h"
 #include "arp_functions.h"
+#include "buffer_functions.h"
+#include "graph_functions.h"
 
 /* 
     FUNCTION IMPLEMENTATIONS
@@ -129,3 +131,55 @@ construct_arp_packet(uint32_t source_ip, uint32_t target_ip, uint16_t opcode, ui
     
     return frame; 
 }
+
+/* 
+    GRAPH NODES
+*/
+
+/* Plug the ARP input node into a graph. Returns -1 on failure. */
+
+int
+register_arp_nodes(Graph *graph)
+{
+    int node;
+
+    if ((node = register_graph_node(graph, "arp-input", arp_input_node)) == -1)
+    {
+        return -1;
+    }
+
+    return register_ethertype_node(graph, ARP_TYPE, node);
+}
+
+/* ARP input node. Turns requests for the receiving interface into replies in 
+   place and queues them for output. Everything else is dropped. */
+
+void
+arp_input_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Packet_Buffer   *buffer;
+    ARP_Packet      *arp_packet;
+    const Interface *interface;
+    int              i;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        buffer     = buffers[i];
+        interface  = buffer->interface;
+        arp_packet = (ARP_Packet *)(buffer->data + sizeof(Ethernet_Header));
+
+        if (!valid_arp_packet(arp_packet) || 
+            ntohs(arp_packet->opcode) != ARP_OP_REQUEST ||
+            ntohl(arp_packet->target_ip_address) != interface->ip_address)
+        {
+            release_packet_buffer(buffer);
+            continue;
+        }
+
+        modify_arp_packet(arp_packet, interface);
+        modify_ethernet_frame(buffer->data, buffer->len, interface->mac_address, arp_packet->target_mac_address);
+
+        buffer->tx_interface = interface;
+        graph_enqueue(graph, NODE_INTERFACE_OUTPUT, buffer);
+    }
+}
@@ -10,6 +10,7 @@
 #include "c_headers.h"
 #include "router.h"
 #include "arp.h"
+#include "graph.h"
 
 /* 
     ARP FUNCTIONS
@@ -22,4 +23,9 @@ void     modify_arp_packet(ARP_Packet *arp_packet, const Interface *interface);
 uint8_t *construct_arp_packet(uint32_t source_ip, uint32_t target_ip, uint16_t opcode,
                               uint8_t *mac_source, uint8_t *mac_target);
 
+/* Graph nodes */
+
+int      register_arp_nodes(Graph *graph);
+void     arp_input_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
 #endif /* ARP_FUNCTIONS__H */
@@ -0,0 +1,138 @@
+/*
+ * bench.h
+ */
+
+#ifndef BENCH__H
+#define BENCH__H
+
+/* Implementation Headers */
+
+#include <sys/resource.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "tcp.h"
+#include "tcp_socket.h"
+
+/*
+    BENCHMARK CONSTANTS
+*/
+
+#define BENCH_FRAMES               200000
+#define BENCH_FLOWS                64
+#define BENCH_BURST                32
+#define BENCH_FRAME_LEN            64         /* Minimum frame, with FCS.         */
+#define BENCH_IDLE_MS              1000       /* Give up on frames after this.    */
+
+/* Traffic from tap0 (R0_0) to interface C (R0_1), both in the ARP cache. */
+
+#define BENCH_SOURCE_IP            0x50010005
+#define BENCH_DESTINATION_IP       0x5A020405
+#define BENCH_RX_INTERFACE         0
+#define BENCH_TX_INTERFACE         1
+
+/* TCP bulk transfer. */
+
+#define TCP_BENCH_PORT             5201       /* Port the receiver listens on.    */
+#define TCP_BENCH_MAX_STREAMS      128
+#define TCP_BENCH_DEFAULT_SECONDS  10
+#define TCP_BENCH_CHUNK            65536      /* Bytes per send or receive.       */
+#define TCP_BENCH_TICK_MS          100        /* Progress is checked this often.  */
+#define TCP_BENCH_IDLE_MS          5000       /* Give up on a silent sender.      */
+#define TCP_BENCH_LINGER_MS        5000       /* Most time to finish closing.     */
+#define TCP_BENCH_SENDER           0
+#define TCP_BENCH_RECEIVER         1
+
+/* Over the in-memory link each instance sees the other as the host on tap0, 
+   which both have in their ARP cache. */
+
+#define TCP_BENCH_LINK_PEER_IP     0x50010005
+#define TCP_BENCH_LINK_INTERFACE   0
+#define TCP_BENCH_LINK_QUEUE       (1 << 20)  /* Bytes queued each way, beyond 
+                                                 which frames are dropped.        */
+
+/*
+    BENCHMARK STRUCTS
+*/
+
+/* One benchmark run. Frames carry their send time, so the sink measures the 
+   latency of every frame through the router. */
+
+typedef struct Benchmark
+{
+    Scheduler_Config  config;                 /* Mode being measured.             */
+    int               generator_fd;           /* Writes frames into R0_0.         */
+    int               sink_fd;                /* Reads frames sent out R0_1.      */
+    uint64_t          start_ns;               /* Time the first frame was sent.   */
+    uint64_t          end_ns;                 /* Time the last frame arrived.     */
+    int               num_received;
+    uint64_t         *latencies;              /* Latency of each frame (ns).      */
+    VDE_Reader        reader;                 /* Buffered reader for the sink.    */
+} Benchmark;
+
+/* What to run. With neither peer_ip nor receive set, a sender and a receiver 
+   run as two instances joined by an in-memory link. */
+
+typedef struct TCP_Bench_Config
+{
+    int               streams;                /* Parallel connections.            */
+    int               seconds;                /* Send for this long...            */
+    uint64_t          bytes;                  /* ...or this many in all, if set.  */
+    uint32_t          peer_ip;                /* Send over the switches to it.    */
+    int               receive;                /* Receive over the switches.       */
+} TCP_Bench_Config;
+
+struct TCP_Bench;
+
+/* One connection of a run. */
+
+typedef struct TCP_Bench_Stream
+{
+    struct TCP_Bench *bench;
+    TCP_Socket       *socket;                 /* NULL once closed.                */
+    uint64_t          quota;                  /* Bytes left to send.              */
+    uint64_t          bytes;                  /* Bytes acknowledged, or read.     */
+    uint32_t          snd_una;                /* Acknowledged up to, last seen.   */
+    uint32_t          retransmits;
+    int               connected;
+    int               done;
+} TCP_Bench_Stream;
+
+/* One side of a TCP run, in its own instance of the stack. */
+
+typedef struct TCP_Bench
+{
+    TCP_Bench_Config  config;
+    Scheduler_Config  scheduler;              /* Mode being measured.             */
+    int               side;                   /* TCP_BENCH_SENDER or _RECEIVER.   */
+    int               ready_fd;               /* Written once listening, or -1.   */
+    TCP_Bench_Stream  streams[TCP_BENCH_MAX_STREAMS];
+    int               num_streams;            /* Opened or accepted.              */
+    int               num_done;
+    int               finished;               /* Reported, closing.               */
+    uint64_t          start_ns;
+    uint64_t          end_ns;
+    uint64_t          last_data_ns;           /* Receiver: last data read.        */
+    uint64_t          linger_ns;              /* Exit by then once finished.      */
+    struct rusage     start_usage;
+    Timer             tick;
+    TCP_RTT_Histogram rtt;
+    uint8_t           chunk[TCP_BENCH_CHUNK];
+} TCP_Bench;
+
+/* One direction of the in-memory link: frames read from one instance, with 
+   addresses mirrored, wait here to be written to the other. */
+
+typedef struct TCP_Bench_Link
+{
+    VDE_Reader        reader;                 /* Frames sent by one instance.     */
+    int               fd;                     /* Input of the other, non-blocking.*/
+    uint8_t          *queue;                  /* Frames with their length prefix. */
+    size_t            start;
+    size_t            len;
+    uint64_t          frames;
+    uint64_t          drops;                  /* Frames that found the queue full.*/
+} TCP_Bench_Link;
+
+#endif /* BENCH__H */
@@ -0,0 +1,984 @@
+/*
+ * bench_functions.c
+ */
+
+/* Implementation Headers */
+
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "frame_crc32.h"
+#include "router.h"
+#include "router_functions.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "ip_functions.h"
+#include "tcp.h"
+#include "tcp_functions.h"
+#include "tcp_socket.h"
+#include "tcp_socket_functions.h"
+#include "timer_functions.h"
+#include "scheduler.h"
+#include "scheduler_functions.h"
+#include "bench.h"
+#include "bench_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/* Benchmark each mode in its own process, so every run starts from fresh 
+   threads, pools and pipes. Benchmarks every mode if config->mode is -1. */
+
+int
+run_benchmarks(const Scheduler_Config *config)
+{
+    Scheduler_Config mode_config = *config;
+    pid_t            pid;
+    int              mode, status;
+
+    printf("BENCHMARK: %d frames of %d bytes over %d flows, R0_%d to R0_%d, busy poll %d us, quota %d\n", BENCH_FRAMES,
+           BENCH_FRAME_LEN, BENCH_FLOWS, BENCH_RX_INTERFACE, BENCH_TX_INTERFACE, config->busy_poll_us, config->rx_quota);
+    printf("    %-9s %8s %10s %10s %10s %12s %12s\n", "Mode", "Workers", "Received", "Seconds",
+           "Mpps", "p50 (us)", "p99 (us)");
+    fflush(stdout);
+
+    for (mode = SCHEDULER_SINGLE; mode <= SCHEDULER_PIPELINE; mode++)
+    {
+        if (config->mode != -1 && config->mode != mode)
+        {
+            continue;
+        }
+
+        mode_config.mode = mode;
+
+        if ((pid = fork()) == -1)
+        {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0)
+        {
+            run_benchmark(&mode_config);
+        }
+
+        waitpid(pid, &status, 0);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Run one benchmark in this process and exit once the sink is done. */
+
+void
+run_benchmark(const Scheduler_Config *config)
+{
+    static Benchmark bench;
+    pthread_t        generator, sink;
+
+    bench.config = *config;
+
+    if ((bench.latencies = malloc(BENCH_FRAMES * sizeof(uint64_t))) == NULL ||
+        connect_benchmark_interfaces(&bench) == -1 ||
+        init_vde_reader(&bench.reader, bench.sink_fd) == -1)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    if (pthread_create(&sink, NULL, benchmark_sink, &bench) != 0 ||
+        pthread_create(&generator, NULL, benchmark_generator, &bench) != 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    run_scheduler(config);
+}
+
+/* Replace the VDE switches with pipes: the generator writes into R0_0 and the 
+   sink reads what is sent out of R0_1. Frames sent out of other interfaces are
+   left in their pipes. Stdin is parked on a pipe that is never written. */
+
+int
+connect_benchmark_interfaces(Benchmark *bench)
+{
+    int in_fds[2], out_fds[2], stdin_fds[2];
+
+    for (int i = 0; i < NUM_INTERFACES; i++)
+    {
+        if (pipe(in_fds) == -1 || pipe(out_fds) == -1)
+        {
+            perror("pipe");
+            return -1;
+        }
+
+        ROUTER_INTERFACES[i].fds[0] = in_fds[0];
+        ROUTER_INTERFACES[i].fds[1] = out_fds[1];
+
+        if (i == BENCH_RX_INTERFACE)
+        {
+            bench->generator_fd = in_fds[1];
+        }
+        if (i == BENCH_TX_INTERFACE)
+        {
+            bench->sink_fd = out_fds[0];
+        }
+    }
+
+    if (pipe(stdin_fds) == -1 || dup2(stdin_fds[0], STDIN_FILENO) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    return 1;
+}
+
+/* Build a minimum-size UDP frame for a flow. The flow picks the source port. 
+   The send time goes in the payload and the FCS is added when it is sent. */
+
+void
+build_benchmark_frame(uint8_t *frame, int flow)
+{
+    Ethernet_Header *ethernet_hdr = (Ethernet_Header *)frame;
+    IP_Header       *ip_hdr       = (IP_Header *)(frame + sizeof(Ethernet_Header));
+    uint16_t        *udp_hdr      = (uint16_t *)((uint8_t *)ip_hdr + sizeof(IP_Header));
+    uint16_t         ip_len       = BENCH_FRAME_LEN - sizeof(Ethernet_Header) - ETHERNET_FCS_LEN;
+
+    memset(frame, 0, BENCH_FRAME_LEN);
+
+    /* Ethernet header. */
+
+    memcpy(ethernet_hdr->destination, ROUTER_INTERFACES[BENCH_RX_INTERFACE].mac_address, 6);
+    memcpy(ethernet_hdr->source, "\x58\x9C\xFC\x00\xB2\x20", 6);
+    ethernet_hdr->type = htons(IP_TYPE);
+
+    /* IP header. */
+
+    ip_hdr->version_and_IHL = (IPV4_VER << 4) | MIN_IHL;
+    ip_hdr->total_length    = htons(ip_len);
+    ip_hdr->ttl             = DEFAULT_TTL;
+    ip_hdr->protocol        = UDP_PROTOCOL;
+    ip_hdr->source          = htonl(BENCH_SOURCE_IP);
+    ip_hdr->destination     = htonl(BENCH_DESTINATION_IP);
+    ip_hdr->checksum        = RFC1071_checksum(ip_hdr, sizeof(IP_Header));
+
+    /* UDP header, without a checksum. */
+
+    udp_hdr[0] = htons(10000 + flow);
+    udp_hdr[1] = htons(9);
+    udp_hdr[2] = htons(ip_len - sizeof(IP_Header));
+}
+
+/* Generator thread. Sends BENCH_FRAMES frames round-robin over the flows, a 
+   burst per write, as fast as the router takes them. */
+
+void *
+benchmark_generator(void *arg)
+{
+    Benchmark *bench = arg;
+    uint8_t    templates[BENCH_FLOWS][BENCH_FRAME_LEN];
+    uint8_t    burst[BENCH_BURST][2 + BENCH_FRAME_LEN];
+    uint8_t   *frame;
+    uint64_t   now;
+    uint32_t   fcs;
+    int        i, flow, sent = 0;
+
+    for (flow = 0; flow < BENCH_FLOWS; flow++)
+    {
+        build_benchmark_frame(templates[flow], flow);
+    }
+
+    bench->start_ns = monotonic_ns();
+
+    while (sent < BENCH_FRAMES)
+    {
+        now = monotonic_ns();
+
+        for (i = 0; i < BENCH_BURST; i++, sent++)
+        {
+            frame = burst[i] + 2;
+            flow  = sent % BENCH_FLOWS;
+
+            burst[i][0] = BENCH_FRAME_LEN >> 8;
+            burst[i][1] = BENCH_FRAME_LEN & 0xFF;
+
+            memcpy(frame, templates[flow], BENCH_FRAME_LEN);
+            memcpy(frame + sizeof(Ethernet_Header) + sizeof(IP_Header) + 8, &now, sizeof(now));
+
+            fcs = crc32(0, frame, BENCH_FRAME_LEN - ETHERNET_FCS_LEN);
+            memcpy(frame + BENCH_FRAME_LEN - ETHERNET_FCS_LEN, &fcs, ETHERNET_FCS_LEN);
+        }
+
+        if (write(bench->generator_fd, burst, sizeof(burst)) != sizeof(burst))
+        {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return NULL;
+}
+
+/* Sink thread. Records the latency of every forwarded frame, then reports once
+   all frames arrived or none arrived for BENCH_IDLE_MS. */
+
+void *
+benchmark_sink(void *arg)
+{
+    Benchmark     *bench   = arg;
+    struct pollfd  poll_fd = { bench->sink_fd, POLLIN, 0 };
+    uint8_t        frame[ETHERNET_MAX_FRAME_LEN];
+    uint64_t       sent_ns;
+    ssize_t        frame_len;
+
+    while (bench->num_received < BENCH_FRAMES)
+    {
+        if ((frame_len = next_ethernet_frame(&bench->reader, frame, sizeof(frame))) > 0)
+        {
+            memcpy(&sent_ns, frame + sizeof(Ethernet_Header) + sizeof(IP_Header) + 8, sizeof(sent_ns));
+
+            bench->end_ns                            = monotonic_ns();
+            bench->latencies[bench->num_received++] = bench->end_ns - sent_ns;
+            continue;
+        }
+
+        if (poll(&poll_fd, 1, BENCH_IDLE_MS) <= 0 || fill_vde_reader(&bench->reader) <= 0)
+        {
+            break;
+        }
+    }
+
+    report_benchmark(bench);
+    exit(EXIT_SUCCESS);
+
+    return NULL;
+}
+
+/* Compare latencies for qsort. */
+
+int
+compare_latencies(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Print throughput and latency percentiles for a run. */
+
+void
+report_benchmark(Benchmark *bench)
+{
+    double seconds = (bench->end_ns - bench->start_ns) / 1e9;
+    int    n       = bench->num_received;
+    int    workers = bench->config.mode == SCHEDULER_SINGLE ? 0 : bench->config.num_forwarding_workers;
+
+    if (n == 0)
+    {
+        printf("    %-9s %8d %10d %10s %10s %12s %12s\n", scheduler_mode_name(bench->config.mode),
+               workers, 0, "-", "-", "-", "-");
+        fflush(stdout);
+        return;
+    }
+
+    qsort(bench->latencies, n, sizeof(uint64_t), compare_latencies);
+
+    printf("    %-9s %8d %10d %10.3f %10.3f %12.1f %12.1f\n", scheduler_mode_name(bench->config.mode),
+           workers, n, seconds, n / seconds / 1e6, bench->latencies[n / 2] / 1e3,
+           bench->latencies[(int)(n * 0.99)] / 1e3);
+    fflush(stdout);
+}
+
+/*
+    TCP BENCHMARK FUNCTIONS
+*/
+
+/* Benchmark TCP bulk transfer. Against a peer over the switches, this instance
+   is the sender or the receiver. Otherwise a receiver and a sender are forked,
+   each its own instance of the stack, with their R0_0 joined by an in-memory
+   link that this process carries. */
+
+int
+run_tcp_benchmark(const Scheduler_Config *config, const TCP_Bench_Config *tcp_config)
+{
+    static TCP_Bench_Link links[2];
+    int                   to_receiver[2], from_receiver[2], to_sender[2], from_sender[2], ready[2];
+    pid_t                 receiver, sender;
+    pthread_t             link;
+    char                  byte;
+
+    printf("TCP BENCHMARK: %d streams, ", tcp_config->streams);
+
+    if (!tcp_config->receive && tcp_config->bytes > 0)
+    {
+        printf("%llu bytes, ", (unsigned long long)tcp_config->bytes);
+    }
+    else if (!tcp_config->receive)
+    {
+        printf("%d s, ", tcp_config->seconds);
+    }
+
+    printf("%s, %s mode\n", tcp_config->peer_ip != 0 ? "to a receiver over the switches" : 
+           tcp_config->receive ? "from a sender over the switches" : "over an in-memory link", scheduler_mode_name(config->mode));
+    printf("    %-9s %7s %14s %9s %10s %8s %7s %7s %7s %9s\n", "Side", "Streams", "Bytes", "Seconds", "Mbit/s",
+           "Retrans", "p50 ms", "p90 ms", "p99 ms", "CPU ns/B");
+    fflush(stdout);
+
+    /* One side, over the switches. */
+
+    if (tcp_config->peer_ip != 0 || tcp_config->receive)
+    {
+        connect_to_interfaces();
+        run_tcp_bench_side(config, tcp_config, tcp_config->receive ? TCP_BENCH_RECEIVER : TCP_BENCH_SENDER, -1);
+    }
+
+    if (pipe(to_receiver) == -1 || pipe(from_receiver) == -1 || pipe(to_sender) == -1 || 
+        pipe(from_sender) == -1 || pipe(ready) == -1)
+    {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+
+    /* Start the receiver, and the sender once the receiver listens. */
+
+    if ((receiver = fork()) == -1)
+    {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (receiver == 0)
+    {
+        if (connect_tcp_bench_link(to_receiver[0], from_receiver[1]) == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        run_tcp_bench_side(config, tcp_config, TCP_BENCH_RECEIVER, ready[1]);
+    }
+
+    if (read(ready[0], &byte, 1) != 1)
+    {
+        waitpid(receiver, NULL, 0);
+        return EXIT_FAILURE;
+    }
+
+    if ((sender = fork()) == -1)
+    {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (sender == 0)
+    {
+        if (connect_tcp_bench_link(to_sender[0], from_sender[1]) == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        run_tcp_bench_side(config, tcp_config, TCP_BENCH_SENDER, -1);
+    }
+
+    /* Carry frames between them until both are done. A side that exits early
+       must not take this process with it. */
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (init_vde_reader(&links[0].reader, from_sender[0]) == -1 ||
+        init_vde_reader(&links[1].reader, from_receiver[0]) == -1 ||
+        (links[0].queue = malloc(TCP_BENCH_LINK_QUEUE)) == NULL ||
+        (links[1].queue = malloc(TCP_BENCH_LINK_QUEUE)) == NULL)
+    {
+        kill(sender, SIGTERM);
+        kill(receiver, SIGTERM);
+        return EXIT_FAILURE;
+    }
+
+    links[0].fd = to_receiver[1];
+    links[1].fd = to_sender[1];
+    fcntl(links[0].fd, F_SETFL, fcntl(links[0].fd, F_GETFL) | O_NONBLOCK);
+    fcntl(links[1].fd, F_SETFL, fcntl(links[1].fd, F_GETFL) | O_NONBLOCK);
+
+    if (pthread_create(&link, NULL, run_tcp_bench_link, links) != 0)
+    {
+        kill(sender, SIGTERM);
+        kill(receiver, SIGTERM);
+        return EXIT_FAILURE;
+    }
+
+    waitpid(sender, NULL, 0);
+    waitpid(receiver, NULL, 0);
+
+    printf("    %-9s %llu frames to the receiver and %llu back, %llu dropped by the link queue\n", "link",
+           (unsigned long long)links[0].frames, (unsigned long long)links[1].frames,
+           (unsigned long long)(links[0].drops + links[1].drops));
+    fflush(stdout);
+
+    return EXIT_SUCCESS;
+}
+
+/* Run one side in this process, as its own instance of the stack. Does not 
+   return: the side exits once it has reported and its connections closed. */
+
+void
+run_tcp_bench_side(const Scheduler_Config *config, const TCP_Bench_Config *tcp_config, int side, int ready_fd)
+{
+    static TCP_Bench bench;
+
+    bench.config              = *tcp_config;
+    bench.scheduler           = *config;
+    bench.scheduler.start     = start_tcp_bench;
+    bench.scheduler.start_arg = &bench;
+    bench.side                = side;
+    bench.ready_fd            = ready_fd;
+
+    run_scheduler(&bench.scheduler);
+    exit(EXIT_SUCCESS);
+}
+
+/* Start a side once the stack is up. The receiver listens and says so on its
+   ready pipe. The sender opens every stream, splitting a byte count between
+   them, and its clock starts. */
+
+int
+start_tcp_bench(void *arg)
+{
+    TCP_Bench        *bench   = arg;
+    TCP_Bench_Stream *stream;
+    uint32_t          peer_ip = bench->config.peer_ip != 0 ? bench->config.peer_ip : TCP_BENCH_LINK_PEER_IP;
+    int               streams = bench->config.streams;
+
+    if (TCP_CONNECTIONS_LIST == NULL && init_tcp_connections_list() == -1)
+    {
+        return -1;
+    }
+
+    TCP_CONNECTIONS_LIST->rtt_histogram = &bench->rtt;
+
+    init_timer(&bench->tick, tcp_bench_tick, bench);
+    arm_timer(&TIMER_WHEEL, &bench->tick, TCP_BENCH_TICK_MS);
+
+    /* Receiver. */
+
+    if (bench->side == TCP_BENCH_RECEIVER)
+    {
+        if (tcp_socket_listen(TCP_ANY_IP, TCP_BENCH_PORT, streams, tcp_bench_accept_event, bench) == NULL)
+        {
+            return -1;
+        }
+
+        if (bench->ready_fd != -1 && write(bench->ready_fd, "", 1) != 1)
+        {
+            return -1;
+        }
+
+        return 1;
+    }
+
+    /* Sender. */
+
+    bench->start_ns = monotonic_ns();
+    getrusage(RUSAGE_SELF, &bench->start_usage);
+
+    for (int i = 0; i < streams; i++)
+    {
+        stream        = &bench->streams[i];
+        stream->bench = bench;
+        stream->quota = bench->config.bytes == 0 ? UINT64_MAX : 
+                        bench->config.bytes / streams + ((uint64_t)i < bench->config.bytes % streams);
+
+        if ((stream->socket = tcp_socket_connect(peer_ip, TCP_BENCH_PORT, 0, tcp_bench_send_event, stream)) == NULL)
+        {
+            return -1;
+        }
+
+        bench->num_streams++;
+    }
+
+    return 1;
+}
+
+/* Check on a run every TCP_BENCH_TICK_MS. The sender is done once its time is
+   up, or its byte count is all acknowledged; the receiver once every stream is
+   closed, which its events see, or the sender has gone silent. After the
+   report, exit once every connection has closed, into TIME_WAIT or not. */
+
+void
+tcp_bench_tick(Timer *timer, void *arg)
+{
+    TCP_Bench        *bench = arg;
+    TCP_Bench_Stream *stream;
+    uint64_t          now   = monotonic_ns();
+    int               done  = 1;
+
+    if (bench->finished)
+    {
+        if (TCP_CONNECTIONS_LIST->head == NULL || now >= bench->linger_ns)
+        {
+            exit(EXIT_SUCCESS);
+        }
+    }
+    else if (bench->side == TCP_BENCH_SENDER)
+    {
+        for (int i = 0; i < bench->num_streams; i++)
+        {
+            stream = &bench->streams[i];
+            update_tcp_bench_stream(stream);
+
+            /* A stream whose connection is gone (reset, or given up on) has
+               ended, though its CLOSED event is yet to be dispatched. */
+
+            if (!stream->done && stream->socket != NULL && stream->socket->connection != NULL &&
+                (stream->quota > 0 || !tcp_all_acked(stream->socket->connection)))
+            {
+                done = 0;
+            }
+        }
+
+        if (done || (bench->config.bytes == 0 && now - bench->start_ns >= bench->config.seconds * 1000000000ULL))
+        {
+            finish_tcp_bench(bench);
+        }
+    }
+    else if (bench->start_ns != 0 && now - bench->last_data_ns >= TCP_BENCH_IDLE_MS * 1000000ULL)
+    {
+        finish_tcp_bench(bench);
+    }
+
+    arm_timer(&TIMER_WHEEL, timer, TCP_BENCH_TICK_MS);
+}
+
+/* Stop the clock, report, and close every stream. The sender's queued data 
+   still goes out before its FIN. */
+
+void
+finish_tcp_bench(TCP_Bench *bench)
+{
+    bench->end_ns = bench->side == TCP_BENCH_RECEIVER && bench->last_data_ns != 0 ? bench->last_data_ns : monotonic_ns();
+
+    report_tcp_bench(bench);
+
+    bench->finished  = 1;
+    bench->linger_ns = monotonic_ns() + TCP_BENCH_LINGER_MS * 1000000ULL;
+
+    for (int i = 0; i < bench->num_streams; i++)
+    {
+        end_tcp_bench_stream(&bench->streams[i]);
+    }
+}
+
+/* Print a side's totals: goodput is what the sender had acknowledged, or the
+   receiver read, over the run. RTTs are the stack's own samples, to the ms of
+   its clock. */
+
+void
+report_tcp_bench(TCP_Bench *bench)
+{
+    struct rusage usage;
+    double        seconds     = (bench->end_ns - bench->start_ns) / 1e9;
+    uint64_t      bytes       = 0;
+    uint32_t      retransmits = 0;
+    int64_t       cpu_ns;
+    char          p50[16] = "-", p90[16] = "-", p99[16] = "-";
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    cpu_ns = (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec - bench->start_usage.ru_utime.tv_sec - 
+                       bench->start_usage.ru_stime.tv_sec) * 1000000000 +
+             (int64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec - bench->start_usage.ru_utime.tv_usec - 
+                       bench->start_usage.ru_stime.tv_usec) * 1000;
+
+    for (int i = 0; i < bench->num_streams; i++)
+    {
+        bytes       += bench->streams[i].bytes;
+        retransmits += bench->streams[i].retransmits;
+    }
+
+    if (bench->rtt.samples > 0)
+    {
+        snprintf(p50, sizeof(p50), "%u", tcp_rtt_percentile(&bench->rtt, 0.50));
+        snprintf(p90, sizeof(p90), "%u", tcp_rtt_percentile(&bench->rtt, 0.90));
+        snprintf(p99, sizeof(p99), "%u", tcp_rtt_percentile(&bench->rtt, 0.99));
+    }
+
+    printf("    %-9s %7d %14llu %9.3f %10.1f %8u %7s %7s %7s %9.2f\n", 
+           bench->side == TCP_BENCH_SENDER ? "sender" : "receiver", bench->num_streams, (unsigned long long)bytes,
+           seconds, seconds > 0 ? bytes * 8 / seconds / 1e6 : 0.0, retransmits, p50, p90, p99,
+           bytes > 0 ? (double)cpu_ns / bytes : 0.0);
+    fflush(stdout);
+}
+
+/* The RTT, in ms, below which a fraction of the samples fall. */
+
+uint32_t
+tcp_rtt_percentile(const TCP_RTT_Histogram *histogram, double fraction)
+{
+    uint64_t rank = histogram->samples * fraction, seen = 0;
+
+    for (uint32_t ms = 0; ms < TCP_RTT_HISTOGRAM_LEN; ms++)
+    {
+        if ((seen += histogram->counts[ms]) > rank)
+        {
+            return ms;
+        }
+    }
+
+    return TCP_RTT_HISTOGRAM_LEN - 1;
+}
+
+/* Parse a byte count, with an optional K, M or G suffix for powers of 1024.
+   Returns 0 if it is not a count. */
+
+uint64_t
+parse_byte_count(const char *count)
+{
+    char               *end;
+    unsigned long long  bytes = strtoull(count, &end, 10);
+
+    switch (*end)
+    {
+        case 'G': case 'g': bytes <<= 10; /* Fall through. */
+        case 'M': case 'm': bytes <<= 10; /* Fall through. */
+        case 'K': case 'k': bytes <<= 10; end++; break;
+    }
+
+    return end == count || *end != '\0' ? 0 : bytes;
+}
+
+/*
+    TCP BENCHMARK SENDER AND RECEIVER FUNCTIONS
+*/
+
+/* Events of a sender's stream: keep its send buffer full from the moment it
+   connects. A stream the receiver closes or that is lost is ended. */
+
+void
+tcp_bench_send_event(TCP_Socket *socket, uint8_t events, void *arg)
+{
+    TCP_Bench_Stream *stream = arg;
+
+    if (events & TCP_SOCKET_CONNECTED)
+    {
+        stream->connected = 1;
+        stream->snd_una   = socket->connection->snd_una;
+    }
+
+    if (events & (TCP_SOCKET_HUP | TCP_SOCKET_CLOSED))
+    {
+        end_tcp_bench_stream(stream);
+        return;
+    }
+
+    fill_tcp_bench_stream(stream);
+}
+
+/* Queue data until the send buffer is full or the stream's quota is sent. The
+   socket says when a short send has room again. */
+
+void
+fill_tcp_bench_stream(TCP_Bench_Stream *stream)
+{
+    ssize_t len, queued;
+
+    while (stream->quota > 0 && !stream->bench->finished)
+    {
+        len = stream->quota < TCP_BENCH_CHUNK ? stream->quota : TCP_BENCH_CHUNK;
+
+        if ((queued = tcp_socket_send(stream->socket, stream->bench->chunk, len)) <= 0)
+        {
+            break;
+        }
+
+        stream->quota -= queued;
+
+        if (queued < len)
+        {
+            break;
+        }
+    }
+}
+
+/* Count what a sender's stream has had acknowledged since it was last looked
+   at, which is well under 4 GB, so sequence numbers wrapping do not matter. */
+
+void
+update_tcp_bench_stream(TCP_Bench_Stream *stream)
+{
+    TCP_Connection *connection;
+
+    if (!stream->connected || stream->socket == NULL || (connection = stream->socket->connection) == NULL)
+    {
+        return;
+    }
+
+    stream->bytes      += connection->snd_una - stream->snd_una;
+    stream->snd_una     = connection->snd_una;
+    stream->retransmits = connection->retransmits;
+}
+
+/* Accept up to the number of streams expected. The receiver's clock starts
+   with the first. */
+
+void
+tcp_bench_accept_event(TCP_Socket *listener, uint8_t events, void *arg)
+{
+    TCP_Bench        *bench = arg;
+    TCP_Bench_Stream *stream;
+
+    while (bench->num_streams < bench->config.streams && !bench->finished)
+    {
+        stream = &bench->streams[bench->num_streams];
+
+        if ((stream->socket = tcp_socket_accept(listener, tcp_bench_receive_event, stream)) == NULL)
+        {
+            return;
+        }
+
+        stream->bench     = bench;
+        stream->connected = 1;
+        bench->num_streams++;
+
+        if (bench->start_ns == 0)
+        {
+            bench->start_ns     = monotonic_ns();
+            bench->last_data_ns = bench->start_ns;
+            getrusage(RUSAGE_SELF, &bench->start_usage);
+        }
+    }
+}
+
+/* Count and release everything a receiver's stream has, without copying it 
+   out of the frames it came in. Once every stream has been closed by the 
+   sender, the run is over. */
+
+void
+tcp_bench_receive_event(TCP_Socket *socket, uint8_t events, void *arg)
+{
+    TCP_Bench_Stream *stream = arg;
+    TCP_Bench        *bench  = stream->bench;
+    TCP_Recv_Chunk   *chunk;
+    ssize_t           len;
+
+    while ((len = tcp_socket_recv_chunk(socket, &chunk)) > 0)
+    {
+        stream->bytes       += len;
+        bench->last_data_ns  = monotonic_ns();
+        tcp_socket_release(socket, chunk);
+    }
+
+    if (len == 0 || (events & TCP_SOCKET_CLOSED))
+    {
+        end_tcp_bench_stream(stream);
+
+        if (bench->num_done == bench->config.streams && !bench->finished)
+        {
+            finish_tcp_bench(bench);
+        }
+    }
+}
+
+/* Close a stream, once. A sender's counts are brought up to date first. */
+
+void
+end_tcp_bench_stream(TCP_Bench_Stream *stream)
+{
+    if (stream->done)
+    {
+        return;
+    }
+
+    if (stream->bench->side == TCP_BENCH_SENDER)
+    {
+        update_tcp_bench_stream(stream);
+    }
+
+    tcp_socket_close(stream->socket);
+
+    stream->socket = NULL;
+    stream->done   = 1;
+    stream->bench->num_done++;
+}
+
+/*
+    TCP BENCHMARK LINK FUNCTIONS
+*/
+
+/* Join R0_0 to one end of the in-memory link, and park the other interfaces 
+   and stdin on pipes that are never written. */
+
+int
+connect_tcp_bench_link(int in_fd, int out_fd)
+{
+    int in_fds[2], out_fds[2], stdin_fds[2];
+
+    for (int i = 0; i < NUM_INTERFACES; i++)
+    {
+        if (i == TCP_BENCH_LINK_INTERFACE)
+        {
+            ROUTER_INTERFACES[i].fds[0] = in_fd;
+            ROUTER_INTERFACES[i].fds[1] = out_fd;
+            continue;
+        }
+
+        if (pipe(in_fds) == -1 || pipe(out_fds) == -1)
+        {
+            perror("pipe");
+            return -1;
+        }
+
+        ROUTER_INTERFACES[i].fds[0] = in_fds[0];
+        ROUTER_INTERFACES[i].fds[1] = out_fds[1];
+    }
+
+    if (pipe(stdin_fds) == -1 || dup2(stdin_fds[0], STDIN_FILENO) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    return 1;
+}
+
+/* Link thread. Moves frames both ways between the two instances, mirrored.
+   Writes never block: frames wait in each direction's queue while the other
+   side is busy, and are dropped if it is full, as a switch would. */
+
+void *
+run_tcp_bench_link(void *arg)
+{
+    TCP_Bench_Link *links = arg;
+    struct pollfd   poll_fds[4];
+    uint8_t         frame[ETHERNET_MAX_FRAME_LEN];
+    ssize_t         frame_len;
+    int             i;
+
+    while (1)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            poll_fds[2 * i].fd         = links[i].reader.fd;
+            poll_fds[2 * i].events     = POLLIN;
+            poll_fds[2 * i + 1].fd     = links[i].fd;
+            poll_fds[2 * i + 1].events = links[i].len > 0 ? POLLOUT : 0;
+        }
+
+        if (poll(poll_fds, 4, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("poll");
+            return NULL;
+        }
+
+        for (i = 0; i < 2; i++)
+        {
+            /* A side that has exited is not polled again. */
+
+            if ((poll_fds[2 * i].revents & (POLLIN | POLLHUP)) && fill_vde_reader(&links[i].reader) <= 0)
+            {
+                links[i].reader.fd = -1;
+            }
+
+            while ((frame_len = next_ethernet_frame(&links[i].reader, frame, sizeof(frame))) > 0)
+            {
+                mirror_ethernet_frame(frame, frame_len);
+                queue_link_frame(&links[i], frame, frame_len);
+            }
+
+            flush_link_queue(&links[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/* Swap a frame's source and destination MACs, and IPs if it is IPv4, so that
+   each instance takes the other for the tap0 host, whose addresses both have.
+   The IP and TCP checksums sum both addresses, so they still hold; only the 
+   FCS is computed again. */
+
+void
+mirror_ethernet_frame(uint8_t *frame, ssize_t frame_len)
+{
+    Ethernet_Header *ethernet_hdr = (Ethernet_Header *)frame;
+    IP_Header       *ip_hdr       = (IP_Header *)(frame + sizeof(Ethernet_Header));
+    uint8_t          mac[6];
+    uint32_t         ip, fcs;
+
+    if (frame_len < (ssize_t)(sizeof(Ethernet_Header) + ETHERNET_FCS_LEN))
+    {
+        return;
+    }
+
+    memcpy(mac, ethernet_hdr->destination, 6);
+    memcpy(ethernet_hdr->destination, ethernet_hdr->source, 6);
+    memcpy(ethernet_hdr->source, mac, 6);
+
+    if (ethernet_hdr->type == htons(IP_TYPE) && frame_len >= (ssize_t)(sizeof(Ethernet_Header) + sizeof(IP_Header) + ETHERNET_FCS_LEN))
+    {
+        ip                  = ip_hdr->source;
+        ip_hdr->source      = ip_hdr->destination;
+        ip_hdr->destination = ip;
+    }
+
+    fcs = crc32(0, frame, frame_len - ETHERNET_FCS_LEN);
+    memcpy(frame + frame_len - ETHERNET_FCS_LEN, &fcs, ETHERNET_FCS_LEN);
+}
+
+/* Add a frame, with its length prefix, to a direction's queue. Sent bytes are
+   only reclaimed when the end of the queue is reached. */
+
+void
+queue_link_frame(TCP_Bench_Link *link, const uint8_t *frame, uint16_t frame_len)
+{
+    uint16_t nbo_len = htons(frame_len);
+
+    link->frames++;
+
+    if (link->start + link->len + 2 + frame_len > TCP_BENCH_LINK_QUEUE)
+    {
+        memmove(link->queue, link->queue + link->start, link->len);
+        link->start = 0;
+    }
+
+    if (link->len + 2 + frame_len > TCP_BENCH_LINK_QUEUE)
+    {
+        link->drops++;
+        return;
+    }
+
+    memcpy(link->queue + link->start + link->len, &nbo_len, 2);
+    memcpy(link->queue + link->start + link->len + 2, frame, frame_len);
+    link->len += 2 + frame_len;
+}
+
+/* Write as much of a direction's queue as the other side's pipe takes. If the
+   side is gone, its frames are discarded. */
+
+void
+flush_link_queue(TCP_Bench_Link *link)
+{
+    ssize_t written = 0;
+
+    while (link->len > 0 && (written = write(link->fd, link->queue + link->start, link->len)) > 0)
+    {
+        link->start += written;
+        link->len   -= written;
+    }
+
+    if (written == -1 && errno != EAGAIN)
+    {
+        link->len = 0;
+    }
+
+    if (link->len == 0)
+    {
+        link->start = 0;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * bench_functions.h
+ */
+
+#ifndef BENCH_FUNCTIONS__H
+#define BENCH_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "bench.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "tcp_socket.h"
+
+/*
+    BENCHMARK FUNCTIONS
+*/
+
+int       run_benchmarks(const Scheduler_Config *config);
+void      run_benchmark(const Scheduler_Config *config);
+int       connect_benchmark_interfaces(Benchmark *bench);
+void      build_benchmark_frame(uint8_t *frame, int flow);
+void     *benchmark_generator(void *arg);
+void     *benchmark_sink(void *arg);
+int       compare_latencies(const void *a, const void *b);
+void      report_benchmark(Benchmark *bench);
+
+/*
+    TCP BENCHMARK FUNCTIONS
+*/
+
+/* Runs */
+
+int       run_tcp_benchmark(const Scheduler_Config *config, const TCP_Bench_Config *tcp_config);
+void      run_tcp_bench_side(const Scheduler_Config *config, const TCP_Bench_Config *tcp_config, int side, int ready_fd);
+int       start_tcp_bench(void *arg);
+void      tcp_bench_tick(Timer *timer, void *arg);
+void      finish_tcp_bench(TCP_Bench *bench);
+void      report_tcp_bench(TCP_Bench *bench);
+uint32_t  tcp_rtt_percentile(const TCP_RTT_Histogram *histogram, double fraction);
+uint64_t  parse_byte_count(const char *count);
+
+/* Sender and receiver */
+
+void      tcp_bench_send_event(TCP_Socket *socket, uint8_t events, void *arg);
+void      fill_tcp_bench_stream(TCP_Bench_Stream *stream);
+void      update_tcp_bench_stream(TCP_Bench_Stream *stream);
+void      tcp_bench_accept_event(TCP_Socket *listener, uint8_t events, void *arg);
+void      tcp_bench_receive_event(TCP_Socket *socket, uint8_t events, void *arg);
+void      end_tcp_bench_stream(TCP_Bench_Stream *stream);
+
+/* In-memory link */
+
+int       connect_tcp_bench_link(int in_fd, int out_fd);
+void     *run_tcp_bench_link(void *arg);
+void      mirror_ethernet_frame(uint8_t *frame, ssize_t frame_len);
+void      queue_link_frame(TCP_Bench_Link *link, const uint8_t *frame, uint16_t frame_len);
+void      flush_link_queue(TCP_Bench_Link *link);
+
+#endif /* BENCH_FUNCTIONS__H */
@@ -0,0 +1,58 @@
+/*
+ * buffer.h
+ */
+
+#ifndef BUFFER__H
+#define BUFFER__H
+
+/* Implementation Headers */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "c_headers.h"
+#include "ethernet.h"
+#include "router.h"
+
+/*
+    BUFFER STRUCTS
+*/
+
+typedef struct Packet_Buffer
+{
+    struct Packet_Buffer *next;         /* Next buffer in the pool's free list.   */
+    struct Buffer_Pool   *pool;         /* Pool the buffer is returned to.        */
+    atomic_int            refcount;     /* References held on the buffer.         */
+    int                   error;        /* IP diagnostic if the frame is dropped. */
+    int                   on_link;      /* ON_LINK or OFF_LINK for the next hop.  */
+    uint32_t              hash;         /* RSS hash of the frame's flow.          */
+    int                   next_node;    /* Node to resume at after a handoff.     */
+    ssize_t               len;          /* Length of the frame in data.           */
+    const Interface      *interface;    /* Interface the frame arrived on.        */
+    const Route          *route;        /* Route chosen by the lookup node.       */
+    const uint8_t        *next_hop_mac; /* MAC address of the next hop.           */
+    const Interface      *tx_interface; /* Interface to send the frame through.   */
+    uint8_t               data[ETHERNET_MAX_FRAME_LEN];
+} Packet_Buffer;
+
+/* A pool is owned by one thread, which takes buffers from free_list without 
+   locking. Buffers released by any other thread are pushed onto remote_free 
+   with a compare-and-swap, and the owner takes that whole list back in one 
+   atomic exchange when free_list runs dry. */
+
+typedef struct Buffer_Pool
+{
+    Packet_Buffer            *free_list;   /* Buffers available for frames.       */
+    _Atomic(Packet_Buffer *)  remote_free; /* Buffers released by other threads.  */
+    Packet_Buffer            *buffers;     /* Backing storage for all buffers.    */
+    size_t                    num_buffers; /* Total buffers in the pool.          */
+    size_t                    num_free;    /* Buffers currently on the free list. */
+    pthread_t                 owner;       /* Thread that takes buffers from pool.*/
+} Buffer_Pool;
+
+/*
+    BUFFER CONSTANTS
+*/
+
+#define BUFFER_POOL_SIZE           1024
+
+#endif /* BUFFER__H */
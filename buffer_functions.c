@@ -0,0 +1,165 @@
+/*
+ * buffer_functions.c
+ */
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "ip.h"
+#include "buffer.h"
+#include "buffer_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/* Initialize a pool of packet buffers owned by the calling thread. All buffers are 
+   allocated up front so that receiving a frame never calls malloc. If malloc 
+   fails, return -1. */
+
+int
+init_buffer_pool(Buffer_Pool *pool, size_t num_buffers)
+{
+    Packet_Buffer *buffer;
+    size_t         i;
+
+    /* Malloc space for buffers. */
+
+    if ((pool->buffers = malloc(num_buffers * sizeof(Packet_Buffer))) == NULL)
+    {
+        return -1;
+    }
+
+    /* Link every buffer into the free list. */
+
+    pool->free_list   = NULL;
+    pool->num_buffers = num_buffers;
+    pool->num_free    = num_buffers;
+    pool->owner       = pthread_self();
+    atomic_init(&pool->remote_free, NULL);
+
+    for (i = num_buffers; i > 0; i--)
+    {
+        buffer           = &pool->buffers[i - 1];
+        buffer->pool     = pool;
+        buffer->next     = pool->free_list;
+        atomic_init(&buffer->refcount, 0);
+        pool->free_list  = buffer;
+    }
+
+    return 1;
+}
+
+/* Free the backing storage of a buffer pool. */
+
+void
+free_buffer_pool(Buffer_Pool *pool)
+{
+    free(pool->buffers);
+
+    pool->buffers     = NULL;
+    pool->free_list   = NULL;
+    pool->num_buffers = 0;
+    pool->num_free    = 0;
+}
+
+/* Make the calling thread the owner of a pool. Must be called before the thread 
+   takes any buffers from a pool initialized elsewhere. */
+
+void
+claim_buffer_pool(Buffer_Pool *pool)
+{
+    pool->owner = pthread_self();
+}
+
+/* Take a buffer from the pool with a single reference held. Returns NULL if
+   the pool is exhausted. */
+
+Packet_Buffer *
+get_packet_buffer(Buffer_Pool *pool)
+{
+    Packet_Buffer *buffer = pool->free_list;
+
+    /* Take back every buffer released by other threads. */
+
+    if (buffer == NULL)
+    {
+        buffer = atomic_exchange_explicit(&pool->remote_free, NULL, memory_order_acquire);
+
+        if (buffer == NULL)
+        {
+            return NULL;
+        }
+
+        pool->free_list = buffer;
+
+        for (; buffer != NULL; buffer = buffer->next)
+        {
+            pool->num_free++;
+        }
+
+        buffer = pool->free_list;
+    }
+
+    /* Unlink from the free list and reset per-frame metadata. */
+
+    pool->free_list      = buffer->next;
+    pool->num_free--;
+
+    buffer->next         = NULL;
+    atomic_store_explicit(&buffer->refcount, 1, memory_order_relaxed);
+    buffer->error        = -1;
+    buffer->on_link      = OFF_LINK;
+    buffer->hash         = 0;
+    buffer->next_node    = 0;
+    buffer->len          = 0;
+    buffer->interface    = NULL;
+    buffer->route        = NULL;
+    buffer->next_hop_mac = NULL;
+    buffer->tx_interface = NULL;
+
+    return buffer;
+}
+
+/* Take an extra reference on a buffer. */
+
+void
+hold_packet_buffer(Packet_Buffer *buffer)
+{
+    atomic_fetch_add_explicit(&buffer->refcount, 1, memory_order_relaxed);
+}
+
+/* Drop a reference on a buffer. Once no references remain, the buffer is
+   returned to its pool: directly if released by the owning thread, or through
+   the pool's remote free list otherwise. */
+
+void
+release_packet_buffer(Packet_Buffer *buffer)
+{
+    Buffer_Pool   *pool = buffer->pool;
+    Packet_Buffer *head;
+
+    /* A sole holder skips the atomic read-modify-write. */
+
+    if (atomic_load_explicit(&buffer->refcount, memory_order_acquire) != 1 &&
+        atomic_fetch_sub_explicit(&buffer->refcount, 1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    if (pthread_equal(pthread_self(), pool->owner))
+    {
+        buffer->next    = pool->free_list;
+        pool->free_list = buffer;
+        pool->num_free++;
+        return;
+    }
+
+    head = atomic_load_explicit(&pool->remote_free, memory_order_relaxed);
+
+    do
+    {
+        buffer->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->remote_free, &head, buffer,
+                                                    memory_order_release, memory_order_relaxed));
+}
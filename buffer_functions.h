@@ -0,0 +1,24 @@
+/*
+ * buffer_functions.h
+ */
+
+#ifndef BUFFER_FUNCTIONS__H
+#define BUFFER_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "buffer.h"
+
+/*
+    BUFFER FUNCTIONS
+*/
+
+int            init_buffer_pool(Buffer_Pool *pool, size_t num_buffers);
+void           free_buffer_pool(Buffer_Pool *pool);
+void           claim_buffer_pool(Buffer_Pool *pool);
+Packet_Buffer *get_packet_buffer(Buffer_Pool *pool);
+void           hold_packet_buffer(Packet_Buffer *buffer);
+void           release_packet_buffer(Packet_Buffer *buffer);
+
+#endif /* BUFFER_FUNCTIONS__H */
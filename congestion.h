@@ -0,0 +1,74 @@
+/*
+ * congestion.h
+ */
+
+#ifndef CONGESTION__H
+#define CONGESTION__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+
+/*
+    CONGESTION CONTROL CONSTANTS
+*/
+
+#define TCP_DUPACK_THRESHOLD       3            /* Dup ACKs before fast retransmit. */
+#define TCP_ABC_LIMIT              2            /* Slow start growth per ACK, in MSS
+                                                   (RFC 3465).                      */
+#define CUBIC_C                    0.4          /* Scaling constant (RFC 9438).     */
+#define CUBIC_BETA                 0.7          /* Multiplicative decrease.         */
+
+/*
+    CONGESTION CONTROL STRUCTS
+*/
+
+struct TCP_Connection;
+
+/* Loss recovery state of a connection. */
+
+typedef enum TCP_CA_State
+{
+    TCP_CA_OPEN,                                /* No loss being recovered.         */
+    TCP_CA_RECOVERY,                            /* Fast recovery (RFC 6582).        */
+    TCP_CA_LOSS                                 /* Recovering from an RTO.          */
+} TCP_CA_State;
+
+typedef struct Reno_State
+{
+    uint32_t        bytes_acked;                /* Acked since cwnd last grew.      */
+} Reno_State;
+
+/* CUBIC windows are kept in segments, as in RFC 9438. */
+
+typedef struct Cubic_State
+{
+    double          w_max;                      /* Window before the last decrease. */
+    double          k;                          /* Seconds to get back to w_max.    */
+    double          origin;                     /* Window the cubic curve plateaus. */
+    double          w_est;                      /* Reno-friendly window estimate.   */
+    int64_t         epoch_start;                /* Tick the epoch began, or -1.     */
+} Cubic_State;
+
+typedef union TCP_Congestion_State
+{
+    Reno_State      reno;
+    Cubic_State     cubic;
+} TCP_Congestion_State;
+
+/* A congestion control algorithm. Loss detection and recovery (fast retransmit,
+   NewReno partial ACKs, RTO) are common to all of them; an algorithm decides
+   how cwnd grows on new ACKs and what ssthresh becomes after a loss. */
+
+typedef struct TCP_Congestion_Ops
+{
+    const char     *name;
+    void          (*init)(struct TCP_Connection *connection);
+    void          (*cong_avoid)(struct TCP_Connection *connection, uint32_t acked);
+    uint32_t      (*ssthresh)(struct TCP_Connection *connection);
+} TCP_Congestion_Ops;
+
+extern const TCP_Congestion_Ops TCP_CONGESTION_ALGORITHMS[];
+extern const int                NUM_CONGESTION_ALGORITHMS;
+
+#endif /* CONGESTION__H */
@@ -0,0 +1,378 @@
+/*
+ * congestion_functions.c
+ */
+
+/* Implementation Headers */
+
+#include <math.h>
+#include <strings.h>
+#include "c_headers.h"
+#include "router.h"
+#include "congestion.h"
+#include "congestion_functions.h"
+#include "tcp_functions.h"
+#include "timer_functions.h"
+
+/*
+    CONGESTION CONTROL ALGORITHMS
+*/
+
+/* The first algorithm is the default for new connections. */
+
+const TCP_Congestion_Ops TCP_CONGESTION_ALGORITHMS[] = {
+    { "newreno", reno_init,  reno_cong_avoid,  reno_ssthresh  },
+    { "cubic",   cubic_init, cubic_cong_avoid, cubic_ssthresh },
+};
+
+const int NUM_CONGESTION_ALGORITHMS = sizeof(TCP_CONGESTION_ALGORITHMS) / sizeof(TCP_Congestion_Ops);
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/*
+    COMMON FUNCTIONS
+*/
+
+/* Find an algorithm by name, ignoring case. Returns NULL if there is none. */
+
+const TCP_Congestion_Ops *
+find_congestion_control(const char *name)
+{
+    for (int i = 0; i < NUM_CONGESTION_ALGORITHMS; i++)
+    {
+        if (strcasecmp(TCP_CONGESTION_ALGORITHMS[i].name, name) == 0)
+        {
+            return &TCP_CONGESTION_ALGORITHMS[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Start a new connection in slow start with the initial window of RFC 5681 and
+   an unbounded ssthresh. */
+
+void
+init_congestion_control(TCP_Connection *connection, const TCP_Congestion_Ops *ops)
+{
+    connection->cwnd     = TCP_INITIAL_CWND(connection->mss);
+    connection->ssthresh = UINT32_MAX;
+    connection->recover  = connection->seq_number;
+    connection->dupacks  = 0;
+    connection->ca_state = TCP_CA_OPEN;
+    connection->cc_ops   = ops;
+
+    ops->init(connection);
+}
+
+/* Switch a connection to another algorithm. The windows are kept, and the new
+   algorithm starts from them. */
+
+void
+set_congestion_control(TCP_Connection *connection, const TCP_Congestion_Ops *ops)
+{
+    connection->cc_ops = ops;
+    ops->init(connection);
+    trace_congestion(connection, "switch");
+}
+
+/* Update the windows for an ACK. acked is the number of newly acknowledged
+   sequence numbers, and dup is set for a duplicate ACK (RFC 5681 2). The third
+   duplicate starts fast retransmit and fast recovery, and partial ACKs in
+   recovery resend the next hole (NewReno, RFC 6582). Otherwise cwnd grows as
+   the algorithm decides. */
+
+void
+tcp_congestion_ack(TCP_Connection *connection, uint32_t ack, uint32_t acked, int dup)
+{
+    uint32_t mss = connection->mss, flight;
+
+    if (dup)
+    {
+        connection->dupacks += connection->dupacks < UINT8_MAX;
+
+        if (connection->ca_state == TCP_CA_RECOVERY)
+        {
+            /* Each duplicate means a segment has left the network. With SACK,
+               it may also show the next hole to fill. */
+
+            connection->cwnd += mss;
+
+            if (connection->opt_flags & TCP_OPT_SACK_PERMITTED)
+            {
+                retransmit_tcp_segment(connection);
+            }
+
+            trace_congestion(connection, "dupack");
+        }
+        else if (connection->ca_state == TCP_CA_OPEN && connection->dupacks == TCP_DUPACK_THRESHOLD &&
+                 SEQ_GT(ack, connection->recover))
+        {
+            connection->ssthresh = connection->cc_ops->ssthresh(connection);
+            connection->cwnd     = connection->ssthresh + TCP_DUPACK_THRESHOLD * mss;
+            connection->recover  = connection->seq_number;
+            connection->ca_state = TCP_CA_RECOVERY;
+            connection->high_rxt = connection->snd_una;
+
+            retransmit_tcp_segment(connection);
+            trace_congestion(connection, "fast-retransmit");
+        }
+        return;
+    }
+
+    if (acked == 0)
+    {
+        return;
+    }
+
+    connection->dupacks = 0;
+
+    switch (connection->ca_state)
+    {
+        case TCP_CA_RECOVERY:
+
+            if (SEQ_GEQ(ack, connection->recover))
+            {
+                /* Full ACK: deflate the window and leave recovery. */
+
+                flight               = connection->seq_number - connection->snd_una;
+                connection->cwnd     = flight + mss < connection->ssthresh ? flight + mss : connection->ssthresh;
+                connection->ca_state = TCP_CA_OPEN;
+                trace_congestion(connection, "recovered");
+            }
+            else
+            {
+                /* Partial ACK: resend the next hole and deflate by what was
+                   acknowledged, less one segment. */
+
+                connection->cwnd -= acked < connection->cwnd - mss ? acked : connection->cwnd - mss;
+                connection->cwnd += acked >= mss ? mss : 0;
+
+                retransmit_tcp_segment(connection);
+                trace_congestion(connection, "partial-ack");
+            }
+            return;
+
+        case TCP_CA_LOSS:
+
+            /* After an RTO, segments sent before it are presumed lost too. */
+
+            if (SEQ_LT(ack, connection->recover))
+            {
+                if (connection->rtx_head != NULL && connection->rtx_head->retransmits == 0)
+                {
+                    retransmit_tcp_segment(connection);
+                }
+            }
+            else
+            {
+                connection->ca_state = TCP_CA_OPEN;
+            }
+            break;
+
+        case TCP_CA_OPEN:
+
+            break;
+    }
+
+    connection->cc_ops->cong_avoid(connection, acked);
+    trace_congestion(connection, "ack");
+}
+
+/* The retransmission timer fired: fall back to one segment and slow start.
+   ssthresh is only lowered for the first timeout of a segment, so repeated
+   timeouts do not collapse it (RFC 5681 3.1). A zero window probe is not a loss. */
+
+void
+tcp_congestion_timeout(TCP_Connection *connection)
+{
+    if (connection->snd_wnd == 0)
+    {
+        return;
+    }
+
+    if (connection->rtx_head->retransmits == 0)
+    {
+        connection->ssthresh = connection->cc_ops->ssthresh(connection);
+    }
+
+    connection->cwnd     = connection->mss;
+    connection->recover  = connection->seq_number;
+    connection->dupacks  = 0;
+    connection->ca_state = TCP_CA_LOSS;
+
+    trace_congestion(connection, "timeout");
+}
+
+/* Grow cwnd by what was acknowledged, up to TCP_ABC_LIMIT segments per ACK and
+   no further than ssthresh. Returns what is left of acked for congestion
+   avoidance once ssthresh is reached. */
+
+uint32_t
+tcp_slow_start(TCP_Connection *connection, uint32_t acked)
+{
+    uint32_t increase = acked < TCP_ABC_LIMIT * connection->mss ? acked : TCP_ABC_LIMIT * connection->mss;
+
+    if (increase > connection->ssthresh - connection->cwnd)
+    {
+        increase = connection->ssthresh - connection->cwnd;
+    }
+
+    connection->cwnd += increase;
+
+    return connection->cwnd < connection->ssthresh ? 0 : acked - increase;
+}
+
+/* Write a line of cwnd/ssthresh trace for a connection, if tracing is on. The
+   fields are: ms, peer address, peer port, algorithm, event, cwnd, ssthresh and
+   bytes in flight. */
+
+void
+trace_congestion(const TCP_Connection *connection, const char *event)
+{
+    uint32_t net_dst_ip;
+    char     dst_ip[INET_ADDRSTRLEN];
+
+    if (TCP_CC_TRACE == NULL)
+    {
+        return;
+    }
+
+    net_dst_ip = htonl(connection->dst_ip);
+    inet_ntop(AF_INET, &net_dst_ip, dst_ip, INET_ADDRSTRLEN);
+
+    fprintf(TCP_CC_TRACE, "%llu,%s,%d,%s,%s,%u,%u,%u\n", (unsigned long long)timer_wheel_clock(&TIMER_WHEEL),
+            dst_ip, connection->dst_port, connection->cc_ops->name, event, connection->cwnd,
+            connection->ssthresh, connection->seq_number - connection->snd_una);
+}
+
+/*
+    NEWRENO FUNCTIONS
+*/
+
+void
+reno_init(TCP_Connection *connection)
+{
+    connection->cc.reno.bytes_acked = 0;
+}
+
+/* Slow start, then grow cwnd by one segment per window of acknowledged bytes
+   (appropriate byte counting, RFC 3465). */
+
+void
+reno_cong_avoid(TCP_Connection *connection, uint32_t acked)
+{
+    Reno_State *reno = &connection->cc.reno;
+
+    if (connection->cwnd < connection->ssthresh && (acked = tcp_slow_start(connection, acked)) == 0)
+    {
+        return;
+    }
+
+    reno->bytes_acked += acked;
+
+    if (reno->bytes_acked >= connection->cwnd)
+    {
+        reno->bytes_acked -= connection->cwnd;
+        connection->cwnd  += connection->mss;
+    }
+}
+
+/* Halve the data in flight, but keep at least two segments (RFC 5681 eq. 4). */
+
+uint32_t
+reno_ssthresh(TCP_Connection *connection)
+{
+    uint32_t flight = connection->seq_number - connection->snd_una;
+
+    connection->cc.reno.bytes_acked = 0;
+
+    return flight / 2 > 2 * connection->mss ? flight / 2 : 2 * connection->mss;
+}
+
+/*
+    CUBIC FUNCTIONS
+*/
+
+void
+cubic_init(TCP_Connection *connection)
+{
+    Cubic_State *cubic = &connection->cc.cubic;
+
+    cubic->w_max       = 0;
+    cubic->k           = 0;
+    cubic->origin      = 0;
+    cubic->w_est       = 0;
+    cubic->epoch_start = -1;
+}
+
+/* Slow start, then follow W(t) = C * (t - K)^3 + W_max from the start of the
+   epoch, one RTT ahead, or the Reno-friendly estimate if that is larger
+   (RFC 9438 4.2 to 4.4). */
+
+void
+cubic_cong_avoid(TCP_Connection *connection, uint32_t acked)
+{
+    Cubic_State *cubic = &connection->cc.cubic;
+    uint64_t     now   = timer_wheel_clock(&TIMER_WHEEL);
+    double       cwnd, target, t;
+
+    if (connection->cwnd < connection->ssthresh && (acked = tcp_slow_start(connection, acked)) == 0)
+    {
+        return;
+    }
+
+    cwnd = (double)connection->cwnd / connection->mss;
+
+    /* A new epoch starts on the first ACK after a decrease. */
+
+    if (cubic->epoch_start < 0)
+    {
+        cubic->epoch_start = now;
+        cubic->w_est       = cwnd;
+
+        if (cwnd < cubic->w_max)
+        {
+            cubic->k      = cbrt((cubic->w_max - cwnd) / CUBIC_C);
+            cubic->origin = cubic->w_max;
+        }
+        else
+        {
+            cubic->k      = 0;
+            cubic->origin = cwnd;
+        }
+    }
+
+    t      = (now - cubic->epoch_start + (connection->srtt >> TCP_RTT_SHIFT)) / 1000.0;
+    target = cubic->origin + CUBIC_C * (t - cubic->k) * (t - cubic->k) * (t - cubic->k);
+    target = target > 1.5 * cwnd ? 1.5 * cwnd : target;
+
+    /* Reno-friendly region. */
+
+    cubic->w_est += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked / connection->mss / cwnd;
+    target        = cubic->w_est > target ? cubic->w_est : target;
+
+    if (target > cwnd)
+    {
+        connection->cwnd += (uint32_t)((target - cwnd) / cwnd * acked);
+    }
+}
+
+/* Remember the window the loss happened at, lower for fast convergence when it
+   is below the previous one, and cut cwnd by beta. */
+
+uint32_t
+cubic_ssthresh(TCP_Connection *connection)
+{
+    Cubic_State *cubic = &connection->cc.cubic;
+    double       cwnd  = (double)connection->cwnd / connection->mss;
+    uint32_t     ssthresh;
+
+    cubic->w_max       = cwnd < cubic->w_max ? cwnd * (1 + CUBIC_BETA) / 2 : cwnd;
+    cubic->epoch_start = -1;
+
+    ssthresh = connection->cwnd * CUBIC_BETA;
+
+    return ssthresh > 2 * connection->mss ? ssthresh : 2 * connection->mss;
+}
@@ -0,0 +1,40 @@
+/*
+ * congestion_functions.h
+ */
+
+#ifndef CONGESTION_FUNCTIONS__H
+#define CONGESTION_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "congestion.h"
+#include "tcp.h"
+
+/*
+    CONGESTION CONTROL FUNCTIONS
+*/
+
+/* Common */
+
+const TCP_Congestion_Ops *find_congestion_control(const char *name);
+void                      init_congestion_control(TCP_Connection *connection, const TCP_Congestion_Ops *ops);
+void                      set_congestion_control(TCP_Connection *connection, const TCP_Congestion_Ops *ops);
+void                      tcp_congestion_ack(TCP_Connection *connection, uint32_t ack, uint32_t acked, int dup);
+void                      tcp_congestion_timeout(TCP_Connection *connection);
+uint32_t                  tcp_slow_start(TCP_Connection *connection, uint32_t acked);
+void                      trace_congestion(const TCP_Connection *connection, const char *event);
+
+/* NewReno */
+
+void                      reno_init(TCP_Connection *connection);
+void                      reno_cong_avoid(TCP_Connection *connection, uint32_t acked);
+uint32_t                  reno_ssthresh(TCP_Connection *connection);
+
+/* CUBIC */
+
+void                      cubic_init(TCP_Connection *connection);
+void                      cubic_cong_avoid(TCP_Connection *connection, uint32_t acked);
+uint32_t                  cubic_ssthresh(TCP_Connection *connection);
+
+#endif /* CONGESTION_FUNCTIONS__H */
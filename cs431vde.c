@@ -7,11 +7,100 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 #include <arpa/inet.h>
+#include "cs431vde.h"
 
 /* These functions manage the fact that VDE expects the first 2 octets written
  * to be the length of the frame, in octets, in big-endian format.  Therefore,
- * send_ethernet_frame adds those and receive_ethernet_frame removes them. */
+ * send_ethernet_frame adds those and receive_ethernet_frame removes them.
+ *
+ * send_ethernet_frame writes the length and frame with writev(2), and
+ * send_ethernet_burst (below) writes many frames at once.  A burst may be far
+ * larger than PIPE_BUF, so POSIX does not make its write atomic,
+ * and any write may come up short.  Every write to a descriptor therefore
+ * holds that descriptor's lock and carries on until the whole frame or burst
+ * is written, so threads sending on the same interface never split a frame
+ * and vde_plug always sees a whole length-prefixed stream. */
+
+/* Descriptors share VDE_WRITE_LOCKS locks by their number. */
+
+static pthread_mutex_t vde_write_locks[VDE_WRITE_LOCKS];
+static pthread_once_t  vde_write_locks_once = PTHREAD_ONCE_INIT;
+
+static void
+init_vde_write_locks(void)
+{
+    int i;
+
+    for (i = 0; i < VDE_WRITE_LOCKS; i++)
+    {
+        pthread_mutex_init(&vde_write_locks[i], NULL);
+    }
+}
+
+static pthread_mutex_t *
+vde_write_lock(int fd)
+{
+    pthread_once(&vde_write_locks_once, init_vde_write_locks);
+
+    return &vde_write_locks[(unsigned)fd % VDE_WRITE_LOCKS];
+}
+
+/* Write all of iov to fd, resuming after short writes and interrupted calls,
+ * and waiting if the pipe is non-blocking and full.  The caller holds the
+ * descriptor's lock.  Returns -1 if the write fails, in which case the
+ * stream may hold a partial frame. */
+
+static int
+write_vde_iov(int fd, struct iovec *iov, int iovcnt)
+{
+    struct pollfd pfd;
+    ssize_t       n;
+
+    while (iovcnt > 0)
+    {
+        if ((n = writev(fd, iov, iovcnt)) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                pfd.fd     = fd;
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+
+            perror("writev");
+            return -1;
+        }
+
+        /* Skip what was written, and resume inside a partly written entry. */
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0)
+        {
+            iov->iov_base  = (uint8_t *)iov->iov_base + n;
+            iov->iov_len  -= n;
+        }
+    }
+
+    return 0;
+}
 
 ssize_t
 receive_ethernet_frame(int fd, void *buf)
@@ -27,12 +116,190 @@ receive_ethernet_frame(int fd, void *buf)
 
 void
 send_ethernet_frame(int fd, void *frame, uint16_t len)
+{
+    uint16_t         nbo_len;
+    struct iovec     iov[2];
+    pthread_mutex_t *lock = vde_write_lock(fd);
+
+    nbo_len         = htons(len);
+    iov[0].iov_base = &nbo_len;
+    iov[0].iov_len  = 2;
+    iov[1].iov_base = frame;
+    iov[1].iov_len  = len;
+
+    pthread_mutex_lock(lock);
+    write_vde_iov(fd, iov, 2);
+    pthread_mutex_unlock(lock);
+}
+
+/* The burst functions below amortize system calls over many frames.  A
+ * VDE_Reader puts the pipe in non-blocking mode and pulls in as many
+ * length-prefixed frames as a single read(2) returns; next_ethernet_frame then
+ * hands them out one at a time, carrying any partial frame over to the next
+ * fill.  send_ethernet_burst writes a whole burst with as few writev(2) calls
+ * as it can, holding the descriptor's lock throughout.
+ *
+ * init_vde_reader returns 0 on success and -1 if the descriptor cannot be
+ * made non-blocking. */
+
+int
+init_vde_reader(VDE_Reader *reader, int fd)
+{
+    int flags;
+
+    reader->fd       = fd;
+    reader->start    = 0;
+    reader->end      = 0;
+    reader->too_long = 0;
+
+    if ((flags = fcntl(fd, F_GETFL)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        perror("fcntl");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Returns the number of octets read, 0 on end of file, or -1 with errno set
+ * (EAGAIN when the pipe is empty). */
+
+ssize_t
+fill_vde_reader(VDE_Reader *reader)
+{
+    ssize_t n;
+
+    /* Move any partial frame to the front of the buffer. */
+    if (reader->start > 0)
+    {
+        memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+        reader->end  -= reader->start;
+        reader->start = 0;
+    }
+
+    /* Only reachable if the caller refills without taking buffered frames. */
+
+    if (reader->end == VDE_READ_BUFFER_LEN)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    n = read(reader->fd, reader->buf + reader->end, VDE_READ_BUFFER_LEN - reader->end);
+
+    if (n > 0)
+    {
+        reader->end += n;
+    }
+
+    return n;
+}
+
+/* Copies the next complete frame into buf and returns its length, or returns
+ * 0 if no complete frame is buffered.  Frames longer than buf_len are
+ * skipped and counted in too_long. */
+
+ssize_t
+next_ethernet_frame(VDE_Reader *reader, void *buf, size_t buf_len)
+{
+    uint16_t nbo_len, len;
+
+    while (reader->end - reader->start >= 2)
+    {
+        memcpy(&nbo_len, reader->buf + reader->start, 2);
+        len = ntohs(nbo_len);
+
+        if (reader->end - reader->start < 2 + (size_t)len)
+        {
+            return 0;
+        }
+
+        reader->start += 2;
+
+        if (len > buf_len)
+        {
+            reader->start += len;
+            reader->too_long++;
+            continue;
+        }
+
+        memcpy(buf, reader->buf + reader->start, len);
+        reader->start += len;
+
+        return len;
+    }
+
+    return 0;
+}
+
+/* Returns 1 if a complete frame is already buffered.  Such frames will not
+ * wake poll(2), so callers must drain them before blocking. */
+
+int
+vde_reader_has_frame(VDE_Reader *reader)
 {
     uint16_t nbo_len;
 
-    nbo_len = htons(len);
-    write(fd, &nbo_len, 2);
-    write(fd, frame, len);
+    if (reader->end - reader->start < 2)
+    {
+        return 0;
+    }
+
+    memcpy(&nbo_len, reader->buf + reader->start, 2);
+
+    return reader->end - reader->start >= 2 + (size_t)ntohs(nbo_len);
+}
+
+/* Bytes waiting to be received: buffered in the reader plus unread in the
+ * pipe. Returns -1 if the pipe cannot be queried. */
+
+ssize_t
+vde_queue_depth(VDE_Reader *reader)
+{
+    int pending;
+
+    if (ioctl(reader->fd, FIONREAD, &pending) == -1)
+    {
+        return -1;
+    }
+
+    return reader->end - reader->start + pending;
+}
+
+void
+send_ethernet_burst(int fd, void *frames[], uint16_t lens[], int num_frames)
+{
+    struct iovec     iov[2 * VDE_MAX_BURST];
+    uint16_t         nbo_lens[VDE_MAX_BURST];
+    pthread_mutex_t *lock = vde_write_lock(fd);
+    int              i, n;
+
+    pthread_mutex_lock(lock);
+
+    while (num_frames > 0)
+    {
+        n = (num_frames > VDE_MAX_BURST) ? VDE_MAX_BURST : num_frames;
+
+        for (i = 0; i < n; i++)
+        {
+            nbo_lens[i]         = htons(lens[i]);
+            iov[2 * i].iov_base = &nbo_lens[i];
+            iov[2 * i].iov_len  = 2;
+            iov[2 * i + 1].iov_base = frames[i];
+            iov[2 * i + 1].iov_len  = lens[i];
+        }
+
+        if (write_vde_iov(fd, iov, 2 * n) == -1)
+        {
+            break;
+        }
+
+        frames     += n;
+        lens       += n;
+        num_frames -= n;
+    }
+
+    pthread_mutex_unlock(lock);
 }
 
 /* This function takes the place of dpipe(1), shipped with vde, which is
@@ -2,10 +2,39 @@
  * cs431vde.h
  */
 
+#ifndef CS431VDE__H
+#define CS431VDE__H
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+/* Buffered reader for a VDE pipe. A single read(2) can pull in many
+ * length-prefixed frames, which are then handed out one at a time.  The
+ * buffer holds more than the largest frame (2 + 65535 octets), so a partial
+ * frame moved to the front always leaves room to read the rest of it. */
+
+#define VDE_READ_BUFFER_LEN (2 * 65536)
+#define VDE_MAX_BURST       256
+#define VDE_WRITE_LOCKS     64      /* Locks shared by descriptor number. */
+
+typedef struct VDE_Reader
+{
+    int      fd;
+    size_t   start;
+    size_t   end;
+    uint64_t too_long;      /* Frames skipped as longer than the caller's buffer. */
+    uint8_t  buf[VDE_READ_BUFFER_LEN];
+} VDE_Reader;
+
 int     connect_to_vde_switch(int fds[2], char *cmd[]);
 ssize_t receive_ethernet_frame(int fd, void *buf);
 void    send_ethernet_frame(int fd, void *frame, uint16_t len);
+int     init_vde_reader(VDE_Reader *reader, int fd);
+ssize_t fill_vde_reader(VDE_Reader *reader);
+ssize_t next_ethernet_frame(VDE_Reader *reader, void *buf, size_t buf_len);
+int     vde_reader_has_frame(VDE_Reader *reader);
+ssize_t vde_queue_depth(VDE_Reader *reader);
+void    send_ethernet_burst(int fd, void *frames[], uint16_t lens[], int num_frames);
+
+#endif /* CS431VDE__H */
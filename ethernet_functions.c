@@ -14,6 +14,8 @@
 #include "ip.h"
 #include "ip_functions.h"
 #include "arp_functions.h"
+#include "buffer_functions.h"
+#include "graph_functions.h"
 
 /* 
     FUNCTION IMPLEMENTATIONS
@@ -271,3 +273,70 @@ construct_ethernet_frame(const uint8_t *mac_source, const uint8_t *mac_dest,
 
     return frame;
 }
+
+/* 
+    GRAPH NODES
+*/
+
+/* Ethernet input node. Checks the length and destination of each frame in the 
+   vector and dispatches it to the node registered for its Ethernet type. ARP 
+   broadcasts are accepted; other frames not for the interface are dropped. */
+
+void
+ethernet_input_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Ethernet_Header *ethernet_hdr;
+    Packet_Buffer   *buffer;
+    uint16_t         ether_type;
+    int              i, next_node, broadcast;
+    char            *source_addr;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        buffer       = buffers[i];
+        ethernet_hdr = (Ethernet_Header *)buffer->data;
+
+        /* Check minimum frame length without frame check sequence. */
+
+        if (buffer->len < ETHERNET_MIN_FRAME_LEN - ETHERNET_FCS_LEN)
+        {
+            printf("ignoring %ld-byte frame (short) \n", buffer->len);
+            release_packet_buffer(buffer);
+            continue;
+        }
+
+        ether_type = ntohs(ethernet_hdr->type);
+        broadcast  = memcmp(ethernet_hdr->destination, BROADCAST_ADDR, 6) == 0;
+
+        /* Check destination. Only ARP broadcasts are accepted. */
+
+        if (memcmp(ethernet_hdr->destination, buffer->interface->mac_address, 6) != 0 &&
+            !(broadcast && ether_type == ARP_TYPE))
+        {
+            if (broadcast)
+            {
+                source_addr = binary_to_hex(ethernet_hdr->source, 6);
+                printf("received %ld-byte broadcast frame from %s", buffer->len, source_addr);
+                free(source_addr);
+            }
+            else
+            {
+                printf("ignoring %ld-byte frame (not for me) \n", buffer->len);
+            }
+
+            release_packet_buffer(buffer);
+            continue;
+        }
+
+        /* Dispatch by Ethernet type. */
+
+        if ((next_node = graph_ethertype_node(graph, ether_type)) == GRAPH_NO_NODE)
+        {
+            printf("ignoring %ld-byte frame (unrecognized type) \n", buffer->len);
+            release_packet_buffer(buffer);
+            continue;
+        }
+
+        graph_enqueue(graph, next_node, buffer);
+    }
+}
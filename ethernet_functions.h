@@ -10,6 +10,7 @@
 #include "c_headers.h"
 #include "router.h"
 #include "ethernet.h"
+#include "graph.h"
 
 /* 
     ETHERNET FUNCTIONS
@@ -22,5 +23,9 @@ int      get_ethernet_type(uint8_t *ether_frame);
 void     modify_ethernet_frame(uint8_t *ether_frame, ssize_t frame_len, const uint8_t *source, const uint8_t *dest);
 uint8_t *construct_ethernet_frame(const uint8_t *mac_source, const uint8_t *mac_dest, uint16_t type, 
                                   void *payload, ssize_t payload_len);
+
+/* Graph nodes */
+
+void     ethernet_input_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
                                   
 #endif /* ETHERNET_FUNCTIONS__H */
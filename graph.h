@@ -0,0 +1,73 @@
+/*
+ * graph.h
+ */
+
+#ifndef GRAPH__H
+#define GRAPH__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "buffer.h"
+
+/*
+    GRAPH CONSTANTS
+*/
+
+#define GRAPH_VECTOR_SIZE          256
+#define GRAPH_MAX_NODES            32
+#define GRAPH_MAX_ETHERTYPES       8
+#define GRAPH_NO_NODE              -1
+
+/* Core Nodes (registered by init_graph, in dispatch order) */
+
+#define NODE_ETHERNET_INPUT        0
+#define NODE_IP_INPUT              1
+#define NODE_IP_LOOKUP             2
+#define NODE_IP_LOCAL              3
+#define NODE_IP_REWRITE            4
+#define NODE_INTERFACE_OUTPUT      5
+
+/*
+    GRAPH STRUCTS
+*/
+
+struct Graph;
+
+/* A node processes a whole vector of frames before any other node runs. Each 
+   frame is either enqueued to a next node or released back to its pool. */
+
+typedef void (*Graph_Node_Function)(struct Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
+typedef struct Graph_Node
+{
+    const char          *name;                           /* Node name for statistics.     */
+    Graph_Node_Function  function;                       /* Vector processing function.   */
+    int                  num_buffers;                    /* Frames pending for this node. */
+    Packet_Buffer       *vector[GRAPH_VECTOR_SIZE];      /* Pending frames.               */
+    uint64_t             calls;                          /* Times the node has run.       */
+    uint64_t             frames;                         /* Frames processed.             */
+    uint64_t             nanoseconds;                    /* Time spent in the node.       */
+    uint64_t             drops;                          /* Frames dropped, vector full.  */
+} Graph_Node;
+
+typedef struct Ethertype_Node
+{
+    uint16_t             type;                           /* Ethernet type.                */
+    int                  node;                           /* Node handling the type.       */
+} Ethertype_Node;
+
+typedef struct Graph
+{
+    Buffer_Pool         *pool;                           /* Pool for received frames.     */
+    int                  num_nodes;                      /* Registered nodes.             */
+    int                  num_ethertypes;                 /* Registered ethertypes.        */
+    int                  ip_error_node;                  /* Node for dropped IP packets.  */
+    int                  current_node;                   /* Node being run by dispatch.   */
+    void                *context;                        /* Owner of the graph (worker).  */
+    Graph_Node           nodes[GRAPH_MAX_NODES];
+    Ethertype_Node       ethertypes[GRAPH_MAX_ETHERTYPES];
+    int                  ip_protocols[256];              /* Node per IP protocol.         */
+} Graph;
+
+#endif /* GRAPH__H */
@@ -0,0 +1,344 @@
+/*
+ * graph_functions.c
+ */
+
+/* Implementation Headers */
+
+#include <errno.h>
+#include <time.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "router.h"
+#include "buffer.h"
+#include "buffer_functions.h"
+#include "graph.h"
+#include "graph_functions.h"
+#include "ethernet_functions.h"
+#include "ip_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/*
+    CONSTRUCTION FUNCTIONS
+*/
+
+/* Initialize a forwarding graph and register the core nodes. Protocol nodes
+   (ARP, ICMP, TCP) are plugged in afterwards by their own modules. */
+
+int
+init_graph(Graph *graph, Buffer_Pool *pool)
+{
+    int i;
+
+    memset(graph, 0, sizeof(Graph));
+
+    graph->pool          = pool;
+    graph->ip_error_node = GRAPH_NO_NODE;
+
+    for (i = 0; i < 256; i++)
+    {
+        graph->ip_protocols[i] = GRAPH_NO_NODE;
+    }
+
+    /* Register core nodes. The order must match the NODE_ constants. */
+
+    if (register_graph_node(graph, "ethernet-input",   ethernet_input_node)   != NODE_ETHERNET_INPUT   ||
+        register_graph_node(graph, "ip-input",         ip_input_node)         != NODE_IP_INPUT         ||
+        register_graph_node(graph, "ip-lookup",        ip_lookup_node)        != NODE_IP_LOOKUP        ||
+        register_graph_node(graph, "ip-local",         ip_local_node)         != NODE_IP_LOCAL         ||
+        register_graph_node(graph, "ip-rewrite",       ip_rewrite_node)       != NODE_IP_REWRITE       ||
+        register_graph_node(graph, "interface-output", interface_output_node) != NODE_INTERFACE_OUTPUT)
+    {
+        return -1;
+    }
+
+    register_ethertype_node(graph, IP_TYPE, NODE_IP_INPUT);
+
+    return 1;
+}
+
+/* Register a node with the graph. Returns the node index, or -1 if the graph is full. */
+
+int
+register_graph_node(Graph *graph, const char *name, Graph_Node_Function function)
+{
+    Graph_Node *node;
+
+    if (graph->num_nodes == GRAPH_MAX_NODES)
+    {
+        return -1;
+    }
+
+    node           = &graph->nodes[graph->num_nodes];
+    node->name     = name;
+    node->function = function;
+
+    return graph->num_nodes++;
+}
+
+/* Replace the function of a registered node, e.g. so a worker thread can send 
+   to rings instead of interfaces. */
+
+void
+replace_graph_node(Graph *graph, int node, const char *name, Graph_Node_Function function)
+{
+    graph->nodes[node].name     = name;
+    graph->nodes[node].function = function;
+}
+
+/* Route frames of an Ethernet type to a node. Returns -1 if no space is left. */
+
+int
+register_ethertype_node(Graph *graph, uint16_t type, int node)
+{
+    if (graph->num_ethertypes == GRAPH_MAX_ETHERTYPES)
+    {
+        return -1;
+    }
+
+    graph->ethertypes[graph->num_ethertypes].type = type;
+    graph->ethertypes[graph->num_ethertypes].node = node;
+    graph->num_ethertypes++;
+
+    return 1;
+}
+
+/* Route locally delivered IP packets of a protocol to a node. */
+
+int
+register_ip_protocol_node(Graph *graph, uint8_t protocol, int node)
+{
+    graph->ip_protocols[protocol] = node;
+
+    return 1;
+}
+
+/* Route dropped IP packets (with an error set) to a node, e.g. for ICMP errors. */
+
+int
+register_ip_error_node(Graph *graph, int node)
+{
+    graph->ip_error_node = node;
+
+    return 1;
+}
+
+/*
+    DISPATCH FUNCTIONS
+*/
+
+/* Enqueue a frame for a node. If the node is missing or its vector is full,
+   the frame is dropped. */
+
+void
+graph_enqueue(Graph *graph, int node_index, Packet_Buffer *buffer)
+{
+    Graph_Node *node;
+
+    if (node_index == GRAPH_NO_NODE)
+    {
+        release_packet_buffer(buffer);
+        return;
+    }
+
+    node = &graph->nodes[node_index];
+
+    if (node->num_buffers == GRAPH_VECTOR_SIZE)
+    {
+        node->drops++;
+        release_packet_buffer(buffer);
+        return;
+    }
+
+    node->vector[node->num_buffers++] = buffer;
+}
+
+/* Run every node with pending frames, stage by stage, until all vectors are empty.
+   Each node sees its whole vector in one call. */
+
+void
+graph_dispatch(Graph *graph)
+{
+    Packet_Buffer   *buffers[GRAPH_VECTOR_SIZE];
+    Graph_Node      *node;
+    struct timespec  start, end;
+    int              i, num_buffers, progress;
+
+    do
+    {
+        progress = 0;
+
+        for (i = 0; i < graph->num_nodes; i++)
+        {
+            node = &graph->nodes[i];
+
+            if (node->num_buffers == 0)
+            {
+                continue;
+            }
+
+            /* Take the vector so the node may enqueue to any node, including itself. */
+
+            num_buffers       = node->num_buffers;
+            node->num_buffers = 0;
+            memcpy(buffers, node->vector, num_buffers * sizeof(Packet_Buffer *));
+
+            graph->current_node = i;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            node->function(graph, buffers, num_buffers);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+
+            node->calls++;
+            node->frames      += num_buffers;
+            node->nanoseconds += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+            progress           = 1;
+        }
+    } while (progress);
+}
+
+/* Read up to budget frames from an interface into the ethernet-input vector. The
+   graph is dispatched whenever the vector fills. Returns the number of frames
+   received, or -1 if the interface failed (errno is set). */
+
+int
+graph_receive_burst(Graph *graph, VDE_Reader *reader, const Interface *interface, int budget)
+{
+    Graph_Node    *input = &graph->nodes[NODE_ETHERNET_INPUT];
+    Packet_Buffer *buffer;
+    ssize_t        frame_len, read_len;
+    int            received = 0;
+
+    while (received < budget)
+    {
+        if ((buffer = get_packet_buffer(graph->pool)) == NULL)
+        {
+            break;
+        }
+
+        /* Take a buffered frame, or refill the reader with one read. */
+
+        if ((frame_len = next_ethernet_frame(reader, buffer->data, sizeof(buffer->data))) == 0)
+        {
+            release_packet_buffer(buffer);
+
+            if ((read_len = fill_vde_reader(reader)) > 0)
+            {
+                continue;
+            }
+            if (read_len == 0)
+            {
+                errno = EPIPE;
+                return -1;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+
+            return -1;
+        }
+
+        buffer->len       = frame_len;
+        buffer->interface = interface;
+        graph_enqueue(graph, NODE_ETHERNET_INPUT, buffer);
+        received++;
+
+        if (input->num_buffers == GRAPH_VECTOR_SIZE)
+        {
+            graph_dispatch(graph);
+        }
+    }
+
+    return received;
+}
+
+/* Return the node registered for an Ethernet type, or GRAPH_NO_NODE. */
+
+int
+graph_ethertype_node(Graph *graph, uint16_t type)
+{
+    for (int i = 0; i < graph->num_ethertypes; i++)
+    {
+        if (graph->ethertypes[i].type == type)
+        {
+            return graph->ethertypes[i].node;
+        }
+    }
+
+    return GRAPH_NO_NODE;
+}
+
+/* Print per-node statistics. */
+
+void
+show_graph_stats(Graph *graph)
+{
+    Graph_Node *node;
+
+    printf("\nGRAPH:\n");
+    printf("    %-20s %12s %12s %12s %12s %12s\n", "Node", "Calls", "Frames", "Frames/Call", "ns/Frame", "Drops");
+
+    for (int i = 0; i < graph->num_nodes; i++)
+    {
+        node = &graph->nodes[i];
+
+        if (node->calls == 0)
+        {
+            printf("    %-20s %12d %12d %12s %12s %12llu\n", node->name, 0, 0, "-", "-",
+                   (unsigned long long)node->drops);
+            continue;
+        }
+
+        printf("    %-20s %12llu %12llu %12.1f %12.1f %12llu\n", node->name,
+               (unsigned long long)node->calls, (unsigned long long)node->frames,
+               (double)node->frames / node->calls, (double)node->nanoseconds / node->frames,
+               (unsigned long long)node->drops);
+    }
+
+    printf("\n");
+}
+
+/*
+    INTERFACE OUTPUT NODE
+*/
+
+/* Send a vector of frames, batching them into one burst per egress interface.
+   Every run-to-completion worker runs this node, and send_ethernet_burst 
+   holds the interface's write lock for the whole burst, so their frames 
+   never interleave. */
+
+void
+interface_output_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    void          *frames[GRAPH_VECTOR_SIZE];
+    uint16_t       lens[GRAPH_VECTOR_SIZE];
+    int            i, j, num_frames;
+
+    for (i = 0; i < NUM_INTERFACES; i++)
+    {
+        num_frames = 0;
+
+        for (j = 0; j < num_buffers; j++)
+        {
+            if (buffers[j]->tx_interface == &ROUTER_INTERFACES[i])
+            {
+                frames[num_frames] = buffers[j]->data;
+                lens[num_frames]   = buffers[j]->len;
+                num_frames++;
+            }
+        }
+
+        if (num_frames > 0)
+        {
+            send_ethernet_burst(ROUTER_INTERFACES[i].fds[1], frames, lens, num_frames);
+        }
+    }
+
+    for (j = 0; j < num_buffers; j++)
+    {
+        release_packet_buffer(buffers[j]);
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * graph_functions.h
+ */
+
+#ifndef GRAPH_FUNCTIONS__H
+#define GRAPH_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "router.h"
+#include "buffer.h"
+#include "graph.h"
+
+/*
+    GRAPH FUNCTIONS
+*/
+
+/* Construction */
+
+int      init_graph(Graph *graph, Buffer_Pool *pool);
+int      register_graph_node(Graph *graph, const char *name, Graph_Node_Function function);
+void     replace_graph_node(Graph *graph, int node, const char *name, Graph_Node_Function function);
+int      register_ethertype_node(Graph *graph, uint16_t type, int node);
+int      register_ip_protocol_node(Graph *graph, uint8_t protocol, int node);
+int      register_ip_error_node(Graph *graph, int node);
+
+/* Dispatch */
+
+void     graph_enqueue(Graph *graph, int node, Packet_Buffer *buffer);
+void     graph_dispatch(Graph *graph);
+int      graph_receive_burst(Graph *graph, VDE_Reader *reader, const Interface *interface, int budget);
+int      graph_ethertype_node(Graph *graph, uint16_t type);
+void     show_graph_stats(Graph *graph);
+
+/* Interface output node */
+
+void     interface_output_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
+#endif /* GRAPH_FUNCTIONS__H */
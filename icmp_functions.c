@@ -15,6 +15,8 @@
 #include "ip_functions.h"
 #include "icmp.h"
 #include "icmp_functions.h"
+#include "buffer_functions.h"
+#include "graph_functions.h"
 
 /* 
     FUNCTION IMPLEMENTATIONS
@@ -68,7 +70,7 @@ send_icmp_packet(IP_Header *old_ip_packet, int type, int code, const Interface *
 
     /* Get IP and MAC addresses. If ARP lookup returns NULL, drop packet. */
 
-    const uint32_t route_dest_ip_address  = find_route_ip_address(new_ip_dest, route, NULL);
+    const uint32_t route_dest_ip_address  = *find_route_ip_address(&new_ip_dest, route, NULL);
     const uint8_t *route_dest_mac_address = find_arp_mac_address(route_dest_ip_address);
 
     if (route_dest_mac_address == NULL)
@@ -207,3 +209,55 @@ dropped_packet_diagnostics(int error, IP_Header *ip_packet, const Interface *int
     
     fflush(stdout);
 }
+
+/* 
+    GRAPH NODES
+*/
+
+/* Plug the ICMP nodes into a graph: local delivery of ICMP packets and 
+   diagnostics (with ICMP errors) for dropped IP packets. Returns -1 on failure. */
+
+int
+register_icmp_nodes(Graph *graph)
+{
+    int local_node, error_node;
+
+    if ((local_node = register_graph_node(graph, "icmp-local", icmp_local_node)) == -1 ||
+        (error_node = register_graph_node(graph, "icmp-error", icmp_error_node)) == -1)
+    {
+        return -1;
+    }
+
+    register_ip_protocol_node(graph, ICMP_PROTOCOL, local_node);
+    register_ip_error_node(graph, error_node);
+
+    return 1;
+}
+
+/* ICMP local node. ICMP packets for the router are delivered locally. */
+
+void
+icmp_local_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    for (int i = 0; i < num_buffers; i++)
+    {
+        printf("    Delivering locally. \n");
+        release_packet_buffer(buffers[i]);
+    }
+}
+
+/* ICMP error node. Prints diagnostics for dropped packets and sends the 
+   corresponding ICMP error back to the source. */
+
+void
+icmp_error_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    IP_Header *ip_packet;
+
+    for (int i = 0; i < num_buffers; i++)
+    {
+        ip_packet = (IP_Header *)(buffers[i]->data + sizeof(Ethernet_Header));
+        dropped_packet_diagnostics(buffers[i]->error, ip_packet, buffers[i]->interface);
+        release_packet_buffer(buffers[i]);
+    }
+}
@@ -11,6 +11,7 @@
 #include "router.h"
 #include "icmp.h"
 #include "ip.h"
+#include "graph.h"
 
 /* 
     ICMP FUNCTIONS (including diagnostics)
@@ -21,4 +22,10 @@ ICMP_Header *construct_icmp_packet(void *payload, ssize_t payload_len, int type,
 void         ip_to_str(uint32_t ip, char *buf);
 void         dropped_packet_diagnostics(int error, IP_Header *ip_packet, const Interface *interface);
 
+/* Graph nodes */
+
+int          register_icmp_nodes(Graph *graph);
+void         icmp_local_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+void         icmp_error_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
 #endif /* ICMP_FUNCTIONS__H */
@@ -15,6 +15,8 @@
 #include "icmp_functions.h"
 #include "tcp_functions.h"
 #include "util.h"
+#include "buffer_functions.h"
+#include "graph_functions.h"
 
 /* 
     FUNCTION IMPLEMENTATIONS
@@ -23,15 +25,21 @@
 /* Compute Internet Checksum (from RFC 1071). */
 
 uint16_t 
-RFC1071_checksum(void *data, uint8_t data_len)
+RFC1071_checksum(const void *data, size_t data_len)
 {
-    uint16_t *d;
-    uint32_t  sum;
-    int       count;
+    return RFC1071_fold(RFC1071_sum(data, data_len, 0));
+}
+
+/* Add the 16-bit words of data to a running one's complement sum, so a checksum 
+   can be computed over pieces that are not contiguous. Every piece but the last
+   must have an even length. The sum is unfolded, which leaves room for 64 KB
+   of data. */
 
-    d     = (uint16_t *)data;
-    sum   = 0;
-    count = data_len; 
+uint32_t
+RFC1071_sum(const void *data, size_t data_len, uint32_t sum)
+{
+    const uint16_t *d     = data;
+    size_t          count = data_len;
 
     while (count > 1)  
     {
@@ -44,11 +52,17 @@ RFC1071_checksum(void *data, uint8_t data_len)
 
     if (count > 0)
     {
-        sum += (uint8_t) *d;
+        sum += *(const uint8_t *)d;
     }
 
-    /*  Fold 32-bit sum to 16 bits */
+    return sum;
+}
+
+/* Fold a sum from RFC1071_sum to 16 bits and complement it. */
 
+uint16_t
+RFC1071_fold(uint32_t sum)
+{
     while (sum >> 16)
     {
         sum = (sum & 0xFFFF) + (sum >> 16);
@@ -176,7 +190,7 @@ send_locally(IP_Header *ip_packet, ssize_t ip_packet_len)
 
             if (ip_packet->protocol == TCP_PROTOCOL)
             {
-                handle_tcp_segment(ip_packet, ntohs(ip_packet->total_length));
+                handle_tcp_segment(ip_packet, ntohs(ip_packet->total_length), NULL);
             }
             else
             {
@@ -197,14 +211,14 @@ send_to_next_hop(uint8_t *ether_frame, ssize_t frame_len, IP_Header *ip_packet,
 {
     int              on_link;
     const Interface *hop_router_interface;
-    const uint8_t   *hop_ip_address, *hop_mac_address, *source_mac_address;
+    const uint32_t  *hop_ip_address;
+    const uint8_t   *hop_mac_address, *source_mac_address;
     uint32_t         ip_dest; 
 
     ip_dest              = ntohl(ip_packet->destination);
     hop_ip_address       = find_route_ip_address(&ip_dest, route, &on_link);
     hop_mac_address      = find_arp_mac_address(*hop_ip_address);
     hop_router_interface = route->interface;
-    on_link              = OFF_LINK; 
 
     /* Check ARP. */
 
@@ -295,3 +309,168 @@ construct_ip_packet(uint32_t ip_source, uint32_t ip_dest, uint16_t id, uint8_t p
 
     return ip_packet; 
 }
+
+
+/* 
+    GRAPH NODES
+*/
+
+/* IP input node. Validates the header of each packet in the vector. Invalid 
+   packets are dropped (valid_ip_packet prints the diagnostic). */
+
+void
+ip_input_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Packet_Buffer *buffer;
+    IP_Header     *ip_packet;
+    ssize_t        ip_packet_len;
+    int            i;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        buffer        = buffers[i];
+        ip_packet     = (IP_Header *)(buffer->data + sizeof(Ethernet_Header));
+        ip_packet_len = buffer->len - sizeof(Ethernet_Header);
+
+        /* If not TCP, subtract frame check sequence from packet length. */
+
+        if (ip_packet->protocol != TCP_PROTOCOL)
+        {
+            ip_packet_len -= ETHERNET_FCS_LEN;
+        }
+
+        if (valid_ip_packet(ip_packet, ip_packet_len, buffer->interface) != 1)
+        {
+            release_packet_buffer(buffer);
+            continue;
+        }
+
+        graph_enqueue(graph, NODE_IP_LOOKUP, buffer);
+    }
+}
+
+/* IP lookup node. Packets for a router interface go to ip-local. Others get a 
+   route and next hop MAC address, or an error for the IP error node. Consecutive 
+   packets to the same destination reuse the previous lookup. */
+
+void
+ip_lookup_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Packet_Buffer *buffer;
+    IP_Header     *ip_packet;
+    const Route   *route        = NULL;
+    const uint8_t *hop_mac      = NULL;
+    uint32_t       ip_dest, hop_ip, cached_dest = 0;
+    int            i, on_link   = OFF_LINK, cached = 0;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        buffer    = buffers[i];
+        ip_packet = (IP_Header *)(buffer->data + sizeof(Ethernet_Header));
+        ip_dest   = ntohl(ip_packet->destination);
+
+        /* Deliver locally if destined for any router interface. */
+
+        if (find_local_interface(ip_dest) != NULL)
+        {
+            graph_enqueue(graph, NODE_IP_LOCAL, buffer);
+            continue;
+        }
+
+        /* Find route and next hop, unless the last packet had the same destination. */
+
+        if (!cached || ip_dest != cached_dest)
+        {
+            hop_mac = NULL;
+
+            if ((route = find_route(ip_dest)) != NULL)
+            {
+                hop_ip  = *find_route_ip_address(&ip_dest, route, &on_link);
+                hop_mac = find_arp_mac_address(hop_ip);
+            }
+
+            cached      = 1;
+            cached_dest = ip_dest;
+        }
+
+        if (route == NULL || hop_mac == NULL)
+        {
+            buffer->error = (route == NULL) ? NO_ROUTE : NO_ARP;
+            graph_enqueue(graph, graph->ip_error_node, buffer);
+            continue;
+        }
+
+        buffer->route        = route;
+        buffer->on_link      = on_link;
+        buffer->next_hop_mac = hop_mac;
+        graph_enqueue(graph, NODE_IP_REWRITE, buffer);
+    }
+}
+
+/* IP local node. Dispatches packets for the router to the node registered for 
+   their protocol. */
+
+void
+ip_local_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    IP_Header *ip_packet;
+    int        i, next_node;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        ip_packet = (IP_Header *)(buffers[i]->data + sizeof(Ethernet_Header));
+        next_node = graph->ip_protocols[ip_packet->protocol];
+
+        if (next_node == GRAPH_NO_NODE)
+        {
+            printf("    Delivering locally. \n");
+            release_packet_buffer(buffers[i]);
+            continue;
+        }
+
+        graph_enqueue(graph, next_node, buffers[i]);
+    }
+}
+
+/* IP rewrite node. Decrements the TTL, updates the checksum and rewrites the 
+   Ethernet header for the next hop. */
+
+void
+ip_rewrite_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Packet_Buffer   *buffer;
+    Ethernet_Header *ethernet_hdr;
+    IP_Header       *ip_packet;
+    const Interface *tx_interface;
+    int              i;
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        buffer       = buffers[i];
+        ethernet_hdr = (Ethernet_Header *)buffer->data;
+        ip_packet    = (IP_Header *)(buffer->data + sizeof(Ethernet_Header));
+        tx_interface = buffer->route->interface;
+
+        if (modify_ip_packet(ip_packet, buffer->on_link) == TTL_EXCEEDED)
+        {
+            buffer->error = TTL_EXCEEDED;
+            graph_enqueue(graph, graph->ip_error_node, buffer);
+            continue;
+        }
+
+        /* TCP frames carry no frame check sequence (see handle_ip_packet). */
+
+        if (ip_packet->protocol == TCP_PROTOCOL)
+        {
+            memcpy(ethernet_hdr->source, tx_interface->mac_address, 6);
+            memcpy(ethernet_hdr->destination, buffer->next_hop_mac, 6);
+        }
+        else
+        {
+            modify_ethernet_frame(buffer->data, buffer->len, tx_interface->mac_address, buffer->next_hop_mac);
+        }
+
+        buffer->tx_interface = tx_interface;
+        graph_enqueue(graph, NODE_INTERFACE_OUTPUT, buffer);
+    }
+}
@@ -10,12 +10,15 @@
 #include "c_headers.h"
 #include "ip.h"
 #include "router.h"
+#include "graph.h"
 
 /* 
     IP FUNCTIONS
 */
 
-uint16_t   RFC1071_checksum(void *data, uint8_t data_len);
+uint16_t   RFC1071_checksum(const void *data, size_t data_len);
+uint32_t   RFC1071_sum(const void *data, size_t data_len, uint32_t sum);
+uint16_t   RFC1071_fold(uint32_t sum);
 void       handle_ip_packet(uint8_t *ether_frame, ssize_t frame_len, const Interface *interface);
 int        valid_ip_packet(IP_Header *ip_packet, ssize_t packet_size, const Interface *interface);
 int        send_locally(IP_Header *ip_packet, ssize_t ip_packet_len);
@@ -25,4 +28,11 @@ int        modify_ip_packet(IP_Header *ip_packet, int on_link);
 IP_Header *construct_ip_packet(uint32_t ip_source, uint32_t ip_dest, uint16_t id, uint8_t protocol,
                                uint8_t ttl, void *payload, ssize_t payload_len);
 
+/* Graph nodes */
+
+void       ip_input_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+void       ip_lookup_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+void       ip_local_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+void       ip_rewrite_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
 #endif /* IP_FUNCTIONS__H */
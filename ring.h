@@ -0,0 +1,38 @@
+/*
+ * ring.h
+ */
+
+#ifndef RING__H
+#define RING__H
+
+/* Implementation Headers */
+
+#include <stdatomic.h>
+#include "c_headers.h"
+
+/*
+    RING CONSTANTS
+*/
+
+#define CACHE_LINE_SIZE            64
+
+/*
+    RING STRUCTS
+*/
+
+/* Lock-free single-producer/single-consumer ring of pointers. The producer only 
+   writes tail and the consumer only writes head, each on its own cache line. 
+   Both sides keep a cached copy of the other's index so the shared line is only 
+   read when the ring looks full (or empty). */
+
+typedef struct SPSC_Ring
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head;        /* Next slot to dequeue.        */
+    size_t                                  cached_tail; /* Consumer's copy of tail.     */
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;        /* Next slot to enqueue.        */
+    size_t                                  cached_head; /* Producer's copy of head.     */
+    _Alignas(CACHE_LINE_SIZE) size_t        mask;        /* Ring size - 1 (power of 2).  */
+    void                                  **slots;       /* Ring storage.                */
+} SPSC_Ring;
+
+#endif /* RING__H */
@@ -0,0 +1,128 @@
+/*
+ * ring_functions.c
+ */
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "ring.h"
+#include "ring_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/* Initialize a ring. The size must be a power of 2. If malloc fails or the
+   size is invalid, return -1. */
+
+int
+init_spsc_ring(SPSC_Ring *ring, size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+    {
+        return -1;
+    }
+
+    /* Malloc space for slots. */
+
+    if ((ring->slots = malloc(size * sizeof(void *))) == NULL)
+    {
+        return -1;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->mask        = size - 1;
+
+    return 1;
+}
+
+/* Free a ring's slots. Objects still in the ring are not freed. */
+
+void
+free_spsc_ring(SPSC_Ring *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+/* Enqueue up to num_objects pointers (producer only). Returns the number enqueued. */
+
+size_t
+spsc_ring_enqueue_burst(SPSC_Ring *ring, void **objects, size_t num_objects)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t free_slots, i;
+
+    /* Only re-read the consumer's head when the cached copy says the ring is full. */
+
+    free_slots = ring->mask + 1 - (tail - ring->cached_head);
+
+    if (free_slots < num_objects)
+    {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        free_slots        = ring->mask + 1 - (tail - ring->cached_head);
+
+        if (num_objects > free_slots)
+        {
+            num_objects = free_slots;
+        }
+    }
+
+    for (i = 0; i < num_objects; i++)
+    {
+        ring->slots[(tail + i) & ring->mask] = objects[i];
+    }
+
+    /* Publish the slots to the consumer. */
+
+    atomic_store_explicit(&ring->tail, tail + num_objects, memory_order_release);
+
+    return num_objects;
+}
+
+/* Dequeue up to max_objects pointers (consumer only). Returns the number dequeued. */
+
+size_t
+spsc_ring_dequeue_burst(SPSC_Ring *ring, void **objects, size_t max_objects)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t used_slots, i;
+
+    /* Only re-read the producer's tail when the cached copy says the ring is empty. */
+
+    used_slots = ring->cached_tail - head;
+
+    if (used_slots < max_objects)
+    {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        used_slots        = ring->cached_tail - head;
+    }
+
+    if (max_objects > used_slots)
+    {
+        max_objects = used_slots;
+    }
+
+    for (i = 0; i < max_objects; i++)
+    {
+        objects[i] = ring->slots[(head + i) & ring->mask];
+    }
+
+    /* Hand the slots back to the producer. */
+
+    atomic_store_explicit(&ring->head, head + max_objects, memory_order_release);
+
+    return max_objects;
+}
+
+/* Number of objects in the ring. Exact only from the producer or consumer thread. */
+
+size_t
+spsc_ring_count(SPSC_Ring *ring)
+{
+    return atomic_load_explicit(&ring->tail, memory_order_acquire) -
+           atomic_load_explicit(&ring->head, memory_order_acquire);
+}
@@ -0,0 +1,23 @@
+/*
+ * ring_functions.h
+ */
+
+#ifndef RING_FUNCTIONS__H
+#define RING_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "ring.h"
+
+/*
+    RING FUNCTIONS
+*/
+
+int      init_spsc_ring(SPSC_Ring *ring, size_t size);
+void     free_spsc_ring(SPSC_Ring *ring);
+size_t   spsc_ring_enqueue_burst(SPSC_Ring *ring, void **objects, size_t num_objects);
+size_t   spsc_ring_dequeue_burst(SPSC_Ring *ring, void **objects, size_t max_objects);
+size_t   spsc_ring_count(SPSC_Ring *ring);
+
+#endif /* RING_FUNCTIONS__H */
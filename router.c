@@ -24,8 +24,16 @@ const int            MAX_VDE_FILE_LEN       = CONTROL_FILE_LEN + (NUM_INTERFACES
  
 int                   LISTENING_PORTS[]     = { 4000, 4001, 4002, 4003, 4004, 4005, 4006, 4007, 4008, 4009 };
 int                   NUM_LISTENING_PORTS   = sizeof(LISTENING_PORTS) / sizeof(int);  
+int                   ACTIVE_SENDING_PORT   = 0;
 TCP_Connections_List *TCP_CONNECTIONS_LIST  = NULL;
-TCP_Connection       *CURRENT_CONNECTION    = NULL;
+TCP_Socket_Table      TCP_SOCKETS;
+TCP_Socket           *CURRENT_SOCKET        = NULL;    /* Socket stdin is sent on.              */
+int                   TCP_CC_DEFAULT        = 0;       /* Index into TCP_CONGESTION_ALGORITHMS. */
+FILE                 *TCP_CC_TRACE          = NULL;    /* cwnd/ssthresh trace, if enabled.      */
+
+/* Timers */
+
+Timer_Wheel           TIMER_WHEEL;
 
 /* Router Interfaces */
 
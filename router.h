@@ -9,6 +9,7 @@
 
 #include "c_headers.h"
 #include "tcp.h"
+#include "tcp_socket.h"
 
 /* 
     ROUTER STRUCTS 
@@ -68,6 +69,13 @@ extern int                   LISTENING_PORTS[];
 extern int                   NUM_LISTENING_PORTS;  
 extern int                   ACTIVE_SENDING_PORT;
 extern TCP_Connections_List *TCP_CONNECTIONS_LIST;
-extern TCP_Connection       *CURRENT_CONNECTION;
+extern TCP_Socket_Table      TCP_SOCKETS;
+extern TCP_Socket           *CURRENT_SOCKET;
+extern int                   TCP_CC_DEFAULT;
+extern FILE                 *TCP_CC_TRACE;
+
+/* Router Timers */
+
+extern Timer_Wheel           TIMER_WHEEL;
 
 #endif /* ROUTER__H */
@@ -105,3 +105,21 @@ find_arp_mac_address(uint32_t ip_address)
     /* No ARP found. */
     return NULL;
 }
+
+/* Find the router interface that owns an IP address. Returns NULL if 
+   the address does not belong to the router. */
+
+const Interface *
+find_local_interface(uint32_t ip_address)
+{
+    for (int i = 0; i < NUM_INTERFACES; i++)
+    {
+        if (ROUTER_INTERFACES[i].ip_address == ip_address)
+        {
+            return &ROUTER_INTERFACES[i];
+        }
+    }
+
+    /* Not a router address. */
+    return NULL;
+}
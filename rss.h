@@ -0,0 +1,37 @@
+/*
+ * rss.h
+ */
+
+#ifndef RSS__H
+#define RSS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+
+/*
+    RSS CONSTANTS
+*/
+
+#define RSS_KEY_LEN                40
+#define RSS_INPUT_LEN              12         /* Source, destination, ports.  */
+#define RSS_INDIRECTION_SIZE       128
+
+/*
+    RSS STRUCTS
+*/
+
+/* Toeplitz hash state, compatible with NIC receive side scaling. Hashing is 
+   done a byte at a time: lookup[i][b] holds the XOR of the key windows for 
+   every set bit of b at input byte i, so a 12-byte tuple costs 12 loads. The 
+   indirection table maps the low bits of a hash to a queue. */
+
+typedef struct RSS_Table
+{
+    uint8_t   key[RSS_KEY_LEN];
+    uint32_t  lookup[RSS_INPUT_LEN][256];
+    uint16_t  indirection[RSS_INDIRECTION_SIZE];
+    int       num_queues;
+} RSS_Table;
+
+#endif /* RSS__H */
@@ -0,0 +1,142 @@
+/*
+ * rss_functions.c
+ */
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "rss.h"
+#include "rss_functions.h"
+
+/*
+    RSS KEY
+*/
+
+/* The key used by most NIC drivers, so hashes match hardware RSS. */
+
+const uint8_t RSS_DEFAULT_KEY[RSS_KEY_LEN] = 
+{
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+};
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/* Initialize a table from a key and spread the indirection table evenly over
+   num_queues. Returns -1 if num_queues is out of range. */
+
+int
+init_rss_table(RSS_Table *table, const uint8_t *key, int num_queues)
+{
+    uint64_t window;
+    uint32_t bit_windows[8];
+    int      i, j, b;
+
+    if (num_queues < 1 || num_queues > RSS_INDIRECTION_SIZE)
+    {
+        return -1;
+    }
+
+    memcpy(table->key, key, RSS_KEY_LEN);
+    table->num_queues = num_queues;
+
+    /* Input bit (8i + j) selects the 32 key bits starting at key bit (8i + j). */
+
+    for (i = 0; i < RSS_INPUT_LEN; i++)
+    {
+        window = ((uint64_t)key[i] << 32) | ((uint64_t)key[i + 1] << 24) | ((uint64_t)key[i + 2] << 16) |
+                 ((uint64_t)key[i + 3] << 8) | key[i + 4];
+
+        for (j = 0; j < 8; j++)
+        {
+            bit_windows[j] = (uint32_t)(window >> (8 - j));
+        }
+
+        for (b = 0; b < 256; b++)
+        {
+            table->lookup[i][b] = 0;
+
+            for (j = 0; j < 8; j++)
+            {
+                if (b & (0x80 >> j))
+                {
+                    table->lookup[i][b] ^= bit_windows[j];
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < RSS_INDIRECTION_SIZE; i++)
+    {
+        table->indirection[i] = i % num_queues;
+    }
+
+    return 1;
+}
+
+/* Toeplitz hash of up to RSS_INPUT_LEN bytes. */
+
+uint32_t
+toeplitz_hash(const RSS_Table *table, const uint8_t *input, int len)
+{
+    uint32_t hash = 0;
+
+    for (int i = 0; i < len; i++)
+    {
+        hash ^= table->lookup[i][input[i]];
+    }
+
+    return hash;
+}
+
+/* Hash an Ethernet frame the way a NIC would: the 4-tuple for unfragmented TCP 
+   and UDP, the address pair for other IPv4 packets. Input is in network byte 
+   order (source address, destination address, source port, destination port). 
+   Frames that are not IPv4 hash to 0. */
+
+uint32_t
+rss_frame_hash(const RSS_Table *table, const uint8_t *frame, ssize_t len)
+{
+    const IP_Header *ip;
+    ssize_t          header_len;
+
+    if (len < (ssize_t)(sizeof(Ethernet_Header) + sizeof(IP_Header)) ||
+        frame[12] != (IP_TYPE >> 8) || frame[13] != (IP_TYPE & 0xFF))
+    {
+        return 0;
+    }
+
+    ip         = (const IP_Header *)(frame + sizeof(Ethernet_Header));
+    header_len = (ip->version_and_IHL & 0x0F) * 4;
+
+    /* Ports are only in the first fragment, so fragments hash on addresses. */
+
+    if ((ip->protocol == TCP_PROTOCOL || ip->protocol == UDP_PROTOCOL) &&
+        (ntohs(ip->flags_and_offset) & 0x3FFF) == 0 &&
+        len >= (ssize_t)sizeof(Ethernet_Header) + header_len + 4)
+    {
+        uint8_t input[RSS_INPUT_LEN];
+
+        memcpy(input, &ip->source, 8);
+        memcpy(input + 8, (const uint8_t *)ip + header_len, 4);
+
+        return toeplitz_hash(table, input, RSS_INPUT_LEN);
+    }
+
+    return toeplitz_hash(table, (const uint8_t *)&ip->source, 8);
+}
+
+/* Queue for a hash. */
+
+int
+rss_queue(const RSS_Table *table, uint32_t hash)
+{
+    return table->indirection[hash & (RSS_INDIRECTION_SIZE - 1)];
+}
@@ -0,0 +1,24 @@
+/*
+ * rss_functions.h
+ */
+
+#ifndef RSS_FUNCTIONS__H
+#define RSS_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "rss.h"
+
+/*
+    RSS FUNCTIONS
+*/
+
+extern const uint8_t RSS_DEFAULT_KEY[RSS_KEY_LEN];
+
+int      init_rss_table(RSS_Table *table, const uint8_t *key, int num_queues);
+uint32_t toeplitz_hash(const RSS_Table *table, const uint8_t *input, int len);
+uint32_t rss_frame_hash(const RSS_Table *table, const uint8_t *frame, ssize_t len);
+int      rss_queue(const RSS_Table *table, uint32_t hash);
+
+#endif /* RSS_FUNCTIONS__H */
@@ -0,0 +1,87 @@
+/*
+ * scheduler.h
+ */
+
+#ifndef SCHEDULER__H
+#define SCHEDULER__H
+
+/* Implementation Headers */
+
+#include <stdatomic.h>
+#include "c_headers.h"
+
+/*
+    SCHEDULER CONSTANTS
+*/
+
+/* Modes */
+
+#define SCHEDULER_SINGLE               0      /* One thread does everything.      */
+#define SCHEDULER_RUN_TO_COMPLETION    1      /* Workers run the whole graph.     */
+#define SCHEDULER_PIPELINE             2      /* Parse, lookup and TX stages.     */
+
+#define SCHEDULER_NO_CPU              -1
+
+/* RX Quota */
+
+#define RX_DEFAULT_QUOTA               64     /* Frames per interface per round.  */
+
+/* Busy Polling */
+
+#define BUSY_POLL_MAX_BACKOFF          1024   /* Most pauses between empty polls. */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX()                    __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define CPU_RELAX()                    __asm__ __volatile__("yield")
+#else
+#define CPU_RELAX()                    do { } while (0)
+#endif
+
+/*
+    SCHEDULER STRUCTS
+*/
+
+/* How frames are scheduled onto threads, chosen at startup. */
+
+typedef struct Scheduler_Config
+{
+    int  mode;                                /* SCHEDULER_ mode.                 */
+    int  num_forwarding_workers;              /* Workers flows are spread over.   */
+    int  pin_cpus;                            /* Pin each worker thread to a CPU. */
+    int  busy_poll_us;                        /* Spin this long after traffic.    */
+    int  rx_quota;                            /* Frames per interface per round.  */
+    int  (*start)(void *arg);                 /* Called once sockets are up, or
+                                                 NULL. Returning -1 exits.        */
+    void *start_arg;                          /* Passed to start.                 */
+} Scheduler_Config;
+
+/* Per-interface RX counters for quota scheduling. An interface that keeps 
+   exhausting its quota has more traffic than it is given each round. */
+
+typedef struct RX_Queue_Stats
+{
+    atomic_ullong  rounds;                    /* Rounds the interface was served. */
+    atomic_ullong  frames;                    /* Frames received.                 */
+    atomic_ullong  exhausted;                 /* Rounds that used the whole quota.*/
+    atomic_ullong  max_depth;                 /* Most bytes left queued after one.*/
+} RX_Queue_Stats;
+
+/* Adaptive busy polling for one thread. After traffic the thread keeps polling
+   without blocking for the budget, pausing twice as long after each empty poll,
+   and only then blocks in the kernel. With a budget of 0 it always blocks. 
+   Counters are written by the polling thread and may be read by any thread. */
+
+typedef struct Busy_Poll
+{
+    uint64_t       budget_ns;                 /* Spin this long after traffic.    */
+    uint64_t       last_work_ns;              /* When traffic was last seen.      */
+    uint64_t       idle_since_ns;             /* Start of the current spin, or 0. */
+    uint64_t       sleep_start_ns;            /* Start of the current sleep.      */
+    int            backoff;                   /* Pauses after the next empty poll.*/
+    atomic_ullong  spin_ns;                   /* Time spent spinning idle.        */
+    atomic_ullong  sleep_ns;                  /* Time spent blocked.              */
+    atomic_ullong  sleeps;                    /* Times the thread blocked.        */
+} Busy_Poll;
+
+#endif /* SCHEDULER__H */
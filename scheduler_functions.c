@@ -0,0 +1,589 @@
+/*
+ * scheduler_functions.c
+ */
+
+/* Implementation Headers */
+
+#ifndef __FreeBSD__
+#define _GNU_SOURCE
+#endif
+
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "router.h"
+#include "tcp_functions.h"
+#include "tcp_socket_functions.h"
+#include "arp_functions.h"
+#include "icmp_functions.h"
+#include "buffer.h"
+#include "buffer_functions.h"
+#include "graph.h"
+#include "graph_functions.h"
+#include "worker.h"
+#include "worker_functions.h"
+#include "scheduler.h"
+#include "scheduler_functions.h"
+#include "timer_functions.h"
+
+#ifdef __FreeBSD__
+#include <pthread_np.h>
+typedef cpuset_t cpu_set_t;
+#endif
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/*
+    MODE FUNCTIONS
+*/
+
+/* Mode names, indexed by SCHEDULER_ mode. */
+
+static const char *SCHEDULER_MODE_NAMES[] = { "single", "rtc", "pipeline" };
+
+/* Parse a mode name. Returns -1 if the name is unknown. */
+
+int
+parse_scheduler_mode(const char *name)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        if (strcmp(name, SCHEDULER_MODE_NAMES[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const char *
+scheduler_mode_name(int mode)
+{
+    return SCHEDULER_MODE_NAMES[mode];
+}
+
+/* Pin a thread to a CPU, wrapping around the online CPUs. Returns the CPU, or
+   SCHEDULER_NO_CPU if pinning failed. */
+
+int
+pin_thread_to_cpu(pthread_t thread, int cpu)
+{
+    cpu_set_t cpus;
+    long      num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    cpu %= num_cpus < 1 ? 1 : num_cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    if (pthread_setaffinity_np(thread, sizeof(cpus), &cpus) != 0)
+    {
+        printf("Could not pin thread to CPU %d. \n", cpu);
+        return SCHEDULER_NO_CPU;
+    }
+
+    return cpu;
+}
+
+/*
+    RX QUOTA FUNCTIONS
+*/
+
+void
+init_rx_queue_stats(RX_Queue_Stats *stats)
+{
+    atomic_init(&stats->rounds, 0);
+    atomic_init(&stats->frames, 0);
+    atomic_init(&stats->exhausted, 0);
+    atomic_init(&stats->max_depth, 0);
+}
+
+/* Serve an interface for one round: receive up to quota frames into the graph.
+   Returns the number received, or -1 if the interface failed. If the whole 
+   quota was used, more frames are probably waiting and the caller should come
+   back without blocking. Rounds that receive nothing are not counted. */
+
+int
+receive_rx_quota(Graph *graph, VDE_Reader *reader, const Interface *interface, int quota, RX_Queue_Stats *stats)
+{
+    ssize_t depth;
+    int     received;
+
+    if ((received = graph_receive_burst(graph, reader, interface, quota)) <= 0)
+    {
+        return received;
+    }
+
+    atomic_fetch_add_explicit(&stats->rounds, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->frames, received, memory_order_relaxed);
+
+    /* Only sample the backlog when it exists, so idle rounds cost no ioctl. */
+
+    if (received == quota)
+    {
+        atomic_fetch_add_explicit(&stats->exhausted, 1, memory_order_relaxed);
+
+        if ((depth = vde_queue_depth(reader)) > (ssize_t)atomic_load_explicit(&stats->max_depth, memory_order_relaxed))
+        {
+            atomic_store_explicit(&stats->max_depth, depth, memory_order_relaxed);
+        }
+    }
+
+    return received;
+}
+
+/* Print quota counters, the current queue depth and frames skipped as too long
+   for an interface. */
+
+void
+show_rx_queue_stats(const char *name, RX_Queue_Stats *stats, VDE_Reader *reader)
+{
+    unsigned long long rounds    = atomic_load(&stats->rounds);
+    unsigned long long exhausted = atomic_load(&stats->exhausted);
+
+    printf("    %-28s rounds %10llu, frames/round %6.1f, quota exhausted %10llu (%5.1f%%), queue %6zd bytes (max %llu), too long %llu\n",
+           name, rounds, rounds ? (double)atomic_load(&stats->frames) / rounds : 0.0, exhausted,
+           rounds ? 100.0 * exhausted / rounds : 0.0, vde_queue_depth(reader),
+           (unsigned long long)atomic_load(&stats->max_depth), (unsigned long long)reader->too_long);
+}
+
+/*
+    BUSY POLL FUNCTIONS
+*/
+
+/* Current CLOCK_MONOTONIC time in nanoseconds. */
+
+uint64_t
+monotonic_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void
+init_busy_poll(Busy_Poll *busy_poll, int budget_us)
+{
+    busy_poll->budget_ns      = (uint64_t)budget_us * 1000;
+    busy_poll->last_work_ns   = 0;
+    busy_poll->idle_since_ns  = 0;
+    busy_poll->sleep_start_ns = 0;
+    busy_poll->backoff        = 1;
+    atomic_init(&busy_poll->spin_ns, 0);
+    atomic_init(&busy_poll->sleep_ns, 0);
+    atomic_init(&busy_poll->sleeps, 0);
+}
+
+/* Record traffic: the spin budget starts over and backoff is reset. */
+
+void
+busy_poll_work(Busy_Poll *busy_poll)
+{
+    if (busy_poll->budget_ns == 0)
+    {
+        return;
+    }
+
+    busy_poll->last_work_ns = monotonic_ns();
+    busy_poll->backoff      = 1;
+
+    if (busy_poll->idle_since_ns != 0)
+    {
+        atomic_fetch_add_explicit(&busy_poll->spin_ns, busy_poll->last_work_ns - busy_poll->idle_since_ns, memory_order_relaxed);
+        busy_poll->idle_since_ns = 0;
+    }
+}
+
+/* Called after an empty poll. Returns 1 if the thread should poll again without
+   blocking, after pausing with exponential backoff, or 0 if the budget since the
+   last traffic is spent and it should block. */
+
+int
+busy_poll_spin(Busy_Poll *busy_poll)
+{
+    uint64_t now;
+
+    if (busy_poll->budget_ns == 0)
+    {
+        return 0;
+    }
+
+    now = monotonic_ns();
+
+    if (busy_poll->idle_since_ns == 0)
+    {
+        busy_poll->idle_since_ns = now;
+    }
+
+    if (now - busy_poll->last_work_ns >= busy_poll->budget_ns)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < busy_poll->backoff; i++)
+    {
+        CPU_RELAX();
+    }
+
+    if (busy_poll->backoff < BUSY_POLL_MAX_BACKOFF)
+    {
+        busy_poll->backoff *= 2;
+    }
+
+    return 1;
+}
+
+/* Bracket a blocking wait, so time asleep is accounted separately from spinning. */
+
+void
+busy_poll_begin_sleep(Busy_Poll *busy_poll)
+{
+    busy_poll->sleep_start_ns = monotonic_ns();
+
+    if (busy_poll->idle_since_ns != 0)
+    {
+        atomic_fetch_add_explicit(&busy_poll->spin_ns, busy_poll->sleep_start_ns - busy_poll->idle_since_ns, memory_order_relaxed);
+        busy_poll->idle_since_ns = 0;
+    }
+}
+
+void
+busy_poll_end_sleep(Busy_Poll *busy_poll)
+{
+    atomic_fetch_add_explicit(&busy_poll->sleep_ns, monotonic_ns() - busy_poll->sleep_start_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&busy_poll->sleeps, 1, memory_order_relaxed);
+}
+
+/* Print time spent spinning and sleeping for a thread. */
+
+void
+show_busy_poll_stats(const char *name, Busy_Poll *busy_poll)
+{
+    printf("    %-28s spinning %10.3f s, sleeping %10.3f s (%llu sleeps)\n", name,
+           atomic_load(&busy_poll->spin_ns) / 1e9, atomic_load(&busy_poll->sleep_ns) / 1e9,
+           (unsigned long long)atomic_load(&busy_poll->sleeps));
+}
+
+/*
+    EVENT LOOPS
+*/
+
+/* Run the event loop for a mode. Does not return. */
+
+void
+run_scheduler(const Scheduler_Config *config)
+{
+    if (init_timer_wheel(&TIMER_WHEEL) == -1)
+    {
+        printf("Could not create timers, exiting. \n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* The command line is a client of the sockets, and listens on the ports. */
+
+    if (init_tcp_sockets() == -1 || listen_on_ports() == -1)
+    {
+        printf("Could not listen on TCP ports, exiting. \n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (config->start != NULL && config->start(config->start_arg) == -1)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    if (config->mode == SCHEDULER_SINGLE)
+    {
+        run_single_thread(config);
+    }
+    else
+    {
+        run_worker_threads(config);
+    }
+}
+
+/* Receive frames from every interface and stdin, and run timers, on one thread. */
+
+void
+run_single_thread(const Scheduler_Config *config)
+{
+    const Interface *interface; 
+    struct pollfd    poll_fds[NUM_INTERFACES + 2];      // Add 2 for stdin and timers
+    VDE_Reader      *readers;
+    Buffer_Pool      pool;
+    Graph            graph;
+    Busy_Poll        busy_poll;
+    RX_Queue_Stats   rx_stats[NUM_INTERFACES];
+    int              backlog[NUM_INTERFACES];
+    char             name[32];
+    int              i, j, received_data, received, timeout, round = 0;
+
+    init_busy_poll(&busy_poll, config->busy_poll_us);
+
+    /* Build the forwarding graph and plug in the protocol nodes. */
+
+    if (init_buffer_pool(&pool, BUFFER_POOL_SIZE) == -1 ||
+        init_graph(&graph, &pool) == -1 ||
+        register_arp_nodes(&graph) == -1 ||
+        register_icmp_nodes(&graph) == -1 ||
+        register_tcp_nodes(&graph) == -1)
+    {
+        printf("Could not build forwarding graph, exiting. \n");
+        exit(EXIT_FAILURE);
+    }
+
+    if ((readers = malloc(NUM_INTERFACES * sizeof(VDE_Reader))) == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Add all interface file descriptors to poll fds. */
+
+    for (i = 0; i < NUM_INTERFACES; i++)
+    {
+        interface          = &ROUTER_INTERFACES[i];
+        poll_fds[i].fd     = interface->fds[0];  
+        poll_fds[i].events = POLLIN;
+        backlog[i]         = 0;
+
+        init_rx_queue_stats(&rx_stats[i]);
+
+        if (init_vde_reader(&readers[i], interface->fds[0]) == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Add stdin fd to the poll fds. */
+
+    poll_fds[NUM_INTERFACES].fd     = STDIN_FILENO;
+    poll_fds[NUM_INTERFACES].events = POLLIN; 
+
+    /* Add the timer wheel's fd to the poll fds. */
+
+    poll_fds[NUM_INTERFACES + 1].fd     = TIMER_WHEEL.timer_fd;
+    poll_fds[NUM_INTERFACES + 1].events = POLLIN;
+
+    while (1)
+    {
+        /* Don't block while frames are still buffered from an earlier burst
+           or left over by a used-up quota, while sockets have events, or 
+           while busy polling after traffic. */
+
+        timeout = tcp_sockets_ready() ? 0 : -1;
+
+        for (i = 0; i < NUM_INTERFACES; i++)
+        {
+            if (backlog[i] || vde_reader_has_frame(&readers[i]))
+            {
+                timeout = 0;
+            }
+        }
+
+        if (timeout == -1 && busy_poll_spin(&busy_poll))
+        {
+            timeout = 0;
+        }
+
+        if (timeout == -1)
+        {
+            busy_poll_begin_sleep(&busy_poll);
+        }
+
+        received_data = poll(poll_fds, NUM_INTERFACES + 2, timeout);
+
+        if (timeout == -1)
+        {
+            busy_poll_end_sleep(&busy_poll);
+        }
+
+        if (received_data == -1)
+        {
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        if (received_data > 0)
+        {
+            busy_poll_work(&busy_poll);
+        }
+
+        /* Receive up to a quota of frames from each interface, starting one 
+           interface later each round so none is always served first. Then 
+           run the graph over the whole vector. */
+
+        round = (round + 1) % NUM_INTERFACES;
+
+        for (j = 0; j < NUM_INTERFACES; j++)
+        {
+            i = (round + j) % NUM_INTERFACES;
+
+            if ((poll_fds[i].revents & POLLIN) || backlog[i] || vde_reader_has_frame(&readers[i]))
+            {
+                if ((received = receive_rx_quota(&graph, &readers[i], &ROUTER_INTERFACES[i], config->rx_quota, &rx_stats[i])) < 0)
+                {
+                    perror("read");
+                    exit(EXIT_FAILURE);
+                }
+
+                backlog[i] = received == config->rx_quota;
+            }
+        }
+
+        graph_dispatch(&graph);
+
+        /* Fire due timers. */
+
+        if (poll_fds[NUM_INTERFACES + 1].revents & POLLIN)
+        {
+            run_timer_wheel(&TIMER_WHEEL);
+        }
+
+        /* Receive data from stdin. */
+
+        if (poll_fds[NUM_INTERFACES].revents & POLLIN)
+        {
+            if (read_stdin_command())
+            {
+                show_graph_stats(&graph);
+                printf("RX QUOTA (%d frames per round):\n", config->rx_quota);
+
+                for (i = 0; i < NUM_INTERFACES; i++)
+                {
+                    snprintf(name, sizeof(name), "R0_%d", i);
+                    show_rx_queue_stats(name, &rx_stats[i], &readers[i]);
+                }
+
+                printf("\nBUSY POLL (budget %d us):\n", config->busy_poll_us);
+                show_busy_poll_stats("Main thread", &busy_poll);
+                printf("\n");
+                show_timer_stats(&TIMER_WHEEL);
+                fflush(stdout);
+            }
+        }
+
+        /* Hand socket events to the applications. */
+
+        dispatch_tcp_sockets();
+    }
+}
+
+/* Forward frames on worker threads: an RX thread per interface steers flows
+   to the forwarding workers by RSS hash. The calling thread becomes the 
+   control thread: it owns all TCP state, so it handles segments for the 
+   router, stdin and timers. */
+
+void
+run_worker_threads(const Scheduler_Config *config)
+{
+    Worker_Set    workers;
+    struct pollfd poll_fds[3];
+    uint64_t      count;
+    int           timeout;
+
+    if (start_worker_set(&workers, config) == -1)
+    {
+        printf("Could not start worker threads, exiting. \n");
+        exit(EXIT_FAILURE);
+    }
+
+    poll_fds[0].fd     = STDIN_FILENO;
+    poll_fds[0].events = POLLIN;
+    poll_fds[1].fd     = workers.control_wakeup.event_fd;
+    poll_fds[1].events = POLLIN;
+    poll_fds[2].fd     = TIMER_WHEEL.timer_fd;
+    poll_fds[2].events = POLLIN;
+
+    while (1)
+    {
+        deliver_local_segments(&workers);
+
+        /* Sleep unless segments arrived after announcing it, or sockets have
+           events. */
+
+        begin_worker_sleep(&workers.control_wakeup);
+        timeout = local_segments_pending(&workers) || tcp_sockets_ready() ? 0 : -1;
+
+        if (poll(poll_fds, 3, timeout) == -1)
+        {
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+
+        end_worker_sleep(&workers.control_wakeup);
+
+        if (poll_fds[1].revents & POLLIN)
+        {
+            read(workers.control_wakeup.event_fd, &count, sizeof(count));
+        }
+
+        /* Fire due timers. */
+
+        if (poll_fds[2].revents & POLLIN)
+        {
+            run_timer_wheel(&TIMER_WHEEL);
+        }
+
+        /* Receive data from stdin. */
+
+        if (poll_fds[0].revents & POLLIN)
+        {
+            if (read_stdin_command())
+            {
+                show_worker_stats(&workers);
+                show_timer_stats(&TIMER_WHEEL);
+                fflush(stdout);
+            }
+        }
+
+        /* Hand socket events to the applications. */
+
+        dispatch_tcp_sockets();
+    }
+}
+
+/* Read a line from stdin and run it as a command. Returns 1 if statistics were
+   asked for, which the event loop prints since it owns them; everything else 
+   goes to handle_input. */
+
+int
+read_stdin_command()
+{
+    char    input[MAX_DATA_LEN];
+    ssize_t input_len;
+
+    input_len = read(STDIN_FILENO, input, sizeof(input) - 1);
+
+    if (input_len < 0)
+    {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Terminate the line, so commands can sscanf their arguments. */
+
+    input[input_len] = '\0';
+
+    /* Add case for ^C if user terminates program. */
+
+    if (input_len > 0)
+    {
+        if (memcmp(input, "/GRAPHSTATS\n", sizeof("/GRAPHSTATS\n") - 1) == 0)
+        {
+            return 1;
+        }
+
+        handle_input(input, input_len);
+        fflush(stdout); 
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * scheduler_functions.h
+ */
+
+#ifndef SCHEDULER_FUNCTIONS__H
+#define SCHEDULER_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include <pthread.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "router.h"
+#include "graph.h"
+#include "worker.h"
+#include "scheduler.h"
+
+/*
+    SCHEDULER FUNCTIONS
+*/
+
+/* Modes */
+
+int          parse_scheduler_mode(const char *name);
+const char  *scheduler_mode_name(int mode);
+int          pin_thread_to_cpu(pthread_t thread, int cpu);
+
+/* RX quota */
+
+void         init_rx_queue_stats(RX_Queue_Stats *stats);
+int          receive_rx_quota(Graph *graph, VDE_Reader *reader, const Interface *interface, int quota, RX_Queue_Stats *stats);
+void         show_rx_queue_stats(const char *name, RX_Queue_Stats *stats, VDE_Reader *reader);
+
+/* Busy polling */
+
+uint64_t     monotonic_ns();
+void         init_busy_poll(Busy_Poll *busy_poll, int budget_us);
+void         busy_poll_work(Busy_Poll *busy_poll);
+int          busy_poll_spin(Busy_Poll *busy_poll);
+void         busy_poll_begin_sleep(Busy_Poll *busy_poll);
+void         busy_poll_end_sleep(Busy_Poll *busy_poll);
+void         show_busy_poll_stats(const char *name, Busy_Poll *busy_poll);
+
+/* Event loops */
+
+void         run_scheduler(const Scheduler_Config *config);
+void         run_single_thread(const Scheduler_Config *config);
+void         run_worker_threads(const Scheduler_Config *config);
+int          read_stdin_command();
+
+#endif /* SCHEDULER_FUNCTIONS__H */
@@ -0,0 +1,47 @@
+/*
+ * slab.h
+ */
+
+#ifndef SLAB__H
+#define SLAB__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "ring.h"
+
+/*
+    SLAB CONSTANTS
+*/
+
+#define SLAB_SIZE                  65536
+
+/*
+    SLAB STRUCTS
+*/
+
+/* Header at the start of every slab. Objects follow on the next cache line. */
+
+typedef struct Slab
+{
+    struct Slab *next;                  /* Next slab of the cache.                 */
+} Slab;
+
+/* Hands out fixed-size objects carved from large cache-line aligned slabs, so 
+   allocating one costs a free list pop and no per-object malloc header. Freed
+   objects are linked through their first word and reused before a new slab is
+   allocated. Slabs are only returned when the cache is freed. Not thread-safe:
+   a cache is used by one thread. */
+
+typedef struct Slab_Cache
+{
+    const char  *name;                  /* Name shown in statistics.               */
+    size_t       object_size;           /* Rounded up to a cache line.             */
+    size_t       objects_per_slab;
+    void        *free_list;             /* Free objects, linked by first word.     */
+    Slab        *slabs;                 /* Every slab allocated by the cache.      */
+    size_t       num_slabs;
+    size_t       num_allocated;         /* Objects currently handed out.           */
+} Slab_Cache;
+
+#endif /* SLAB__H */
@@ -0,0 +1,136 @@
+/*
+ * slab_functions.c
+ */
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "slab.h"
+#include "slab_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/* Initialize an empty cache of objects of a given size. No slab is allocated 
+   until the first object is. Returns -1 if an object cannot fit in a slab. */
+
+int
+init_slab_cache(Slab_Cache *cache, const char *name, size_t object_size)
+{
+    size_t header_size = (sizeof(Slab) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+
+    /* Round up so every object starts on its own cache line. */
+
+    object_size = (object_size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+
+    if (object_size == 0 || object_size > SLAB_SIZE - header_size)
+    {
+        return -1;
+    }
+
+    cache->name             = name;
+    cache->object_size      = object_size;
+    cache->objects_per_slab = (SLAB_SIZE - header_size) / object_size;
+    cache->free_list        = NULL;
+    cache->slabs            = NULL;
+    cache->num_slabs        = 0;
+    cache->num_allocated    = 0;
+
+    return 1;
+}
+
+/* Free every slab of a cache, including objects still handed out. */
+
+void
+free_slab_cache(Slab_Cache *cache)
+{
+    Slab *slab, *next;
+
+    for (slab = cache->slabs; slab != NULL; slab = next)
+    {
+        next = slab->next;
+        free(slab);
+    }
+
+    cache->free_list     = NULL;
+    cache->slabs         = NULL;
+    cache->num_slabs     = 0;
+    cache->num_allocated = 0;
+}
+
+/* Allocate a slab and link its objects into the free list. If the allocation 
+   fails, return -1. */
+
+int
+grow_slab_cache(Slab_Cache *cache)
+{
+    Slab    *slab;
+    uint8_t *objects;
+    size_t   i;
+
+    if (posix_memalign((void **)&slab, CACHE_LINE_SIZE, SLAB_SIZE) != 0)
+    {
+        return -1;
+    }
+
+    slab->next   = cache->slabs;
+    cache->slabs = slab;
+    cache->num_slabs++;
+
+    /* Objects start on the cache line after the header. */
+
+    objects = (uint8_t *)slab + ((sizeof(Slab) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1));
+
+    for (i = cache->objects_per_slab; i > 0; i--)
+    {
+        *(void **)(objects + (i - 1) * cache->object_size) = cache->free_list;
+        cache->free_list = objects + (i - 1) * cache->object_size;
+    }
+
+    return 1;
+}
+
+/* Take an object from the cache. Its contents are undefined. Returns NULL if
+   a new slab was needed and could not be allocated. */
+
+void *
+slab_alloc(Slab_Cache *cache)
+{
+    void *object;
+
+    if (cache->free_list == NULL && grow_slab_cache(cache) == -1)
+    {
+        return NULL;
+    }
+
+    object           = cache->free_list;
+    cache->free_list = *(void **)object;
+    cache->num_allocated++;
+
+    return object;
+}
+
+/* Return an object to the cache. NULL is ignored. */
+
+void
+slab_free(Slab_Cache *cache, void *object)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+
+    *(void **)object = cache->free_list;
+    cache->free_list = object;
+    cache->num_allocated--;
+}
+
+/* Print the objects in use and memory held by a cache. */
+
+void
+show_slab_stats(const Slab_Cache *cache)
+{
+    printf("    %-20s %10zu objects in use (%zu bytes each), %zu slabs, %zu KB\n", cache->name,
+           cache->num_allocated, cache->object_size, cache->num_slabs, cache->num_slabs * SLAB_SIZE / 1024);
+}
@@ -0,0 +1,24 @@
+/*
+ * slab_functions.h
+ */
+
+#ifndef SLAB_FUNCTIONS__H
+#define SLAB_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "slab.h"
+
+/*
+    SLAB FUNCTIONS
+*/
+
+int            init_slab_cache(Slab_Cache *cache, const char *name, size_t object_size);
+void           free_slab_cache(Slab_Cache *cache);
+int            grow_slab_cache(Slab_Cache *cache);
+void          *slab_alloc(Slab_Cache *cache);
+void           slab_free(Slab_Cache *cache, void *object);
+void           show_slab_stats(const Slab_Cache *cache);
+
+#endif /* SLAB_FUNCTIONS__H */
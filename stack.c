@@ -18,96 +18,156 @@
 #include "icmp_functions.h"
 #include "arp_functions.h"
 #include "tcp_functions.h"
+#include "buffer.h"
+#include "buffer_functions.h"
+#include "graph.h"
+#include "graph_functions.h"
+#include "worker.h"
+#include "worker_functions.h"
+#include "scheduler.h"
+#include "scheduler_functions.h"
+#include "bench_functions.h"
 
 /* Function Prototypes */
 
 void print_message();
 void print_color_message();
+void print_usage(char *program);
 
 /* MAIN */
 
 int main(int argc, char *argv[])
 {
-    const Interface *interface; 
-    struct pollfd    poll_fds[NUM_INTERFACES + 1];      // Add 1 for stdin        
-    uint8_t          ether_frame[ETHERNET_MAX_FRAME_LEN];
-    ssize_t          frame_len, input_len;
-    int              i, received_data;
+    Scheduler_Config config;
+    TCP_Bench_Config tcp_config;
+    int              option, benchmark = 0, tcp_benchmark = 0, workers_given = 0;
 
-    /* Connect to all interfaces. */
+    /* Default to one forwarding worker per online CPU. */
 
-    connect_to_interfaces();
+    config.mode                   = -1;
+    config.pin_cpus               = 0;
+    config.busy_poll_us           = 0;
+    config.rx_quota               = RX_DEFAULT_QUOTA;
+    config.start                  = NULL;
+    config.start_arg              = NULL;
 
-    /* Add all interface file descriptors to poll fds. */
+    /* One TCP stream for ten seconds, over the in-memory link. */
 
-    for (i = 0; i < NUM_INTERFACES; i++)
-    {
-        interface          = &ROUTER_INTERFACES[i];
-        poll_fds[i].fd     = interface->fds[0];  
-        poll_fds[i].events = POLLIN;
-    }
+    tcp_config.streams            = 1;
+    tcp_config.seconds            = TCP_BENCH_DEFAULT_SECONDS;
+    tcp_config.bytes              = 0;
+    tcp_config.peer_ip            = 0;
+    tcp_config.receive            = 0;
+    config.num_forwarding_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    config.num_forwarding_workers = config.num_forwarding_workers < 1 ? 1 : config.num_forwarding_workers;
+    config.num_forwarding_workers = config.num_forwarding_workers > WORKER_MAX_FORWARDERS ? WORKER_MAX_FORWARDERS : config.num_forwarding_workers;
 
-    /* Add stdin fd to the poll fds. */
+    /* Parse options. */
 
-    poll_fds[NUM_INTERFACES].fd     = STDIN_FILENO;
-    poll_fds[NUM_INTERFACES].events = POLLIN; 
-
-    /* Print program message. */
+    while ((option = getopt(argc, argv, "ts:w:ap:q:bT:d:n:c:S")) != -1)
+    {
+        switch (option)
+        {
+            case 't':
+                config.mode = SCHEDULER_RUN_TO_COMPLETION;
+                break;
+            case 's':
+                if ((config.mode = parse_scheduler_mode(optarg)) == -1)
+                {
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'w':
+                config.num_forwarding_workers = atoi(optarg);
+                workers_given                 = 1;
+                break;
+            case 'a':
+                config.pin_cpus = 1;
+                break;
+            case 'p':
+                if ((config.busy_poll_us = atoi(optarg)) < 0)
+                {
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'q':
+                if ((config.rx_quota = atoi(optarg)) < 1)
+                {
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'b':
+                benchmark = 1;
+                break;
+            case 'T':
+                if ((tcp_config.streams = atoi(optarg)) < 1 || tcp_config.streams > TCP_BENCH_MAX_STREAMS)
+                {
+                    print_usage(argv[0]);
+                }
+                tcp_benchmark = 1;
+                break;
+            case 'd':
+                if ((tcp_config.seconds = atoi(optarg)) < 1)
+                {
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'n':
+                if ((tcp_config.bytes = parse_byte_count(optarg)) == 0)
+                {
+                    print_usage(argv[0]);
+                }
+                break;
+            case 'c':
+                if (inet_pton(AF_INET, optarg, &tcp_config.peer_ip) != 1)
+                {
+                    print_usage(argv[0]);
+                }
+                tcp_config.peer_ip = ntohl(tcp_config.peer_ip);
+                tcp_benchmark      = 1;
+                break;
+            case 'S':
+                tcp_config.receive = 1;
+                tcp_benchmark      = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+        }
+    }
 
-    print_message();
+    /* Benchmark on generated traffic instead of the switches: every mode, 
+       unless one was given. */
 
-    /* Continously receive data and frames. */
-
-    while (1)
+    if (benchmark)
     {
-        received_data = poll(poll_fds, NUM_INTERFACES + 1, -1);
+        return run_benchmarks(&config);
+    }
 
-        if (received_data == -1)
-        {
-            perror("poll");
-            exit(EXIT_FAILURE);
-        }
+    /* Asking for workers without a mode means run-to-completion. */
 
-        /* Receive data from interfaces. */
+    if (config.mode == -1)
+    {
+        config.mode = workers_given ? SCHEDULER_RUN_TO_COMPLETION : SCHEDULER_SINGLE;
+    }
 
-        for (i = 0; i < NUM_INTERFACES; i++)
-        {
-            if (poll_fds[i].revents & POLLIN)
-            {
-                if ((frame_len = receive_ethernet_frame(poll_fds[i].fd, ether_frame)) < 0)
-                {
-                    perror("read");
-                    exit(EXIT_FAILURE);
-                }
-                
-                handle_ethernet_frame(ether_frame, frame_len, &ROUTER_INTERFACES[i]);
-            }
-        }
+    /* Benchmark TCP bulk transfer in that mode. */
 
-        /* Receive data from stdin. */
+    if (tcp_benchmark)
+    {
+        return run_tcp_benchmark(&config, &tcp_config);
+    }
 
-        if (poll_fds[NUM_INTERFACES].revents & POLLIN)
-        {
-            char    input[MAX_DATA_LEN];
+    /* Connect to all interfaces. */
 
-            input_len = read(STDIN_FILENO, input, sizeof(input));
+    connect_to_interfaces();
 
-            if (input_len < 0)
-            {
-                perror("read");
-                exit(EXIT_FAILURE);
-            }
+    /* Print program message. */
 
-            /* Add case for ^C if user terminates program. */
+    print_message();
 
-            if (input_len > 0)
-            {
-                handle_input(input, input_len);
-                fflush(stdout); 
-            }
-        }
+    /* Continously receive data and frames. */
 
-    }
+    run_scheduler(&config);
 
     return 0;
 }
@@ -152,4 +212,24 @@ print_message()
 
     printf("\033[0m"); 
     printf("\n");
-}
\ No newline at end of file
+}
+
+void
+print_usage(char *program)
+{
+    fprintf(stderr, "usage: %s [-t] [-s single|rtc|pipeline] [-w workers] [-a] [-p usec] [-q frames] [-b] \n", program);
+    fprintf(stderr, "       %s [-T streams] [-d seconds | -n bytes] [-c ip | -S] [scheduler options] \n", program);
+    fprintf(stderr, "    -t            same as -s rtc \n");
+    fprintf(stderr, "    -s mode       single thread, run-to-completion workers, or a parse/lookup/TX pipeline \n");
+    fprintf(stderr, "    -w workers    number of forwarding workers flows are spread over (implies -s rtc) \n");
+    fprintf(stderr, "    -a            pin each worker thread to a CPU \n");
+    fprintf(stderr, "    -p usec       busy poll for usec after traffic before blocking \n");
+    fprintf(stderr, "    -q frames     frames received from each interface per round (default %d) \n", RX_DEFAULT_QUOTA);
+    fprintf(stderr, "    -b            benchmark every mode on generated traffic and exit \n");
+    fprintf(stderr, "    -T streams    benchmark TCP bulk transfer over parallel streams between two instances and exit \n");
+    fprintf(stderr, "    -d seconds    send for this long (default %d) \n", TCP_BENCH_DEFAULT_SECONDS);
+    fprintf(stderr, "    -n bytes      send this many in all instead, with an optional K, M or G \n");
+    fprintf(stderr, "    -c ip         send to a receiver at ip over the switches instead \n");
+    fprintf(stderr, "    -S            receive on port %d over the switches instead \n", TCP_BENCH_PORT);
+    exit(EXIT_FAILURE);
+}
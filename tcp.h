@@ -10,11 +10,16 @@
 #include "c_headers.h"
 #include "ethernet.h"
 #include "ip.h"
+#include "congestion.h"
+#include "slab.h"
+#include "timer.h"
 
 /* 
     TCP DATA STRUCTURES
 */
 
+struct TCP_Socket;
+
 typedef struct TCP_Header
 {
     uint16_t src_port;                  /* Source port.                            */
@@ -39,6 +44,32 @@ typedef struct TCP_Pseudoheader
 } TCP_Pseudoheader;
 
 
+/* Range [start, end) of sequence numbers a receiver holds (RFC 2018). */
+
+typedef struct TCP_Sack_Block
+{
+    uint32_t start;
+    uint32_t end;
+} TCP_Sack_Block;
+
+#define TCP_FASTOPEN_MAX_COOKIE_LEN 16  /* RFC 7413 4.1.1. */
+
+/* Options of a received segment. present is a mask of TCP_OPT_MSS ... 
+   TCP_OPT_FASTOPEN. */
+
+typedef struct TCP_Options
+{
+    uint8_t        present;
+    uint8_t        wscale;              /* Window scale shift.                     */
+    uint16_t       mss;                 /* Maximum segment size.                   */
+    uint32_t       ts_val;              /* Timestamp of the sender.                */
+    uint32_t       ts_ecr;              /* Timestamp echoed back to us.            */
+    uint8_t        num_sacks;
+    TCP_Sack_Block sacks[4];            /* At most 4 fit in the option space.      */
+    uint8_t        cookie_len;          /* Fast Open cookie, or 0 for a request.   */
+    uint8_t        cookie[TCP_FASTOPEN_MAX_COOKIE_LEN];
+} TCP_Options;
+
 typedef enum TCP_State
 {
     TCP_CLOSED,
@@ -54,39 +85,250 @@ typedef enum TCP_State
     TCP_TIME_WAIT
 } TCP_State;
 
-typedef struct TCP_Flags
+/* Control bits of a segment, as a mask of TCP_FIN ... TCP_URG. */
+
+typedef uint8_t TCP_Flags;
+
+/* Segment waiting to be acknowledged. Its payload stays in the connection's 
+   send buffer until then, so only the range of sequence numbers is kept. */
+
+typedef struct TCP_Segment
 {
-    int FIN_FLAG_SET;
-    int SYN_FLAG_SET;
-    int RST_FLAG_SET;
-    int PSH_FLAG_SET;
-    int ACK_FLAG_SET;
-    int URG_FLAG_SET;
-} TCP_Flags; 
+    struct TCP_Segment    *next;
+    uint32_t               seq;         /* Sequence number of the segment.         */
+    uint16_t               len;         /* Payload length.                         */
+    TCP_Flags              flags;       /* SYN and FIN take a sequence number.     */
+    uint8_t                retransmits; /* Times the segment was sent again.       */
+    uint8_t                sacked;      /* Held by the peer (SACK).                */
+    uint64_t               sent;        /* Tick first sent, for RTT samples.       */
+} TCP_Segment;
+
+/* Range [start, end) of out-of-order data held in the receive buffer. */
+
+typedef struct TCP_Interval
+{
+    struct TCP_Interval   *next;
+    uint32_t               start;
+    uint32_t               end;
+} TCP_Interval;
+
+/* Connections are allocated from a slab, each on its own cache lines. Fields 
+   read to demultiplex and handle every segment come first and must stay within
+   the first cache line; fields only used by the commands or when connections 
+   come and go follow. */
 
 typedef struct TCP_Connection
 {
-    uint32_t  src_ip;
-    uint32_t  dst_ip;
-    uint16_t  src_port;
-    uint16_t  dst_port;
-    uint16_t  window_size; 
-    uint32_t  seq_number;
-    uint32_t  ack_number;
-    TCP_State state; 
+    /* Hot. */
+
+    uint32_t               src_ip;
+    uint32_t               dst_ip;
+    uint16_t               src_port;
+    uint16_t               dst_port;
+    uint32_t               seq_number;  /* Next sequence number to send.           */
+    uint32_t               ack_number;  /* Next sequence number expected.          */
+    uint32_t               snd_una;     /* Oldest unacknowledged sequence number.  */
+    uint32_t               window_size; /* Window advertised to the peer.          */
+    TCP_State              state; 
+
+    /* Cold. */
+
+    struct TCP_Connection *next;        /* Next connection in the list.            */
+    struct TCP_Connection *prev;        /* Previous connection in the list.        */
+    Timer                  timer;       /* Handshake timeout.                      */
+    struct TCP_Socket     *socket;      /* Socket of the application, or NULL.     */
+    uint8_t                syn_queued;  /* Counted in its listener's SYN queue.    */
+
+    /* Retransmission (RFC 6298). */
+
+    TCP_Segment           *rtx_head;    /* Unacknowledged segments, oldest first.  */
+    TCP_Segment           *rtx_tail;
+    uint32_t               srtt;        /* Smoothed RTT, in 1/8 ticks.             */
+    uint32_t               rttvar;      /* RTT variation, in 1/4 ticks.            */
+    uint32_t               rto;         /* Retransmission timeout, in ms.          */
+    Timer                  rtx_timer;   /* Runs while segments are unacknowledged. */
+    uint32_t               retransmits; /* Segments sent again, for statistics.    */
+
+    /* Send buffer and window. Queued bytes sit in a ring at their sequence 
+       number modulo its size, from snd_una up to snd_end. */
+
+    uint8_t               *snd_buf;     /* NULL until data is first queued.        */
+    uint32_t               snd_end;     /* Sequence number after the queued data.  */
+    uint32_t               snd_wnd;     /* Window advertised by the peer.          */
+    uint32_t               snd_wl1;     /* Sequence number of last window update.  */
+    uint32_t               snd_wl2;     /* Ack number of last window update.       */
+    uint16_t               mss;         /* Largest payload sent in one segment,    
+                                           less options carried in every segment.  */
+    uint8_t                fin_queued;  /* FIN to follow the queued data.          */
+    uint8_t                nagle;       /* TCP_NAGLE_OFF and TCP_NAGLE_CORK.       */
+
+    /* Congestion control. */
+
+    const TCP_Congestion_Ops *cc_ops;   /* Algorithm of the connection.            */
+    TCP_Congestion_State   cc;          /* Private state of the algorithm.         */
+    uint32_t               cwnd;        /* Congestion window.                      */
+    uint32_t               ssthresh;    /* Slow start threshold.                   */
+    uint32_t               recover;     /* snd_nxt when recovery began.            */
+    uint8_t                dupacks;     /* Duplicate ACKs in a row.                */
+    uint8_t                ca_state;    /* TCP_CA_State.                           */
+
+    /* Reassembly. Out-of-order data sits in a ring at its sequence number modulo
+       its size until the gap before it is filled; in-order data is delivered 
+       straight from the segment. */
+
+    uint8_t               *rcv_buf;     /* NULL until data arrives out of order.   */
+    TCP_Interval          *ooo_head;    /* Held ranges, sorted and disjoint.       */
+    uint8_t                ooo_count;   /* Ranges held.                            */
+    uint32_t               ooo_last;    /* Start of the latest out-of-order data.  */
+    uint8_t                ack_pending; /* In-order segments not yet acknowledged. */
+    Timer                  ack_timer;   /* Runs while an ACK is delayed.           */
+
+    /* Options agreed in the handshake (RFC 7323, RFC 2018). */
+
+    uint8_t                opt_flags;   /* Mask of the TCP_OPT_* in use, or 0.     */
+    uint8_t                snd_wscale;  /* Shift of the peer's windows.            */
+    uint8_t                rcv_wscale;  /* Shift of our windows.                   */
+    uint32_t               ts_recent;   /* Timestamp to echo to the peer.          */
+    uint32_t               ack_sent;    /* Ack number in our last segment.         */
+    uint32_t               high_sacked; /* End of the highest SACKed segment.      */
+    uint32_t               high_rxt;    /* End of the last hole resent in recovery.*/
+    uint8_t                fastopen;    /* Our SYN or SYN-ACK carries a Fast Open 
+                                           option (RFC 7413).                      */
 } TCP_Connection;
 
-typedef struct TCP_Node
+_Static_assert(offsetof(TCP_Connection, next) <= CACHE_LINE_SIZE, "TCP connection hot fields exceed a cache line");
+
+/* Frames of one segmentation offload burst. A single set serves every 
+   connection, since TCP runs on the control thread only. */
+
+#define TCP_TSO_MAX_SEGMENTS      64    /* Frames per write.                       */
+#define TCP_TSO_HEADER_LEN        (sizeof(Ethernet_Header) + sizeof(IP_Header) + sizeof(TCP_Header) + TCP_MAX_OPTIONS_LEN)
+
+typedef struct TCP_TSO_Batch
+{
+    uint8_t         frames[TCP_TSO_MAX_SEGMENTS][ETHERNET_MAX_FRAME_LEN];
+    void           *frame_ptrs[TCP_TSO_MAX_SEGMENTS];
+    uint16_t        frame_lens[TCP_TSO_MAX_SEGMENTS];
+} TCP_TSO_Batch;
+
+/* In-order data segments of one flow from an RX burst, merged by software GRO
+   to go through the lookup and the state machine once. The head's TCP header
+   stands for the run, with the ACK, window, options and PSH of the latest
+   segment written into it; each payload stays in its own buffer. */
+
+#define TCP_GRO_MAX_SEGMENTS      44    /* 64 KB of full-sized segments.           */
+#define TCP_GRO_MAX_FLOWS         8     /* Runs open at once in a burst.           */
+
+typedef struct TCP_GRO_Run
+{
+    IP_Header            *ip_packet;
+    TCP_Header           *tcp_header;
+    uint32_t              len;          /* Payload of every segment.               */
+    uint32_t              next_seq;     /* Sequence number a segment must start at
+                                           to join.                                */
+    int                   num_segments;
+    struct Packet_Buffer *buffers[TCP_GRO_MAX_SEGMENTS];  /* NULL if nothing holds
+                                                              the payload.         */
+    uint8_t              *payloads[TCP_GRO_MAX_SEGMENTS];
+    uint16_t              lens[TCP_GRO_MAX_SEGMENTS];
+} TCP_GRO_Run;
+
+/* RTT samples of every connection, counted by the ms, for measuring the stack. */
+
+#define TCP_RTT_HISTOGRAM_LEN     1024  /* The last bucket holds longer RTTs too.  */
+
+typedef struct TCP_RTT_Histogram
 {
-    struct TCP_Node *next;  
-    TCP_Connection  *connection; 
-} TCP_Node; 
+    uint64_t        samples;
+    uint64_t        counts[TCP_RTT_HISTOGRAM_LEN];
+} TCP_RTT_Histogram;
+
+/* Slot in the connection table. Keeps the hash so most mismatches are skipped
+   without touching the connection. Empty if connection is NULL. */
+
+typedef struct TCP_Table_Slot
+{
+    uint32_t        hash;               /* Hash of the connection's 4-tuple.       */
+    TCP_Connection *connection;
+} TCP_Table_Slot;
+
+/* Fast Open cookie a server gave us, with its MSS, so the next connection to
+   it can carry data in the SYN. Empty if ip is 0. */
+
+#define TCP_FASTOPEN_CACHE_SIZE   256   /* Power of 2. Peers share entries by hash. */
+
+typedef struct TCP_Fastopen_Entry
+{
+    uint32_t        ip;
+    uint16_t        mss;
+    uint8_t         cookie_len;
+    uint8_t         cookie[TCP_FASTOPEN_MAX_COOKIE_LEN];
+} TCP_Fastopen_Entry;
+
+/* Connection in TIME_WAIT, cut down to what acknowledging a resent FIN and
+   guarding its 4-tuple take. A 0 src_port marks a bucket recycled before it
+   expired; a 0 ts_recent, one whose connection did not use timestamps. */
+
+typedef struct TCP_TW_Bucket
+{
+    uint32_t        src_ip;
+    uint32_t        dst_ip;
+    uint16_t        src_port;
+    uint16_t        dst_port;
+    uint32_t        snd_nxt;            /* Sequence number after our FIN.          */
+    uint32_t        rcv_nxt;            /* Sequence number after the peer's FIN.   */
+    uint32_t        ts_recent;          /* Peer's last timestamp.                  */
+    uint32_t        expires;            /* Tick it expires at, modulo 2^32.        */
+    uint32_t        next;               /* Next bucket in the hash chain, or 
+                                           TCP_TW_NONE.                            */
+} TCP_TW_Bucket;
+
+_Static_assert(sizeof(TCP_TW_Bucket) == 32, "TIME_WAIT bucket exceeds 32 bytes");
+
+/* Buckets of the connections in TIME_WAIT. Every bucket waits the same time, 
+   so they expire in the order they were entered: they are taken from a ring in
+   that order, and one timer reaps the oldest as they expire. Buckets are found
+   through hash chains of ring indices. A bucket recycled early stays in the 
+   ring, unchained, until its turn comes. */
+
+typedef struct TCP_TW_Table
+{
+    TCP_TW_Bucket  *ring;               /* TCP_MAX_TW_BUCKETS buckets, or NULL 
+                                           until a connection first enters.        */
+    uint32_t       *chains;             /* TCP_TW_HASH_SIZE chain heads.           */
+    uint32_t        head;               /* Oldest bucket in the ring.              */
+    uint32_t        count;              /* Buckets in the ring, recycled or not.   */
+    uint32_t        live;               /* Buckets still chained.                  */
+    uint64_t        recycled;           /* Reused early for a newer connection.    */
+    uint64_t        overflows;          /* Closed at once, the ring full.          */
+    Timer           timer;              /* Runs while the ring is not empty.       */
+} TCP_TW_Table;
+
+/* Connections in the order they were added, for the commands, indexed by an
+   open addressing table keyed by the 4-tuple for per-segment lookup. The table 
+   uses Robin Hood hashing with backward-shift deletion, so it has no tombstones
+   and probe lengths stay short as connections come and go. */
 
 typedef struct TCP_Connections_List
 {
-    size_t    size;
-    TCP_Node *head; 
-    TCP_Node *tail; 
+    size_t          size;
+    TCP_Connection *head; 
+    TCP_Connection *tail; 
+    Slab_Cache      cache;              /* Connections of the list.                */
+    Slab_Cache      segment_cache;      /* Retransmission queue entries.           */
+    Slab_Cache      interval_cache;     /* Out-of-order ranges.                    */
+    TCP_Table_Slot *slots;              /* Table of capacity (mask + 1) slots.     */
+    uint32_t        mask;               /* Capacity - 1 (power of 2).              */
+    uint32_t        seed;               /* Random hash seed.                       */
+    TCP_TSO_Batch  *tso;                /* Frames of the burst being sent.         */
+    uint16_t        ip_id;              /* IP id of the next segment sent.         */
+    uint64_t        cookie_secret;      /* Key of the SYN cookie hash.             */
+    TCP_RTT_Histogram *rtt_histogram;   /* RTT samples are counted here, if set.   */
+    TCP_TW_Table    tw;                 /* Connections in TIME_WAIT.               */
+    uint64_t        fastopen_secret;    /* Key of the Fast Open cookies we give.   */
+    TCP_Fastopen_Entry fastopen_cache[TCP_FASTOPEN_CACHE_SIZE]; /* Cookies we were given. */
+    uint64_t        gro_segments;       /* Segments received in runs of two or more. */
+    uint64_t        gro_runs;
 } TCP_Connections_List;
 
 /* 
@@ -106,13 +348,110 @@ typedef struct TCP_Connections_List
 
 #define SEQ_NUMBER_NOT_SET        0
 #define AF_INET                   2 
-#define MAX_TCP_CONNECTIONS       50
+#define MAX_TCP_CONNECTIONS       262144
+#define TCP_TABLE_INITIAL_SIZE    64
 #define MAX_SEGMENT_LIFETIME      120
 #define TCP_CONNECTION_TIMEOUT    (MAX_SEGMENT_LIFETIME * 2)   
+#define TCP_HANDSHAKE_TIMEOUT     75
+#define TCP_FIN_WAIT_2_TIMEOUT    60    /* Seconds to wait for the FIN of a peer
+                                           after the application closed.        */
+
+/* TIME_WAIT. Once the ring is full, connections close without it, so memory
+   stays bounded however fast connections churn. A bucket with timestamps may
+   be reused by our own connect once it is TCP_TW_REUSE_DELAY old, since every
+   segment of the new connection then carries a later timestamp than the old
+   one's (RFC 6191). */
+
+#define TCP_MAX_TW_BUCKETS        262144 /* Power of 2, 8 MB of buckets. */
+#define TCP_TW_HASH_SIZE          131072 /* Power of 2.                  */
+#define TCP_TW_NONE               UINT32_MAX
+#define TCP_TW_REUSE_DELAY        1000   /* ms */
+
+/* Retransmission (RFC 6298, times in ms) */
+
+#define TCP_INITIAL_RTO           1000
+#define TCP_MIN_RTO               1000
+#define TCP_MAX_RTO               60000
+#define TCP_MAX_RETRANSMITS       12
+#define TCP_RTT_SHIFT             3     /* srtt is scaled by 8.    */
+#define TCP_RTTVAR_SHIFT          2     /* rttvar is scaled by 4.  */
+
+/* Send path */
+
+#define TCP_SEND_BUFFER_SIZE      65536 /* Power of 2. */
+#define TCP_DEFAULT_MSS           536   /* Without an MSS option (RFC 1122 4.2.2.6). */
+#define TCP_MAX_MSS               (ETHERNET_MAX_DATA_LEN - sizeof(IP_Header) - sizeof(TCP_Header))
+#define TCP_NAGLE_OFF             0x1   /* Send short segments at once (NODELAY). */
+#define TCP_NAGLE_CORK            0x2   /* Hold short segments until uncorked.    */
+
+/* Receive path. The buffer must be larger than the advertised window. */
+
+#define TCP_RECV_BUFFER_SIZE      262144 /* Power of 2. */
+#define TCP_MAX_OOO_INTERVALS     16
+#define TCP_DELACK_SEGMENTS       2     /* ACK at least every second segment. */
+#define TCP_DELACK_TIMEOUT        40    /* ms, well under RFC 1122's 500.     */
+
+/* What tcp_receive_segment() made of a segment. */
+
+#define TCP_RECV_NOTHING          0
+#define TCP_RECV_DATA             1     /* In-order data, to acknowledge.     */
+#define TCP_RECV_ACK_NOW          2     /* Old, out of order or filling a gap. */
+#define TCP_RECV_FIN              3     /* The peer's FIN is next.            */
+
+/* TCP Options */
+
+#define TCP_OPTION_END            0
+#define TCP_OPTION_NOP            1
+#define TCP_OPTION_MSS            2
+#define TCP_OPTION_WSCALE         3
+#define TCP_OPTION_SACK_PERMITTED 4
+#define TCP_OPTION_SACK           5
+#define TCP_OPTION_TIMESTAMPS     8
+#define TCP_OPTION_FASTOPEN       34
+
+#define TCP_OPT_MSS               0x1
+#define TCP_OPT_WSCALE            0x2
+#define TCP_OPT_SACK_PERMITTED    0x4
+#define TCP_OPT_TIMESTAMPS        0x8
+#define TCP_OPT_SACK              0x10
+#define TCP_OPT_FASTOPEN          0x20
+#define TCP_OPT_OFFERED           (TCP_OPT_WSCALE | TCP_OPT_SACK_PERMITTED | TCP_OPT_TIMESTAMPS)
+
+#define TCP_MAX_OPTIONS_LEN       40
+#define TCP_TIMESTAMPS_LEN        12    /* With two NOPs for alignment. */
+#define TCP_WSCALE                2     /* Shift of our windows.        */
+#define TCP_MAX_WSCALE            14
+#define TCP_SCALED_WINDOW_SIZE    (65535 << TCP_WSCALE)
+
+/* SYN queue and SYN cookies (RFC 4987). A cookie is the sequence number of a
+   SYN-ACK: 5 bits of time, 3 bits of MSS and 24 bits of keyed hash. */
+
+#define TCP_SYN_BACKLOG           256   /* Half-open connections per listener.  */
+#define TCP_COOKIE_PERIOD         64000 /* ms each value of the time bits lasts.*/
+#define TCP_COOKIE_MAX_AGE        2     /* Periods a cookie is accepted after.  */
+#define TCP_COOKIE_TIME_SHIFT     27
+#define TCP_COOKIE_MSS_SHIFT      24
+#define TCP_COOKIE_HASH_MASK      0xFFFFFF
+
+/* Fast Open cookies, those we give and the shortest we take (RFC 7413 4.1.1). */
+
+#define TCP_FASTOPEN_COOKIE_LEN     8
+#define TCP_FASTOPEN_MIN_COOKIE_LEN 4
+
+/* Initial congestion window (RFC 5681 3.1) */
+
+#define TCP_INITIAL_CWND(mss)     ((mss) > 2190 ? 2 * (mss) : (mss) > 1095 ? 3 * (mss) : 4 * (mss))
+
+/* Sequence number comparisons (modulo 2^32) */
+
+#define SEQ_LT(a, b)              ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b)             ((int32_t)((a) - (b)) <= 0)
+#define SEQ_GT(a, b)              ((int32_t)((a) - (b)) > 0)
+#define SEQ_GEQ(a, b)             ((int32_t)((a) - (b)) >= 0)
+
 #define TCP_INITIAL_WINDOW_SIZE   1024
-#define MIN_TCP_PACKET_LEN        sizeof(Ethernet_Header) + sizeof(IP_Header) + sizeof(TCP_Header)
 #define MAX_DATA_LEN              4096
-#define DEFAULT_WINDOW_SIZE       8192
+#define DEFAULT_WINDOW_SIZE       65535
 #define MAX_VALID_PORT            65535
 
 #endif /* TCP__H */
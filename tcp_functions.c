@@ -12,10 +12,27 @@
 #include "router.h"
 #include "router_functions.h"
 #include "ethernet_functions.h"
+#include "frame_crc32.h"
 #include "ip.h"
 #include "ip_functions.h"
 #include "tcp.h"
 #include "tcp_functions.h"
+#include "tcp_socket.h"
+#include "tcp_socket_functions.h"
+#include "congestion_functions.h"
+#include "slab_functions.h"
+#include "timer_functions.h"
+#include "buffer_functions.h"
+#include "graph_functions.h"
+
+/*
+    SYN COOKIE MSS VALUES
+*/
+
+/* MSS values a SYN cookie can hold, in its 3 MSS bits. */
+
+static const uint16_t TCP_COOKIE_MSS[] = { 536, 1024, 1220, 1300, 1400, 1440, 1452, 1460 };
+static const int      NUM_COOKIE_MSS     = sizeof(TCP_COOKIE_MSS) / sizeof(uint16_t);
 
 /* 
     FUNCTION IMPLEMENTATIONS
@@ -27,51 +44,10 @@
 
 /* Extract the TCP flags from the TCP packet. */
 
-TCP_Flags *  
+TCP_Flags
 get_tcp_flags(TCP_Header *tcp_header)
 {
-    uint8_t    control_bits = ntohs(tcp_header->offset_reserved_control) & 0x3F;
-    TCP_Flags *flags;
-
-    /* Malloc space for flags. */
-
-    if ((flags = malloc(sizeof(TCP_Flags))) == NULL)  
-    {
-        return NULL;
-    }
-
-    /* Memset all flags to 0. */
-
-    memset(flags, 0, sizeof(TCP_Flags));
-
-    /* Check if each TCP control flag is set. */ 
-    
-    if (control_bits & TCP_FIN) 
-    {
-        flags->FIN_FLAG_SET = 1;
-    }
-    if (control_bits & TCP_SYN) 
-    {
-        flags->SYN_FLAG_SET = 1;
-    }
-    if (control_bits & TCP_RST) 
-    {
-        flags->RST_FLAG_SET = 1;
-    }
-    if (control_bits & TCP_PSH) 
-    {
-        flags->PSH_FLAG_SET = 1;
-    }
-    if (control_bits & TCP_ACK) 
-    {
-        flags->ACK_FLAG_SET = 1;
-    }
-    if (control_bits & TCP_URG) 
-    {
-        flags->URG_FLAG_SET = 1;
-    }
-
-    return flags; 
+    return ntohs(tcp_header->offset_reserved_control) & 0x3F;
 }
 
 /* Generates a random sequence number (uint32_t). */
@@ -99,75 +75,29 @@ get_random_port_number()
     return random_port_num;
 }
 
-/* Verifies if a port number is being listened to. */
-
-int 
-is_listening_port(uint16_t port_num)
-{
-    for (int i = 0; i < NUM_LISTENING_PORTS; i++)
-    {
-        if (port_num == LISTENING_PORTS[i])
-        {
-            return 1; 
-        }
-    }
-
-    return 0; 
-}
-
-/* Calculates the TCP checksum. Sets the passed tcp_header's own checksum to 0. */
+/* Calculates the TCP checksum. Sets the passed tcp_header's own checksum to 0. 
+   The pseudo-header, header and payload are summed in place. */
 
 uint16_t  
 calculate_tcp_checksum(TCP_Header *tcp_header, uint8_t *payload, ssize_t payload_len, uint32_t ip_src, uint32_t ip_dst)
 {
-    TCP_Pseudoheader *pseudo_header;
-    int               add_padding = 0; 
-    uint16_t          checksum;
-
-    /* Check for padding and allocate stack buffer. */
-
-    if (payload_len % 2 != 0)
-    {
-        add_padding = 1;
-    }
-
-    uint8_t pseudo_header_and_tcp_segment[sizeof(TCP_Pseudoheader) + sizeof(TCP_Header) + payload_len + add_padding];
-
-    /* Malloc space for pseudo header. */
-
-    if ((pseudo_header = malloc(sizeof(TCP_Pseudoheader))) == NULL)
-    {
-        return -1;
-    }
+    TCP_Pseudoheader pseudo_header;
+    uint32_t         sum;
 
     /* Set psuedo-header fields. */
 
-    pseudo_header->src_address = htonl(ip_src); 
-    pseudo_header->dst_address = htonl(ip_dst);
-    pseudo_header->zero        = 0; 
-    pseudo_header->protocol    = TCP_PROTOCOL;
-    pseudo_header->tcp_length  = htons(sizeof(TCP_Header) + payload_len); 
-    tcp_header->checksum       = 0;
-
-    /* Prefix pseudoheader to header and payload. */
-
-    memcpy(pseudo_header_and_tcp_segment, pseudo_header, sizeof(TCP_Pseudoheader));
-    memcpy(pseudo_header_and_tcp_segment + sizeof(TCP_Pseudoheader), tcp_header, sizeof(TCP_Header));
-    memcpy(pseudo_header_and_tcp_segment + sizeof(TCP_Pseudoheader) + sizeof(TCP_Header), payload, payload_len);  
-
-    /* Pad last byte on the right if needed. */
-
-    if (add_padding)
-    {
-        memset(pseudo_header_and_tcp_segment + sizeof(TCP_Pseudoheader) + sizeof(TCP_Header) + payload_len, 0, 1);
-    }
-
-    /* Calculate checksum and free pseudo header. */
+    pseudo_header.src_address = htonl(ip_src); 
+    pseudo_header.dst_address = htonl(ip_dst);
+    pseudo_header.zero        = 0; 
+    pseudo_header.protocol    = TCP_PROTOCOL;
+    pseudo_header.tcp_length  = htons(sizeof(TCP_Header) + payload_len); 
+    tcp_header->checksum      = 0;
 
-    checksum = RFC1071_checksum(pseudo_header_and_tcp_segment, sizeof(TCP_Pseudoheader) + sizeof(TCP_Header) + payload_len + add_padding);
-    free(pseudo_header);
+    sum = RFC1071_sum(&pseudo_header, sizeof(TCP_Pseudoheader), 0);
+    sum = RFC1071_sum(tcp_header, sizeof(TCP_Header), sum);
+    sum = RFC1071_sum(payload, payload_len, sum);
 
-    return checksum;
+    return RFC1071_fold(sum);
 }
 
 /* Print connection info. */
@@ -238,29 +168,44 @@ extract_ip_and_port(char *input, uint32_t *ip, uint16_t *port)
     SEGMENT HANDLER FUNCTIONS
 */
 
-/* Handle a TCP segment, encapsulated in an IP packet. NOTE: When creating or 
-   finding a connection, the received packet's source and destination IP/ports 
-   are switched. Also, when creating a new connection, the connection's seq number
-   will be randomized and its ack number will be the initial syn packet's seq number. */
+/* Handle a TCP segment, encapsulated in an IP packet, on its own. buffer holds
+   the packet, or is NULL if nothing does. */
+
+void 
+handle_tcp_segment(IP_Header *ip_packet, ssize_t ip_packet_len, Packet_Buffer *buffer)
+{
+    TCP_GRO_Run run;
+
+    if (init_tcp_gro_run(&run, ip_packet, ip_packet_len, buffer) == 0)
+    {
+        handle_tcp_run(&run);
+    }
+}
+
+/* Handle a run of TCP segments, verified by init_tcp_gro_run(). NOTE: When 
+   creating or finding a connection, the received packet's source and 
+   destination IP/ports are switched. Also, when creating a new connection, the
+   connection's seq number will be randomized and its ack number will be the 
+   initial syn packet's seq number. */
 
 void 
-handle_tcp_segment(IP_Header *ip_packet, ssize_t ip_packet_len)
+handle_tcp_run(TCP_GRO_Run *run)
 {
-    TCP_Header       *tcp_header;
-    TCP_Flags        *flags;
+    IP_Header        *ip_packet  = run->ip_packet;
+    TCP_Header       *tcp_header = run->tcp_header;
+    TCP_Options       options;
+    TCP_Flags         flags;
     TCP_Connection   *connection; 
-    uint8_t           ihl, data_offset;
-    uint16_t          src_port, dst_port, window_size; 
+    TCP_TW_Bucket    *bucket;
+    TCP_Socket       *listener;
+    uint16_t          src_port, dst_port; 
     uint32_t          ip_src, ip_dst, seq_number;
     ssize_t           segment_len, tcp_payload_len;  
 
-    /* Get TCP header, and calculate the segment and payload length. */
+    /* Calculate the header (with options) and payload length. */
 
-    ihl               = (ip_packet->version_and_IHL & 0x0F) * 4;
-    tcp_header        = (TCP_Header *)((uint8_t *)ip_packet + ihl);
-    data_offset       = ntohs(tcp_header->offset_reserved_control) >> 12;
-    segment_len       = data_offset * 4;
-    tcp_payload_len   = ip_packet_len - ihl - sizeof(TCP_Header); 
+    segment_len       = (ntohs(tcp_header->offset_reserved_control) >> 12) * 4;
+    tcp_payload_len   = run->len; 
 
     /* Extract TCP and IP fields. */
 
@@ -268,58 +213,119 @@ handle_tcp_segment(IP_Header *ip_packet, ssize_t ip_packet_len)
     ip_dst            = ntohl(ip_packet->destination);
     src_port          = ntohs(tcp_header->src_port); 
     dst_port          = ntohs(tcp_header->dst_port);
-    window_size       = ntohs(tcp_header->window_size);
     seq_number        = ntohl(tcp_header->seq_number);
 
-    /* Verify the validity of the packet. */
-
-    if (!valid_tcp_packet(tcp_header, ip_src, ip_dst, tcp_payload_len, segment_len))
+    if (parse_tcp_options(tcp_header, segment_len, &options) == -1)
     {
-        return; 
+        printf("Dropping TCP segment. Bad options.\n");
+        return;
     }
 
     /* Extract TCP flags. */
 
-    if ((flags = get_tcp_flags(tcp_header)) == NULL)
-    {
-        return; 
-    }
+    flags = get_tcp_flags(tcp_header);
 
     /* Initialize the connections list. */
 
-    if (TCP_CONNECTIONS_LIST == NULL)
+    if (TCP_CONNECTIONS_LIST == NULL && init_tcp_connections_list() == -1)
     {
-        init_tcp_connections_list();
+        return;
     }
 
-    /* Find the TCP connection and handle it. If it doesn't exist, create and add it to the list. */
+    /* Find the TCP connection and handle it. If it doesn't exist, only a SYN to an IP and port 
+       that are listened on opens one, or an ACK that completes a SYN cookie handshake. */
 
     if ((connection = find_tcp_connection(ip_dst, ip_src, dst_port, src_port)) == NULL)
     {
-        connection = create_tcp_connection(ip_dst, ip_src, dst_port, src_port, window_size, get_random_sequence_number(), seq_number, TCP_LISTEN);
-        add_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+        /* A connection in TIME_WAIT keeps its 4-tuple unless a newer SYN 
+           takes it over. */
+
+        if ((bucket = find_tw_bucket(ip_dst, ip_src, dst_port, src_port)) != NULL &&
+            handle_tw_segment(bucket, tcp_header, flags, &options, tcp_payload_len) == 0)
+        {
+            return;
+        }
+
+        if ((listener = find_tcp_listener(ip_dst, dst_port)) == NULL)
+        {
+            printf("Dropping TCP packet. Not listening on port.\n");
+            return; 
+        }
+
+        if ((flags & (TCP_SYN | TCP_ACK | TCP_RST)) == TCP_ACK)
+        {
+            if ((connection = check_syn_cookie(ip_dst, ip_src, dst_port, src_port, tcp_header, &options)) == NULL)
+            {
+                printf("Dropping TCP packet. No connection.\n");
+                return;
+            }
+
+            listener->stats.cookies_accepted++;
+        }
+        else if ((flags & (TCP_SYN | TCP_ACK | TCP_RST)) != TCP_SYN)
+        {
+            printf("Dropping TCP packet. No connection.\n");
+            return;
+        }
+        else if (listener->queued >= listener->backlog)
+        {
+            listener->stats.overflows++;
+            printf("Dropping TCP packet. Accept queue of port %d is full.\n", dst_port);
+            return; 
+        }
+        else if (listener->syn_queued >= listener->syn_backlog)
+        {
+            /* The SYN queue is full: answer without keeping any state. */
+
+            listener->stats.cookies_sent++;
+            send_syn_cookie(ip_dst, ip_src, dst_port, src_port, seq_number, &options);
+            return;
+        }
+        else
+        {
+            connection = create_tcp_connection(ip_dst, ip_src, dst_port, src_port, DEFAULT_WINDOW_SIZE, get_random_sequence_number(), seq_number, TCP_LISTEN);
+
+            if (connection == NULL || add_tcp_connection(TCP_CONNECTIONS_LIST, connection) == -1)
+            {
+                slab_free(&TCP_CONNECTIONS_LIST->cache, connection);
+                return;
+            }
+
+            /* A listener that takes Fast Open answers a request or a cookie with its own. */
+
+            connection->fastopen = listener->fastopen && (options.present & TCP_OPT_FASTOPEN);
+
+            /* Count it in the SYN queue, and drop it if it is not established in time. */
+
+            connection->syn_queued = 1;
+            listener->syn_queued++;
+            listener->stats.syns_queued++;
+            arm_timer(&TIMER_WHEEL, &connection->timer, TCP_HANDSHAKE_TIMEOUT * 1000);
+        }
     }
 
     /* Handle TCP connection. */
 
-    handle_tcp_connection(tcp_header, flags, connection, tcp_payload_len);
+    handle_tcp_connection(tcp_header, flags, connection, &options, run);
 }
 
-/* Verifies the length, checksum, and destination port of a TCP packet. Note that the
+/* Verifies the length and checksum of a TCP packet. Note that the
    actual segment len only needs to be greater than or equal to the passed segment length 
-   calculated from the data offset. Returns 0 if any of the above verifications fail. */
+   calculated from the data offset, which must cover at least the fixed header. payload_len 
+   is everything after the fixed header, options included. Returns 0 if any of the above 
+   verifications fail. */
 
 int 
 valid_tcp_packet(TCP_Header *tcp_header, uint32_t ip_src, uint32_t ip_dst, ssize_t payload_len, ssize_t calculated_segment_len)
 {
-    uint8_t  segment_len         = sizeof(TCP_Header) + payload_len; 
+    ssize_t  segment_len         = sizeof(TCP_Header) + payload_len; 
     uint8_t *payload             = (uint8_t *)(tcp_header) + sizeof(TCP_Header);
     uint16_t old_checksum        = tcp_header->checksum;
     uint16_t calculated_checksum = calculate_tcp_checksum(tcp_header, payload, payload_len, ip_src, ip_dst); 
     
     /* Verify TCP segment length. */
 
-    if (segment_len < calculated_segment_len)
+    if (segment_len < calculated_segment_len || calculated_segment_len < (ssize_t)sizeof(TCP_Header))
     {
         printf("Dropping TCP segment. Bad segment length.\n");
         return 0; 
@@ -333,14 +339,6 @@ valid_tcp_packet(TCP_Header *tcp_header, uint32_t ip_src, uint32_t ip_dst, ssize
         return 0; 
     }
 
-    /* Verify listening on the destination port. */
-
-    if (!is_listening_port(ntohs(tcp_header->dst_port)))
-    {
-        printf("Dropping TCP packet. Not listening on port.\n");
-        return 0; 
-    }
-
     return 1; 
 }
 
@@ -348,65 +346,106 @@ valid_tcp_packet(TCP_Header *tcp_header, uint32_t ip_src, uint32_t ip_dst, ssize
     CONNECTION IMPLEMENTATION FUNCTIONS
 */
 
-/* Initialize the list of TCP connections. If malloc fails, return -1.*/
+/* Initialize the list of TCP connections, its lookup table and the slab cache its 
+   connections come from. If malloc fails, return -1.*/
 
 int
 init_tcp_connections_list()
 {
     TCP_Connections_List *connections; 
 
-    /* Malloc space for connections list. */
+    /* Malloc space for connections list and table. */
 
     if ((connections = malloc(sizeof(TCP_Connections_List))) == NULL)
     {
         return -1;
     }
 
-    /* Set list fields and initialize global list. */
+    if ((connections->slots = calloc(TCP_TABLE_INITIAL_SIZE, sizeof(TCP_Table_Slot))) == NULL)
+    {
+        free(connections);
+        return -1;
+    }
+
+    if ((connections->tso = malloc(sizeof(TCP_TSO_Batch))) == NULL)
+    {
+        free(connections->slots);
+        free(connections);
+        return -1;
+    }
+
+    /* Set list fields and initialize global list. The seed keeps peers from 
+       choosing 4-tuples that collide. */
 
     connections->size = 0;
     connections->head = NULL;
     connections->tail = NULL;
+    connections->mask = TCP_TABLE_INITIAL_SIZE - 1;
+    connections->seed = get_random_sequence_number();
+    connections->ip_id = 0;
+    connections->rtt_histogram = NULL;
+    connections->tw.ring       = NULL;
+    connections->tw.chains     = NULL;
+    connections->tw.head       = 0;
+    connections->tw.count      = 0;
+    connections->tw.live       = 0;
+    connections->tw.recycled   = 0;
+    connections->tw.overflows  = 0;
+    init_timer(&connections->tw.timer, tcp_tw_timeout, &connections->tw);
+    getrandom(&connections->fastopen_secret, sizeof(uint64_t), 0);
+    memset(connections->fastopen_cache, 0, sizeof(connections->fastopen_cache));
+    connections->gro_segments  = 0;
+    connections->gro_runs      = 0;
+    getrandom(&connections->cookie_secret, sizeof(uint64_t), 0);
+    init_slab_cache(&connections->cache, "tcp-connection", sizeof(TCP_Connection));
+    init_slab_cache(&connections->segment_cache, "tcp-segment", sizeof(TCP_Segment));
+    init_slab_cache(&connections->interval_cache, "tcp-interval", sizeof(TCP_Interval));
 
     TCP_CONNECTIONS_LIST = connections;
 
     return 1; 
 }
 
-/* Free all connections, nodes and the list of TCP connections itself. */
+/* Free all connections and the list of TCP connections itself. */
 
 void 
 free_tcp_connections_list(TCP_Connections_List *connections_list) 
 {
-    TCP_Node *curr = connections_list->head;
-    TCP_Node *prev = NULL; 
+    TCP_Connection *curr;
 
-    /* Free all connections and nodes until end of list. */
+    /* Free the send and receive buffers, then all connections, segments and 
+       intervals with their slabs, then the tables, the burst frames and the list. */
 
-    while (curr != NULL)
+    for (curr = connections_list->head; curr != NULL; curr = curr->next)
     {
-        free(curr->connection);
-        prev = curr; 
-        curr = curr->next; 
-        free(prev);
+        free(curr->snd_buf);
+        free(curr->rcv_buf);
     }
-    
-    /* Free the list. */
 
+    free_slab_cache(&connections_list->cache);
+    free_slab_cache(&connections_list->segment_cache);
+    free_slab_cache(&connections_list->interval_cache);
+    cancel_timer(&TIMER_WHEEL, &connections_list->tw.timer);
+    free(connections_list->slots);
+    free(connections_list->tw.ring);
+    free(connections_list->tw.chains);
+    free(connections_list->tso);
     free(connections_list);
 }
 
-/* Create a connection and returns a pointer to it. If malloc fails, return NULL. */
+/* Create a connection and returns a pointer to it. The connection is taken from
+   the slab cache of the connections list, which must be initialized. If the 
+   cache cannot grow, return NULL. */
 
 TCP_Connection *
 create_tcp_connection(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
-                      uint16_t window_size, uint32_t seq_number, uint32_t ack_number, TCP_State state)
+                      uint32_t window_size, uint32_t seq_number, uint32_t ack_number, TCP_State state)
 {
     TCP_Connection *tcp_connection; 
 
-    /* Malloc space for connection. */
+    /* Take space for connection. */
 
-    if ((tcp_connection = malloc(sizeof(TCP_Connection))) == NULL)
+    if ((tcp_connection = slab_alloc(&TCP_CONNECTIONS_LIST->cache)) == NULL)
     {
         return NULL; 
     }
@@ -420,42 +459,210 @@ create_tcp_connection(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint1
     tcp_connection->window_size = window_size;
     tcp_connection->seq_number  = seq_number;
     tcp_connection->ack_number  = ack_number;
+    tcp_connection->snd_una     = seq_number;
     tcp_connection->state       = state;
+    tcp_connection->next        = NULL;
+    tcp_connection->prev        = NULL;
+    tcp_connection->socket      = NULL;
+    tcp_connection->syn_queued  = 0;
+    tcp_connection->rtx_head    = NULL;
+    tcp_connection->rtx_tail    = NULL;
+    tcp_connection->srtt        = 0;
+    tcp_connection->rttvar      = 0;
+    tcp_connection->rto         = TCP_INITIAL_RTO;
+    tcp_connection->retransmits = 0;
+    tcp_connection->snd_buf     = NULL;
+    tcp_connection->snd_end     = seq_number + 1;
+    tcp_connection->snd_wnd     = 0;
+    tcp_connection->snd_wl1     = 0;
+    tcp_connection->snd_wl2     = 0;
+    tcp_connection->mss         = TCP_DEFAULT_MSS;
+    tcp_connection->fin_queued  = 0;
+    tcp_connection->nagle       = 0;
+    tcp_connection->rcv_buf     = NULL;
+    tcp_connection->ooo_head    = NULL;
+    tcp_connection->ooo_count   = 0;
+    tcp_connection->ooo_last    = ack_number;
+    tcp_connection->ack_pending = 0;
+    tcp_connection->opt_flags   = 0;
+    tcp_connection->snd_wscale  = 0;
+    tcp_connection->rcv_wscale  = 0;
+    tcp_connection->ts_recent   = 0;
+    tcp_connection->ack_sent    = ack_number;
+    tcp_connection->high_sacked = seq_number;
+    tcp_connection->high_rxt    = seq_number;
+    tcp_connection->fastopen    = 0;
+
+    init_congestion_control(tcp_connection, &TCP_CONGESTION_ALGORITHMS[TCP_CC_DEFAULT]);
+
+    init_timer(&tcp_connection->timer, tcp_connection_timeout, tcp_connection);
+    init_timer(&tcp_connection->rtx_timer, tcp_retransmit_timeout, tcp_connection);
+    init_timer(&tcp_connection->ack_timer, tcp_delack_timeout, tcp_connection);
 
     return tcp_connection;
 }
 
-/* Add a TCP connection to the connections list. If malloc fails, return -1. */
+/* Hash a 4-tuple with a multiply-xorshift mix of the addresses and ports. */
+
+uint32_t
+tcp_connection_hash(const TCP_Connections_List *connections_list, uint32_t src_ip, uint32_t dst_ip, 
+                    uint16_t src_port, uint16_t dst_port)
+{
+    uint64_t hash;
+
+    hash  = ((uint64_t)src_ip << 32 | dst_ip) ^ connections_list->seed;
+    hash *= 0x9E3779B97F4A7C15ULL;
+    hash ^= ((uint64_t)src_port << 16 | dst_port) * 0xC2B2AE3D27D4EB4FULL;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+
+    return (uint32_t)hash;
+}
+
+/* Place a node in the table. A node that has probed further than the slot's 
+   occupant takes the slot, and the occupant moves on (Robin Hood hashing). */
+
+void
+insert_tcp_table_slot(TCP_Connections_List *connections_list, uint32_t hash, TCP_Connection *connection)
+{
+    TCP_Table_Slot *slots = connections_list->slots;
+    TCP_Table_Slot  entry = { hash, connection }, swap;
+    uint32_t        mask  = connections_list->mask;
+    uint32_t        index = hash & mask;
+    uint32_t        distance = 0, slot_distance;
+
+    while (slots[index].connection != NULL)
+    {
+        slot_distance = (index - slots[index].hash) & mask;
+
+        if (slot_distance < distance)
+        {
+            swap          = slots[index];
+            slots[index]  = entry;
+            entry         = swap;
+            distance      = slot_distance;
+        }
+
+        index = (index + 1) & mask;
+        distance++;
+    }
+
+    slots[index] = entry;
+}
+
+/* Double the size of the table and reinsert every connection. If calloc fails, return -1. */
+
+int
+grow_tcp_table(TCP_Connections_List *connections_list)
+{
+    TCP_Table_Slot *old_slots = connections_list->slots;
+    uint32_t        old_size  = connections_list->mask + 1;
+
+    if ((connections_list->slots = calloc(old_size * 2, sizeof(TCP_Table_Slot))) == NULL)
+    {
+        connections_list->slots = old_slots;
+        return -1;
+    }
+
+    connections_list->mask = old_size * 2 - 1;
+
+    for (uint32_t i = 0; i < old_size; i++)
+    {
+        if (old_slots[i].connection != NULL)
+        {
+            insert_tcp_table_slot(connections_list, old_slots[i].hash, old_slots[i].connection);
+        }
+    }
+
+    free(old_slots);
+
+    return 1;
+}
+
+/* Find the table slot of a 4-tuple. The probe stops early at a slot whose occupant
+   is closer to its home than we are, since Robin Hood order puts us before it.
+   Returns -1 if not found. */
+
+int64_t
+find_tcp_table_slot(const TCP_Connections_List *connections_list, uint32_t src_ip, uint32_t dst_ip, 
+                    uint16_t src_port, uint16_t dst_port)
+{
+    const TCP_Table_Slot *slots = connections_list->slots;
+    const TCP_Connection *connection;
+    uint32_t              mask  = connections_list->mask;
+    uint32_t              hash  = tcp_connection_hash(connections_list, src_ip, dst_ip, src_port, dst_port);
+    uint32_t              index = hash & mask;
+
+    for (uint32_t distance = 0; slots[index].connection != NULL; distance++)
+    {
+        if (((index - slots[index].hash) & mask) < distance)
+        {
+            break;
+        }
+
+        if (slots[index].hash == hash)
+        {
+            connection = slots[index].connection;
+
+            if (connection->src_ip   == src_ip   && connection->dst_ip   == dst_ip &&
+                connection->src_port == src_port && connection->dst_port == dst_port)
+            {
+                return index;
+            }
+        }
+
+        index = (index + 1) & mask;
+    }
+
+    return -1;
+}
+
+/* Add a TCP connection to the end of the connections list and to its table. The 
+   table doubles once it is 7/8 full. If malloc fails or the table already holds 
+   MAX_TCP_CONNECTIONS, return -1. */
 
 int 
 add_tcp_connection(TCP_Connections_List *connections_list, TCP_Connection *connection)
 {
-    TCP_Node *tcp_node;
+    if (connections_list->size == MAX_TCP_CONNECTIONS)
+    {
+        printf("Dropping TCP connection. Connection table full.\n");
+        return -1;
+    }
 
-    /* Malloc space for node. */
+    /* Grow the table before it gets crowded. */
 
-    if ((tcp_node = malloc(sizeof(TCP_Node))) == NULL)
+    if ((connections_list->size + 1) * 8 > ((size_t)connections_list->mask + 1) * 7 &&
+        grow_tcp_table(connections_list) == -1)
     {
-        return -1; 
+        return -1;
     }
 
     /* Check if the list is empty. */
 
     if (connections_list->head == NULL)
     {
-        connections_list->head       = tcp_node;
+        connections_list->head       = connection;
     }
     else
     {
-        connections_list->tail->next = tcp_node; 
+        connections_list->tail->next = connection; 
     }
 
     /* Increase the list size and insert the connection. */
 
     connections_list->size++; 
-    connections_list->tail           = tcp_node;
-    tcp_node->next                   = NULL;
-    tcp_node->connection             = connection; 
+    connection->prev                 = connections_list->tail;
+    connection->next                 = NULL;
+    connections_list->tail           = connection;
+
+    /* Index the connection by its 4-tuple. */
+
+    insert_tcp_table_slot(connections_list, 
+                          tcp_connection_hash(connections_list, connection->src_ip, connection->dst_ip,
+                                              connection->src_port, connection->dst_port),
+                          connection);
 
     return 1; 
 }
@@ -465,122 +672,98 @@ add_tcp_connection(TCP_Connections_List *connections_list, TCP_Connection *conne
 TCP_Connection * 
 find_tcp_connection(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
 {
-    TCP_Connection *connection; 
-    TCP_Node       *curr = TCP_CONNECTIONS_LIST->head;
-    int             found_connection; 
+    int64_t index;
 
-    while (curr != NULL)
+    if ((index = find_tcp_table_slot(TCP_CONNECTIONS_LIST, src_ip, dst_ip, src_port, dst_port)) == -1)
     {
-        connection           = curr->connection;
-        found_connection     = 1;
-
-        /* Check if connection fields are the same. If they are,
-           return the connection. Else, continue searching. */
-
-        if (connection->src_ip != src_ip)
-        {
-            found_connection = 0;
-        }
-        if (connection->dst_ip != dst_ip)
-        {
-            found_connection = 0;
-        }
-        if (connection->src_port != src_port)
-        {
-            found_connection = 0;
-        }
-        if (connection->dst_port != dst_port)
-        {
-            found_connection = 0;
-        }
-        
-        if (found_connection)
-        {
-            return connection;
-        }
-
-        curr = curr->next;
+        return NULL;
     }
 
-    return NULL;
+    return TCP_CONNECTIONS_LIST->slots[index].connection;
 }
 
-/* Remove a connection from the connections list. Returns -1 on failure (cannot find connection). */
+/* Remove a connection from the connections list. The slots after it are shifted
+   back one place until one is empty or already at its home slot, so no tombstone 
+   is left behind. Returns -1 on failure (cannot find connection). */
 
 int
 remove_tcp_connection(TCP_Connections_List *connections_list, TCP_Connection *connection)
 {
-    TCP_Node *curr          = connections_list->head; 
-    TCP_Node *prev          = NULL; 
-    int       deleting_curr = 0; 
+    TCP_Table_Slot *slots = connections_list->slots;
+    uint32_t        mask  = connections_list->mask;
+    uint32_t        index, next;
+    int64_t         found;
 
-    while (curr != NULL)
+    if ((found = find_tcp_table_slot(connections_list, connection->src_ip, connection->dst_ip,
+                                     connection->src_port, connection->dst_port)) == -1)
     {
-        /* Check for a matching connection. */
-
-        if (memcmp(curr->connection, connection, sizeof(TCP_Connection)) == 0)
-        {
-            /* If removing current connection to send data to. */
-
-            if (CURRENT_CONNECTION == curr->connection)
-            {
-                deleting_curr = 1; 
-            }
-            
-            /* If removing the list head. */
+        return -1;
+    }
 
-            if (prev == NULL)
-            {
-                connections_list->head = curr->next; 
-            }
-            else
-            {
-                prev->next = curr->next; 
-            }
+    /* Remove from the table. */
 
-            /* If removing the list tail. */
+    index = found;
+    next  = (index + 1) & mask;
 
-            if (connections_list->tail == curr)
-            {
-                connections_list->tail = prev; 
-            }
+    while (slots[next].connection != NULL && ((next - slots[next].hash) & mask) != 0)
+    {
+        slots[index] = slots[next];
+        index        = next;
+        next         = (next + 1) & mask;
+    }
 
-            /* Free structs and reduce size. */
+    slots[index].connection = NULL;
 
-            free(curr->connection);
-            free(curr);
-            connections_list->size--;
+    /* Unlink from the list. */
 
-            /* If deleting the currently selected connection, reset to the 
-               first established connection in list. */
+    if (connection->prev == NULL)
+    {
+        connections_list->head = connection->next; 
+    }
+    else
+    {
+        connection->prev->next = connection->next; 
+    }
 
-            if (deleting_curr)
-            {
-                reset_selected_connection();
-            }
+    if (connection->next == NULL)
+    {
+        connections_list->tail = connection->prev; 
+    }
+    else
+    {
+        connection->next->prev = connection->prev; 
+    }
 
-            return 1; 
-        }
+    /* Tell the socket, then free connection and reduce size. */
 
-        prev = curr; 
-        curr = curr->next; 
-    }
+    tcp_socket_notify(connection, TCP_SOCKET_CLOSED);
+    tcp_socket_unqueue_syn(connection);
+    cancel_timer(&TIMER_WHEEL, &connection->timer);
+    cancel_timer(&TIMER_WHEEL, &connection->rtx_timer);
+    cancel_timer(&TIMER_WHEEL, &connection->ack_timer);
+    free_tcp_segments(connection);
+    free_ooo_intervals(connection);
+    free(connection->snd_buf);
+    free(connection->rcv_buf);
+    slab_free(&connections_list->cache, connection);
+    connections_list->size--;
 
-    return -1;
+    return 1; 
 }
 
-/* Reset the selected connection to send data to as the first established connection or NULL. */
+/* Reset the selected connection to send data to as the first established connection 
+   of the command line, or NULL. */
 
 int 
 reset_selected_connection()
 {
-    TCP_Node *curr = TCP_CONNECTIONS_LIST->head; 
+    TCP_Connection *curr = TCP_CONNECTIONS_LIST != NULL ? TCP_CONNECTIONS_LIST->head : NULL; 
 
     while (curr != NULL)
     {
-        if (curr->connection->state == TCP_ESTABLISHED)
+        if (curr->state == TCP_ESTABLISHED && cli_socket(curr) != NULL)
         {
-            CURRENT_CONNECTION = curr->connection; 
+            CURRENT_SOCKET = curr->socket; 
             return 1; 
         }
 
@@ -589,7 +772,7 @@ reset_selected_connection()
 
     /* No remaining established connections. Set to NULL */
     
-    CURRENT_CONNECTION = NULL; 
+    CURRENT_SOCKET = NULL; 
 
     return 0;
 }
@@ -604,9 +787,9 @@ reset_selected_connection()
 int                  
 handle_input(char *input, ssize_t input_len)
 {
-    TCP_Flags *flags; 
     char      *num_pos;
     int        conn_num;
+    ssize_t    queued;
 
     /* Command /HELP  */
 
@@ -698,8 +881,10 @@ handle_input(char *input, ssize_t input_len)
     {
         uint16_t dst_port;
         uint32_t ip_dst;
+        int      data_pos = 0;
+        char    *data;
 
-        /* Extract the IP address and port number. */
+        /* Extract the IP address and port number, and any data to send. */
 
         num_pos = input + (sizeof("/CONNECT ") - 1);
 
@@ -708,9 +893,12 @@ handle_input(char *input, ssize_t input_len)
             return -1; 
         }
 
+        sscanf(num_pos, "%*s %*s %n", &data_pos);
+        data = num_pos + data_pos;
+
         /* Create connection and attempt to connect. */
         
-        if (active_create_connection(ip_dst, dst_port) != -1)
+        if (active_create_connection(ip_dst, dst_port, data, data_pos > 0 ? strcspn(data, "\n") : 0) != NULL)
         {
             printf("Attempting to connect. Use /SHOWALL to see established connections.\n\n");
             return 0;
@@ -743,69 +931,121 @@ handle_input(char *input, ssize_t input_len)
         return 1; 
     }
 
-    /* Sending data. Check if connection is non-NULL. */
+    /* Command /LISTEN and /UNLISTEN */
 
-    if (CURRENT_CONNECTION == NULL)
+    if (memcmp(input, "/LISTEN\n", sizeof("/LISTEN\n") - 1) == 0)
     {
-        printf("No connection to send data to. \n\n");
-
-        return 0; 
+        show_listeners();
+        return 0;
     }
 
-    /* Malloc space for flags. */
+    if (memcmp(input, "/LISTEN ", sizeof("/LISTEN ") - 1) == 0)
+    {
+        return change_listener(input + sizeof("/LISTEN ") - 1, 1);
+    }
 
-    if ((flags = malloc(sizeof(TCP_Flags))) == NULL)  
+    if (memcmp(input, "/UNLISTEN ", sizeof("/UNLISTEN ") - 1) == 0)
     {
-        return -1;
+        return change_listener(input + sizeof("/UNLISTEN ") - 1, 0);
     }
 
-    /* Set flags. */
+    /* Command /CCTRACE */
 
-    memset(flags, 0, sizeof(TCP_Flags));
-    flags->ACK_FLAG_SET = 1;
-    flags->PSH_FLAG_SET = 1;
+    if (memcmp(input, "/CCTRACE ", sizeof("/CCTRACE ") - 1) == 0)
+    {
+        char path[256] = "";
 
-    /* Construct and send packet. Update sequence number by input length. */
+        sscanf(input + sizeof("/CCTRACE ") - 1, "%255s", path);
+        trace_congestion_to(path);
 
-    construct_and_send_tcp_packet(flags, CURRENT_CONNECTION, input, input_len);
-    update_connection_seq_ack(CURRENT_CONNECTION, input_len, 0);
-    free(flags);
+        return 1;
+    }
 
-    return 0;
-}
+    /* Command /NODELAY */
 
-/* Show help message. */
+    if (memcmp(input, "/NODELAY\n", sizeof("/NODELAY\n") - 1) == 0 || memcmp(input, "/NODELAY ", sizeof("/NODELAY ") - 1) == 0)
+    {
+        change_send_coalescing(input + sizeof("/NODELAY") - 1, TCP_NAGLE_OFF);
+        return 1;
+    }
 
-void 
-show_help()
-{
-    printf("\nHELP:\n");
-    printf("    Use /SHOWALL to show all connections and currently connected connection (to send data to).\n");
-    printf("    Use /SWITCHTO 0 to switch to an established connection when sending data (replace 0). \n");
-    printf("    Use /CLOSE 0 to close an established connection (replace 0).\n");
-    printf("    Use /CONNECT 0.0.0.0 4000 to actively connect to an IP and port (replace 0.0.0.0 and 4000).\n");    
-    printf("    Use /ACTIVEPORT to view the current port to actively create connections.\n");
-    printf("    Use /ACTIVEPORT 4000 to replace the current port to actively create connections (replace 4000).\n\n");
-}
+    /* Command /CORK */
 
-/* Show currently connected connection and all ESTABLISHED connections. */
+    if (memcmp(input, "/CORK\n", sizeof("/CORK\n") - 1) == 0 || memcmp(input, "/CORK ", sizeof("/CORK ") - 1) == 0)
+    {
+        change_send_coalescing(input + sizeof("/CORK") - 1, TCP_NAGLE_CORK);
+        return 1;
+    }
+
+    /* Command /CC */
+
+    if (memcmp(input, "/CC\n", sizeof("/CC\n") - 1) == 0 || memcmp(input, "/CC ", sizeof("/CC ") - 1) == 0)
+    {
+        change_congestion_control(input + sizeof("/CC") - 1);
+        return 1;
+    }
+
+    /* Sending data. Check if connection is non-NULL. */
+
+    if (CURRENT_SOCKET == NULL)
+    {
+        printf("No connection to send data to. \n\n");
+
+        return 0; 
+    }
+
+    /* Queue the input on the send buffer. It goes out as the window allows. */
+
+    if ((queued = tcp_socket_send(CURRENT_SOCKET, input, input_len)) < input_len)
+    {
+        printf("Send buffer full, %zd of %zd bytes not sent. \n\n", input_len - (queued > 0 ? queued : 0), input_len);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Show help message. */
+
+void 
+show_help()
+{
+    printf("\nHELP:\n");
+    printf("    Use /SHOWALL to show all connections and currently connected connection (to send data to).\n");
+    printf("    Use /SWITCHTO 0 to switch to an established connection when sending data (replace 0). \n");
+    printf("    Use /CLOSE 0 to close an established connection (replace 0).\n");
+    printf("    Use /CONNECT 0.0.0.0 4000 to actively connect to an IP and port (replace 0.0.0.0 and 4000).\n");    
+    printf("    Use /CONNECT 0.0.0.0 4000 hello to send hello as the connection opens, in the SYN with Fast Open.\n");
+    printf("    Use /ACTIVEPORT to view the current port to actively create connections.\n");
+    printf("    Use /ACTIVEPORT 4000 to replace the current port to actively create connections (replace 4000).\n");
+    printf("    Use /LISTEN to view listeners, /LISTEN 4000 to listen on a port and /LISTEN 0.0.0.0 4000 on one IP.\n");
+    printf("    Use /UNLISTEN 4000 or /UNLISTEN 0.0.0.0 4000 to stop listening (replace 0.0.0.0 and 4000).\n");
+    printf("    Use /CC to view congestion control, /CC cubic to set it for new connections and /CC 0 cubic for connection 0.\n");
+    printf("    Use /CCTRACE trace.csv to write cwnd/ssthresh changes to a file, and /CCTRACE OFF to stop.\n");
+    printf("    Use /NODELAY ON to send short input at once on the current connection, and /NODELAY OFF to coalesce it.\n");
+    printf("    Use /CORK ON to send only full segments on the current connection, and /CORK OFF to send what is held.\n");
+    printf("    Use /GRAPHSTATS to show per-node forwarding graph statistics.\n\n");
+}
+
+/* Show currently connected connection and all ESTABLISHED connections. */
 
 void 
 show_all_connections()
 {
-    TCP_Node       *curr = TCP_CONNECTIONS_LIST->head; 
+    TCP_Connection *curr = TCP_CONNECTIONS_LIST->head; 
     int             conn_num = 0;
 
-    /* Print current connection to send to. */
+    /* Print current connection to send to. Its connection may be gone before
+       the socket is told. */
 
-    if (CURRENT_CONNECTION == NULL)
+    if (CURRENT_SOCKET == NULL || CURRENT_SOCKET->connection == NULL)
     {
         printf("\nCurrent connection (sending to): NONE \n");
     }
     else 
     {
         printf("\nCurrent connection (sending to): \n");
-        print_connection_info(CURRENT_CONNECTION, -1);
+        print_connection_info(CURRENT_SOCKET->connection, -1);
     }
 
     /* Print all established connections. */
@@ -814,15 +1054,29 @@ show_all_connections()
 
     while (curr != NULL)
     {
-        if (curr->connection->state == TCP_ESTABLISHED)
+        if (curr->state == TCP_ESTABLISHED)
         {
-            print_connection_info(curr->connection, conn_num);
+            print_connection_info(curr, conn_num);
             conn_num++; 
         }
 
         curr = curr->next; 
     }
 
+    /* Print connection memory. */
+
+    printf("\nConnection memory (%zu connections, %u table slots):\n", TCP_CONNECTIONS_LIST->size, TCP_CONNECTIONS_LIST->mask + 1);
+    show_slab_stats(&TCP_CONNECTIONS_LIST->cache);
+    show_slab_stats(&TCP_CONNECTIONS_LIST->segment_cache);
+    show_slab_stats(&TCP_CONNECTIONS_LIST->interval_cache);
+    show_slab_stats(&TCP_SOCKETS.chunk_cache);
+    printf("    %u packet buffers held for received data.\n", TCP_SOCKETS.held_buffers);
+    printf("    %u connections in TIME_WAIT (%zu bytes each), %llu recycled early, %llu closed without it.\n", 
+           TCP_CONNECTIONS_LIST->tw.live, sizeof(TCP_TW_Bucket), (unsigned long long)TCP_CONNECTIONS_LIST->tw.recycled, 
+           (unsigned long long)TCP_CONNECTIONS_LIST->tw.overflows);
+    printf("    %llu segments received merged into %llu runs by GRO.\n", 
+           (unsigned long long)TCP_CONNECTIONS_LIST->gro_segments, (unsigned long long)TCP_CONNECTIONS_LIST->gro_runs);
+
     printf("\n");
 }
 
@@ -831,19 +1085,19 @@ show_all_connections()
 int 
 switch_to_connection(int conn_num)
 {
-    TCP_Node       *curr       = TCP_CONNECTIONS_LIST->head; 
+    TCP_Connection *curr       = TCP_CONNECTIONS_LIST->head; 
     int             curr_conn  = 0; 
 
     /* Search for matching connection. */
 
     while (curr != NULL)
     {
-        if (curr->connection->state == TCP_ESTABLISHED)
+        if (curr->state == TCP_ESTABLISHED)
         {
-            if (curr_conn == conn_num)
+            if (curr_conn == conn_num && cli_socket(curr) != NULL)
             {
                 printf("Switching to connection %d. \n", conn_num);
-                CURRENT_CONNECTION = curr->connection;
+                CURRENT_SOCKET = curr->socket;
                 return 1;
             }
 
@@ -863,21 +1117,19 @@ switch_to_connection(int conn_num)
 int 
 close_connection(int conn_num)
 {
-    TCP_Node        *curr       = TCP_CONNECTIONS_LIST->head; 
+    TCP_Connection  *curr       = TCP_CONNECTIONS_LIST->head; 
     int              curr_conn  = 0;  
 
     /* Search for matching connection. */
 
     while (curr != NULL)
     {
-        if (curr->connection->state == TCP_ESTABLISHED)
+        if (curr->state == TCP_ESTABLISHED)
         {            
-            if (curr_conn == conn_num)
+            if (curr_conn == conn_num && cli_socket(curr) != NULL)
             {
                 printf("Closing connection %d. \n\n", conn_num);
-                send_fin_ack(curr->connection); 
-                curr->connection->state = TCP_FIN_WAIT_1;
-                reset_selected_connection();
+                close_cli_socket(curr->socket);
                 return 1;          
             }
             
@@ -892,73 +1144,52 @@ close_connection(int conn_num)
     return 0;
 }
 
-/* Actively create a conncetion and connect to a specific IP and port. */
+/* Actively create a conncetion and connect to a specific IP and port, from the active port. 
+   Data, if len is not 0, goes as the connection opens. */
 
-int 
-active_create_connection(uint32_t ip_dst, uint16_t dst_port)
+TCP_Socket * 
+active_create_connection(uint32_t ip_dst, uint16_t dst_port, const char *data, size_t len)
 {
-    TCP_Connection *connection; 
-    uint16_t        src_port; 
-    uint32_t        ip_src   = ROUTER_INTERFACES[0].ip_address;
-
-    /* Initialize the connections list. */
-
-    if (TCP_CONNECTIONS_LIST == NULL)
-    {
-        init_tcp_connections_list();
-    }
-
     /* Get source port. */
 
     if (!ACTIVE_SENDING_PORT)
     {
         ACTIVE_SENDING_PORT = LISTENING_PORTS[0]; 
     }
-    
-    src_port = ACTIVE_SENDING_PORT; 
-
-    /* Search for existing connection or create a new one. */
-    
-    if ((connection = find_tcp_connection(ip_src, ip_dst, src_port, dst_port)) == NULL)
-    {
-        connection = create_tcp_connection(ip_src, ip_dst, src_port, dst_port, DEFAULT_WINDOW_SIZE, get_random_sequence_number(), 0, TCP_LISTEN);
-        add_tcp_connection(TCP_CONNECTIONS_LIST, connection);
-    }
-    else if (connection->state == TCP_ESTABLISHED)
-    {
-        printf("\nConnection already established. \n\n");
-        return 0;
-    }
 
-    /* Attempt to connect to connection if not established. */
-
-    if (send_syn(connection) == -1)
+    if (len > 0)
     {
-        printf("\nFailed to send SYN packet. \n\n");
-        return -1;
+        return tcp_socket_connect_data(ip_dst, dst_port, ACTIVE_SENDING_PORT, data, len, handle_cli_socket, NULL);
     }
 
-    connection->state = TCP_SYN_SENT;
-
-    return 1;
+    return tcp_socket_connect(ip_dst, dst_port, ACTIVE_SENDING_PORT, handle_cli_socket, NULL);
 }
 
 void
 change_active_port(uint16_t port)
 {
-    if (port == 0 || !is_listening_port(port))
+    TCP_Socket *listener;
+    int         num_ports = 0, last_port = -1;
+
+    if (port == 0 || !tcp_port_listened(port))
     {
         printf("\nPlease choose a valid source port. \n");
         printf("\nCurrently listening on the following ports: \n");
 
-        for (int i = 0; i < NUM_LISTENING_PORTS; i++)
+        for (listener = next_tcp_listener(NULL); listener != NULL; listener = next_tcp_listener(listener))
         {
-            if (i % 5 == 0)
+            if (listener->src_port == last_port)
+            {
+                continue;
+            }
+
+            if (num_ports++ % 5 == 0)
             {
                 printf("\n      "); 
             }
 
-            printf("%d  ", LISTENING_PORTS[i]);
+            printf("%d  ", listener->src_port);
+            last_port = listener->src_port;
         }
 
         printf("\n\n");
@@ -970,438 +1201,2761 @@ change_active_port(uint16_t port)
     }
 }
 
-/* 
-    STATE MACHINE FUNCTIONS
-*/
+/* Show or change congestion control. With no arguments, show the algorithms and
+   the windows of established connections. With a name, set the algorithm for 
+   new connections; with a connection number and a name, switch that connection. */
 
-void 
-handle_tcp_connection(TCP_Header *tcp_header, TCP_Flags *flags, TCP_Connection *connection, ssize_t tcp_payload_len)
+int
+change_congestion_control(char *args)
 {
-    uint32_t net_dst_ip;
-    char     dst_ip[INET_ADDRSTRLEN]; 
+    const TCP_Congestion_Ops *ops;
+    TCP_Connection           *curr;
+    char                      name[16];
+    int                       conn_num, curr_conn = 0, num_args;
 
-    /* Diagnostic info. */
-    net_dst_ip = htonl(connection->dst_ip);
-    inet_ntop(AF_INET, &(net_dst_ip), dst_ip, INET_ADDRSTRLEN);
+    /* Show algorithms and connections. */
 
-    switch (connection->state) 
+    if ((num_args = sscanf(args, "%d %15s", &conn_num, name)) != 2 && sscanf(args, "%15s", name) != 1)
     {
-        case TCP_CLOSED:
-
-            break;
-
-        case TCP_LISTEN:
-
-            if (flags->SYN_FLAG_SET) 
-            {
-                update_connection_seq_ack(connection, 0, 1);
-                send_syn_ack(connection);
-                connection->state = TCP_SYN_RECEIVED;
-            }
-            break;
-
-        case TCP_SYN_SENT:
-
-            if (flags->SYN_FLAG_SET && flags->ACK_FLAG_SET) 
-            {
-                update_connection_seq_ack(connection, 0, ntohl(tcp_header->seq_number) + 1);
-                send_ack(connection);
-                establish_conn_and_print(connection, dst_ip);
-            } 
-            break;
-
-        case TCP_SYN_RECEIVED:
-
-            if (flags->FIN_FLAG_SET)
-            {
-                dest_closes_connection(connection);          
-            }
-            else if (flags->ACK_FLAG_SET) 
-            {
-                establish_conn_and_print(connection, dst_ip);
-            } 
-            break;
+        printf("\nCongestion control (new connections): %s\n", TCP_CONGESTION_ALGORITHMS[TCP_CC_DEFAULT].name);
+        printf("Available:");
 
-        case TCP_ESTABLISHED:
-            
-            if (flags->FIN_FLAG_SET)
-            {
-                dest_closes_connection(connection);          
-            }
-            else if (tcp_payload_len > 0)
-            {
-                /* Receive and acknowledge TCP segments containing data. */
-                display_tcp_data(tcp_header, tcp_payload_len, connection);
-                update_connection_seq_ack(connection, 0, tcp_payload_len);
-                send_ack(connection);
-            }
-            break;
+        for (int i = 0; i < NUM_CONGESTION_ALGORITHMS; i++)
+        {
+            printf(" %s", TCP_CONGESTION_ALGORITHMS[i].name);
+        }
 
-        case TCP_FIN_WAIT_1:
+        printf("\n");
 
-            if (flags->ACK_FLAG_SET)
+        for (curr = TCP_CONNECTIONS_LIST == NULL ? NULL : TCP_CONNECTIONS_LIST->head; curr != NULL; curr = curr->next)
+        {
+            if (curr->state == TCP_ESTABLISHED)
             {
-                connection->state = TCP_FIN_WAIT_2;
+                printf("    %d. Dst Port: %d %s cwnd: %u ssthresh: %u\n", curr_conn++, curr->dst_port, 
+                       curr->cc_ops->name, curr->cwnd, curr->ssthresh);
             }
-            break;
-
-        case TCP_FIN_WAIT_2:
+        }
 
-            if (flags->FIN_FLAG_SET)
-            {
-                update_connection_seq_ack(connection, 1, 1);
-                send_ack(connection);
-                connection->state = TCP_CLOSING;
-            }
-            break;
+        printf("\n");
+        return 0;
+    }
 
-        case TCP_CLOSE_WAIT:
+    if ((ops = find_congestion_control(name)) == NULL)
+    {
+        printf("\nUnknown congestion control %s. Use /CC to see the available ones.\n\n", name);
+        return -1;
+    }
 
-            /* Not implemented. */
-            break;
-        
-        case TCP_CLOSING:
+    /* Set the default for new connections. */
 
-            if (flags->ACK_FLAG_SET)
-            {
-                remove_conn_and_print(connection, dst_ip);
-            }
-            break;
+    if (num_args != 2)
+    {
+        TCP_CC_DEFAULT = ops - TCP_CONGESTION_ALGORITHMS;
+        printf("\nNew connections will use %s. \n\n", ops->name);
+        return 1;
+    }
 
-        case TCP_LAST_ACK:
+    /* Switch an established connection. */
 
-            if (flags->ACK_FLAG_SET) 
-            {
-                remove_conn_and_print(connection, dst_ip);
-            } 
+    for (curr = TCP_CONNECTIONS_LIST == NULL ? NULL : TCP_CONNECTIONS_LIST->head; curr != NULL; curr = curr->next)
+    {
+        if (curr->state == TCP_ESTABLISHED && curr_conn++ == conn_num)
+        {
+            set_congestion_control(curr, ops);
+            printf("\nConnection %d now uses %s. \n\n", conn_num, ops->name);
+            return 1;
+        }
+    }
 
-            break; 
+    printf("Connection %d is not established or does not exist. \n\n", conn_num);
 
-        case TCP_TIME_WAIT:
-        
-            /* Not implemented. */
-            break; 
-    }
+    return 0;
 }
 
-/* Set connection as established and current, and print diagnostic information. */
+/* Start writing cwnd/ssthresh changes to a file (as CSV), or stop if path is 
+   OFF. Any previous trace file is closed. */
 
-void 
-establish_conn_and_print(TCP_Connection *connection, char *dst_ip)
+int
+trace_congestion_to(char *path)
 {
-    connection->state  = TCP_ESTABLISHED;    
-    CURRENT_CONNECTION = connection; 
-    printf("\n    NOTIFICATION: a connection has been established from %s on port %d.\n", dst_ip, connection->dst_port);
-    printf("    Use /SHOWALL to view current connections. \n\n");
-    fflush(stdout);
-} 
+    if (TCP_CC_TRACE != NULL)
+    {
+        fclose(TCP_CC_TRACE);
+        TCP_CC_TRACE = NULL;
+    }
 
-/* Remove connection and print diagnostic information. */
+    if (path[0] == '\0' || strcmp(path, "OFF") == 0)
+    {
+        printf("\nCongestion control tracing is off. \n\n");
+        return 0;
+    }
 
-void 
-remove_conn_and_print(TCP_Connection *connection, char *dst_ip)
-{
-    remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
-    printf("\n    NOTIFICATION: a connection has been closed from %s on port %d.\n", dst_ip, connection->dst_port);
-    printf("    Use /SHOWALL to view current connections. \n\n");
-    fflush(stdout);
-} 
+    if ((TCP_CC_TRACE = fopen(path, "w")) == NULL)
+    {
+        perror("fopen");
+        return -1;
+    }
 
-/* Destination sends a fin-ack and closes the connection. Send an ACK and a FIN-ACK. */
+    fprintf(TCP_CC_TRACE, "ms,dst_ip,dst_port,algorithm,event,cwnd,ssthresh,flight\n");
+    printf("\nTracing congestion control to %s. \n\n", path);
 
-void 
-dest_closes_connection(TCP_Connection *connection)
-{
-    update_connection_seq_ack(connection, 0, 1);
-    send_ack(connection);
-    send_fin_ack(connection);
-    connection->state = TCP_LAST_ACK;
+    return 1;
 }
 
-/* Update a TCP connection's sequence and ack numbers. */
+/* Set or show a send coalescing option (TCP_NAGLE_OFF or TCP_NAGLE_CORK) of the 
+   current connection. args is " ON" or " OFF", or empty to show it. */
 
-void
-update_connection_seq_ack(TCP_Connection *connection, uint32_t seq_num_increment, uint32_t ack_num_increment)
+int
+change_send_coalescing(char *args, uint8_t option)
 {
-    connection->seq_number += seq_num_increment;
-    connection->ack_number += ack_num_increment; 
-}
+    const char *name = option == TCP_NAGLE_OFF ? "NODELAY" : "CORK";
+    char        value[4] = "";
 
-/* Display/print received data from a TCP connection. */
-
-void 
-display_tcp_data(TCP_Header *tcp_header, ssize_t payload_len, TCP_Connection *connection)
-{
-    uint8_t  payload_str[payload_len + 1]; 
-    uint8_t *payload     = (uint8_t *)tcp_header + sizeof(TCP_Header);
-    uint32_t net_dst_ip  =  htonl(connection->dst_ip); 
-    char     dst_ip[INET_ADDRSTRLEN]; 
+    if (CURRENT_SOCKET == NULL || CURRENT_SOCKET->connection == NULL)
+    {
+        printf("No connection to set %s on. \n\n", name);
+        return -1;
+    }
 
-    if (payload_len > 0)
-    {        
-        /* Insert null byte. */
+    sscanf(args, "%3s", value);
 
-        memcpy(payload_str, payload, payload_len);
-        payload_str[payload_len] = '\0'; 
+    if (strcmp(value, "ON") == 0 || strcmp(value, "OFF") == 0)
+    {
+        if (option == TCP_NAGLE_OFF)
+        {
+            tcp_set_nodelay(CURRENT_SOCKET->connection, value[1] == 'N');
+        }
+        else
+        {
+            tcp_set_cork(CURRENT_SOCKET->connection, value[1] == 'N');
+        }
+    }
+    else if (value[0] != '\0')
+    {
+        printf("\nUse /%s ON or /%s OFF. \n\n", name, name);
+        return -1;
+    }
 
-        /* Convert IP to 0.0.0.0. format and print. */
+    printf("\n%s is %s on the current connection. \n\n", name, (CURRENT_SOCKET->connection->nagle & option) ? "ON" : "OFF");
 
-        inet_ntop(AF_INET, &(net_dst_ip), dst_ip, INET_ADDRSTRLEN);
-        printf("\n(%s port %d): %s \n", dst_ip, connection->dst_port, payload_str);
-    }
+    return 1;
 }
 
-/*
-    CONSTRUCTING AND SENDING FUNCTIONS
-*/
-
-/* Construct an IP packet with a TCP segment. */
+/* Show every listener in port order, with its queues and counters. */
 
-uint8_t *
-construct_tcp_packet(TCP_Connection *connection, TCP_Flags *flags, uint16_t id, void *payload, ssize_t payload_len)
+void
+show_listeners()
 {
-    ssize_t        tcp_segment_len = sizeof(TCP_Header) + payload_len;
-    TCP_Header    *tcp_segment;
-    IP_Header     *ip_packet;
-    uint8_t       *tcp_packet;
-    const uint8_t *mac_src, *mac_dst;
-    uint16_t       data_offset, offset_reserved_control, checksum;
+    TCP_Socket *listener;
+    uint32_t    net_ip;
+    char        ip[INET_ADDRSTRLEN];
 
-    /* Malloc space for segment. */
+    printf("\nListening on (%u listeners):\n", TCP_SOCKETS.num_listeners);
 
-    if ((tcp_segment = malloc(tcp_segment_len)) == NULL)
+    for (listener = next_tcp_listener(NULL); listener != NULL; listener = next_tcp_listener(listener))
     {
-        return NULL;
+        net_ip = htonl(listener->src_ip);
+        inet_ntop(AF_INET, &net_ip, ip, INET_ADDRSTRLEN);
+
+        printf("    %s:%d accept %u/%u syn %u/%u queued %llu cookies %llu/%llu established %llu overflows %llu fastopen %s %llu\n",
+               ip, listener->src_port, listener->queued, listener->backlog, listener->syn_queued, listener->syn_backlog,
+               (unsigned long long)listener->stats.syns_queued, (unsigned long long)listener->stats.cookies_sent,
+               (unsigned long long)listener->stats.cookies_accepted, (unsigned long long)listener->stats.established,
+               (unsigned long long)listener->stats.overflows, listener->fastopen ? "on" : "off", 
+               (unsigned long long)listener->stats.fastopen);
     }
 
-    /* Set TCP fields. */
+    printf("\n");
+}
 
-    tcp_segment->src_port       = htons(connection->src_port);
-    tcp_segment->dst_port       = htons(connection->dst_port);
-    tcp_segment->seq_number     = htonl(connection->seq_number);
-    tcp_segment->ack_number     = htonl(connection->ack_number);
-    tcp_segment->window_size    = htons(connection->window_size); 
-    tcp_segment->checksum       = 0;
-    tcp_segment->urgent_pointer = 0;
+/* Listen on a port for the command line, or stop listening, from "4000" for
+   every interface or "0.0.0.0 4000" for one. Connections already made on the
+   port are kept when it stops. */
 
-    /* Set Data Offset and Control Bits. */
+int
+change_listener(char *args, int on)
+{
+    TCP_Socket *listener;
+    uint32_t    ip = TCP_ANY_IP, net_ip;
+    uint16_t    port;
+    char        ip_str[INET_ADDRSTRLEN], port_str[6];
+    int         port_conv;
 
-    data_offset                 = sizeof(TCP_Header) / 4;
-    offset_reserved_control     = data_offset << 12;
-    
-    if (flags->FIN_FLAG_SET) 
-    {
-        offset_reserved_control |= TCP_FIN;
-    }
-    if (flags->SYN_FLAG_SET) 
-    {
-        offset_reserved_control |= TCP_SYN;
-    }
-    if (flags->RST_FLAG_SET) 
-    {
-        offset_reserved_control |= TCP_RST;
-    }
-    if (flags->PSH_FLAG_SET) 
+    /* Parse the IP, if there is one, and port. */
+
+    if (sscanf(args, "%15s %5s", ip_str, port_str) == 2)
     {
-        offset_reserved_control |= TCP_PSH;
+        if (extract_ip_and_port(args, &ip, &port) == -1)
+        {
+            return -1;
+        }
     }
-    if (flags->ACK_FLAG_SET) 
+    else if ((port_conv = atoi(args)) <= 0 || port_conv > MAX_VALID_PORT)
     {
-        offset_reserved_control |= TCP_ACK;
+        printf("\nInvalid port number.\n\n");
+        return -1;
     }
-    if (flags->URG_FLAG_SET) 
+    else
     {
-        offset_reserved_control |= TCP_URG;
+        port = (uint16_t)port_conv;
     }
 
-    tcp_segment->offset_reserved_control = htons(offset_reserved_control);
+    net_ip = htonl(ip);
+    inet_ntop(AF_INET, &net_ip, ip_str, INET_ADDRSTRLEN);
 
-    /* Memcopy payload after header and get checksum. */
+    /* Listen. */
 
-    if (payload_len > 0)
+    if (on)
     {
-        memcpy(tcp_segment + 1, payload, payload_len);
-    }
-
-    checksum              = calculate_tcp_checksum(tcp_segment, payload, payload_len, connection->src_ip, connection->dst_ip);
-    tcp_segment->checksum = checksum;
-
-    /* Construct IP packet.*/
-
-    ip_packet             = construct_ip_packet(connection->src_ip, connection->dst_ip, id, TCP_PROTOCOL, DEFAULT_TTL, tcp_segment, tcp_segment_len);
+        if ((listener = tcp_socket_listen(ip, port, TCP_SOCKET_DEFAULT_BACKLOG, accept_cli_connections, NULL)) == NULL)
+        {
+            printf("\n");
+            return -1;
+        }
 
-    /* Construct Ethernet Frame. */
+        tcp_socket_set_fastopen(listener, 1);
 
-    mac_src               = ROUTER_INTERFACES[0].mac_address;
-    mac_dst               = find_arp_mac_address(connection->dst_ip);
+        printf("\nListening on %s:%d. \n\n", ip_str, port);
+        return 1;
+    }
 
-    /* ARP translation failed: no ARP for given IP address.  s*/
+    /* Stop listening. Only listeners of the command line are closed here. */
 
-    if (mac_dst == NULL)
+    if ((listener = find_bound_tcp_listener(ip, port)) == NULL || listener->callback != accept_cli_connections)
     {
-        free(tcp_segment);
-        free(ip_packet);
-        return NULL;         
+        printf("\nNot listening on %s:%d. \n\n", ip_str, port);
+        return -1;
     }
 
-    tcp_packet            = construct_ethernet_frame(mac_src, mac_dst, IP_TYPE, ip_packet, tcp_segment_len + sizeof(IP_Header));
+    tcp_socket_close(listener);
+    printf("\nStopped listening on %s:%d. \n\n", ip_str, port);
 
-    return tcp_packet;     
+    return 1;
 }
 
-/* Construct and send a TCP packet (through interface R0_0). */
+/* Listen on every port of LISTENING_PORTS, on every interface, for the command
+   line, taking Fast Open: what the command line does with data is print it, 
+   which is safe to repeat if a SYN is replayed. More can be added and removed
+   with /LISTEN and /UNLISTEN. Returns -1 if a port cannot be listened on. */
 
 int
-construct_and_send_tcp_packet(TCP_Flags *flags, TCP_Connection *connection, void *payload, ssize_t payload_len)
+listen_on_ports()
 {
-    uint8_t *tcp_packet; 
-
-    tcp_packet = construct_tcp_packet(connection, flags, 12345, payload, payload_len);
-
-    /* Send packet ONLY if no errors occur (malloc or ARP fails). */
+    TCP_Socket *listener;
 
-    if (tcp_packet == NULL)
-    {
-        return -1;
-    }
-    else 
+    for (int i = 0; i < NUM_LISTENING_PORTS; i++)
     {
-        send_ethernet_frame(ROUTER_INTERFACES[0].fds[1], tcp_packet, MIN_TCP_PACKET_LEN + payload_len);
+        if ((listener = tcp_socket_listen(TCP_ANY_IP, LISTENING_PORTS[i], TCP_SOCKET_DEFAULT_BACKLOG, accept_cli_connections, NULL)) == NULL)
+        {
+            return -1;
+        }
+
+        tcp_socket_set_fastopen(listener, 1);
     }
 
-    free(tcp_packet);
-    return 0;
+    return 1;
 }
 
-/* Send a SYN packet. */
+/* Accept every connection waiting on a listening port, and send to the newest. */
 
-int 
+void
+accept_cli_connections(TCP_Socket *listener, uint8_t events, void *arg)
+{
+    TCP_Socket *socket;
+
+    while ((socket = tcp_socket_accept(listener, handle_cli_socket, NULL)) != NULL)
+    {
+        CURRENT_SOCKET = socket;
+        print_connection_notification(socket, "established");
+    }
+}
+
+/* Handle the events of a connection of the command line: print what it 
+   receives, and close our side once the peer closes its own. */
+
+void
+handle_cli_socket(TCP_Socket *socket, uint8_t events, void *arg)
+{
+    TCP_Recv_Chunk *chunk;
+    ssize_t         len;
+
+    if (events & TCP_SOCKET_CONNECTED)
+    {
+        CURRENT_SOCKET = socket;
+        print_connection_notification(socket, "established");
+    }
+
+    if (events & TCP_SOCKET_READABLE)
+    {
+        while ((len = tcp_socket_recv_chunk(socket, &chunk)) > 0)
+        {
+            display_tcp_data(socket, chunk->data, len);
+            tcp_socket_release(socket, chunk);
+        }
+
+        fflush(stdout);
+    }
+
+    if (events & TCP_SOCKET_HUP)
+    {
+        print_connection_notification(socket, "closed");
+        close_cli_socket(socket);
+    }
+    else if (events & TCP_SOCKET_CLOSED)
+    {
+        close_cli_socket(socket);
+    }
+}
+
+/* Close a socket of the command line, and send to another connection if it 
+   was the current one. */
+
+void
+close_cli_socket(TCP_Socket *socket)
+{
+    tcp_socket_close(socket);
+
+    if (CURRENT_SOCKET == socket)
+    {
+        reset_selected_connection();
+    }
+}
+
+/* Returns the socket of a connection if the command line owns it, or NULL. */
+
+TCP_Socket *
+cli_socket(TCP_Connection *connection)
+{
+    if (connection->socket == NULL || connection->socket->callback != handle_cli_socket)
+    {
+        return NULL;
+    }
+
+    return connection->socket;
+}
+
+/* Print that a connection has been established or closed. */
+
+void
+print_connection_notification(TCP_Socket *socket, const char *event)
+{
+    uint32_t net_dst_ip = htonl(socket->dst_ip);
+    char     dst_ip[INET_ADDRSTRLEN]; 
+
+    inet_ntop(AF_INET, &net_dst_ip, dst_ip, INET_ADDRSTRLEN);
+    printf("\n    NOTIFICATION: a connection has been %s from %s on port %d.\n", event, dst_ip, socket->dst_port);
+    printf("    Use /SHOWALL to view current connections. \n\n");
+    fflush(stdout);
+}
+
+/* Display/print received data from a TCP connection, straight from where it
+   was received. */
+
+void 
+display_tcp_data(TCP_Socket *socket, const uint8_t *payload, ssize_t payload_len)
+{
+    uint32_t net_dst_ip  =  htonl(socket->dst_ip); 
+    char     dst_ip[INET_ADDRSTRLEN]; 
+
+    if (payload_len > 0)
+    {        
+        /* Convert IP to 0.0.0.0. format and print. */
+
+        inet_ntop(AF_INET, &(net_dst_ip), dst_ip, INET_ADDRSTRLEN);
+        printf("\n(%s port %d): %.*s \n", dst_ip, socket->dst_port, (int)payload_len, (const char *)payload);
+    }
+}
+
+/* 
+    STATE MACHINE FUNCTIONS
+*/
+
+void 
+handle_tcp_connection(TCP_Header *tcp_header, TCP_Flags flags, TCP_Connection *connection, 
+                      const TCP_Options *options, const TCP_GRO_Run *run)
+{
+    uint32_t seq             = ntohl(tcp_header->seq_number);
+    uint32_t tcp_payload_len = run->len;
+    uint32_t ack, acked, window;
+    int      dup;
+
+    /* Drop segments with an old timestamp (PAWS). A reset is never dropped. */
+
+    if (!(flags & TCP_RST) && !check_tcp_timestamps(connection, seq, options))
+    {
+        return;
+    }
+
+    /* Take acknowledged segments off the retransmission queue, take the peer's
+       window, and let congestion control see the ACK. A duplicate ACK carries
+       no data or window change and acknowledges nothing new while data is 
+       outstanding (RFC 5681 2). */
+
+    if ((flags & TCP_ACK) && connection->state != TCP_LISTEN)
+    {
+        ack    = ntohl(tcp_header->ack_number);
+        window = ntohs(tcp_header->window_size) << ((flags & TCP_SYN) ? 0 : connection->snd_wscale);
+        acked  = process_tcp_ack(connection, ack);
+        dup    = acked == 0 && ack == connection->snd_una && connection->snd_una != connection->seq_number &&
+                 tcp_payload_len == 0 && !(flags & (TCP_SYN | TCP_FIN)) && window == connection->snd_wnd;
+
+        /* With timestamps, every ACK of new data is an RTT sample (RFC 7323 4). */
+
+        if (acked > 0 && (connection->opt_flags & options->present & TCP_OPT_TIMESTAMPS) && options->ts_ecr != 0)
+        {
+            update_tcp_rto(connection, (uint32_t)timer_wheel_clock(&TIMER_WHEEL) - options->ts_ecr);
+        }
+
+        process_sack_blocks(connection, options);
+        update_send_window(connection, seq, ack, window);
+
+        /* Acknowledged data makes room in the send buffer. */
+
+        if (acked > 0)
+        {
+            tcp_socket_notify(connection, TCP_SOCKET_WRITABLE);
+        }
+
+        if (connection->state != TCP_SYN_SENT && connection->state != TCP_SYN_RECEIVED)
+        {
+            tcp_congestion_ack(connection, ack, acked, dup);
+        }
+    }
+
+    switch (connection->state) 
+    {
+        case TCP_CLOSED:
+
+            break;
+
+        case TCP_LISTEN:
+
+            if (flags & TCP_SYN) 
+            {
+                tcp_syn_options(connection, options);
+                update_connection_seq_ack(connection, 0, 1);
+
+                if (connection->fastopen && tcp_payload_len > 0 && valid_fastopen_cookie(connection, options))
+                {
+                    accept_fastopen_data(connection, tcp_header, run->buffers[0], run->payloads[0], tcp_payload_len);
+                    break;
+                }
+
+                send_syn_ack(connection);
+                connection->state = TCP_SYN_RECEIVED;
+            }
+            break;
+
+        case TCP_SYN_SENT:
+
+            /* The SYN-ACK must acknowledge our SYN, but may leave data queued 
+               behind it, or sent with it, unacknowledged. */
+
+            if ((flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK) && 
+                (connection->rtx_head == NULL || !(connection->rtx_head->flags & TCP_SYN))) 
+            {
+                tcp_syn_options(connection, options);
+                update_connection_seq_ack(connection, 0, seq + 1);
+                send_ack(connection);
+                establish_tcp_connection(connection);
+
+                /* Fast Open data the server did not take goes again at once 
+                   (RFC 7413 4.2.2), and its cookie is kept for next time. */
+
+                if (connection->fastopen)
+                {
+                    cache_fastopen_cookie(connection->dst_ip, options);
+
+                    if (connection->rtx_head != NULL)
+                    {
+                        retransmit_tcp_segment(connection);
+                    }
+                }
+            } 
+            break;
+
+        case TCP_SYN_RECEIVED:
+
+            if (flags & TCP_FIN)
+            {
+                dest_closes_connection(connection);          
+            }
+            else if ((flags & TCP_ACK) && tcp_all_acked(connection)) 
+            {
+                establish_tcp_connection(connection);
+            } 
+            break;
+
+        case TCP_ESTABLISHED:
+            
+            /* Receive data in order, and close once the peer's FIN is next. */
+
+            if (tcp_receive(connection, seq, run, flags))
+            {
+                dest_closes_connection(connection);          
+            }
+            break;
+
+        case TCP_FIN_WAIT_1:
+
+            /* Our FIN is acknowledged once nothing is left to acknowledge. The
+               peer's FIN may come with that ACK, or before it. The peer may 
+               still send data until its FIN. */
+
+            if (tcp_receive(connection, seq, run, flags))
+            {
+                update_connection_seq_ack(connection, 0, 1);
+                send_ack(connection);
+
+                if (tcp_all_acked(connection))
+                {
+                    enter_time_wait(connection);
+                    return;
+                }
+
+                connection->state = TCP_CLOSING;
+            }
+            else if (tcp_all_acked(connection))
+            {
+                /* The application has closed, so wait only so long for the 
+                   peer's FIN. */
+
+                connection->state = TCP_FIN_WAIT_2;
+                arm_timer(&TIMER_WHEEL, &connection->timer, TCP_FIN_WAIT_2_TIMEOUT * 1000);
+            }
+            break;
+
+        case TCP_FIN_WAIT_2:
+
+            if (tcp_receive(connection, seq, run, flags))
+            {
+                update_connection_seq_ack(connection, 0, 1);
+                send_ack(connection);
+                enter_time_wait(connection);
+                return;
+            }
+            break;
+
+        case TCP_CLOSE_WAIT:
+
+            /* The peer's FIN was acknowledged and the application has yet to 
+               close. Acknowledge the FIN again if it is resent. */
+
+            if (flags & TCP_FIN)
+            {
+                send_ack(connection);
+            }
+            break;
+        
+        case TCP_CLOSING:
+
+            if (tcp_all_acked(connection))
+            {
+                enter_time_wait(connection);
+                return;
+            }
+            break;
+
+        case TCP_LAST_ACK:
+
+            if (tcp_all_acked(connection)) 
+            {
+                remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+                return;
+            } 
+
+            break; 
+
+        case TCP_TIME_WAIT:
+        
+            /* Not reached: a connection gives way to a bucket as it enters 
+               TIME_WAIT, and handle_tw_segment() takes its segments. */
+
+            break; 
+    }
+
+    /* Send what the acknowledgements and window now allow. */
+
+    tcp_output(connection);
+}
+
+/* Set connection as established, and hand it to its socket, or to the listener 
+   of its port to be accepted. If there is no room to queue it, close it. */
+
+void 
+establish_tcp_connection(TCP_Connection *connection)
+{
+    cancel_timer(&TIMER_WHEEL, &connection->timer);
+    tcp_socket_unqueue_syn(connection);
+    connection->state = TCP_ESTABLISHED;    
+
+    if (tcp_socket_established(connection) == -1)
+    {
+        printf("Closing TCP connection. Nothing to accept it on port %d.\n", connection->src_port);
+        send_fin_ack(connection);
+        connection->state = TCP_FIN_WAIT_1;
+    }
+} 
+
+/* Enter TIME_WAIT after closing our side. The connection gives way to a 
+   bucket that waits twice the maximum segment lifetime, so a resent FIN is 
+   still acknowledged and its 4-tuple is not reused while old segments may be 
+   in flight. The connection is freed. */
+
+void
+enter_time_wait(TCP_Connection *connection)
+{
+    uint32_t ts_recent = (connection->opt_flags & TCP_OPT_TIMESTAMPS) ? connection->ts_recent : 0;
+
+    if (add_tw_bucket(connection->src_ip, connection->dst_ip, connection->src_port, connection->dst_port,
+                      connection->seq_number, connection->ack_number, ts_recent) == NULL)
+    {
+        TCP_CONNECTIONS_LIST->tw.overflows++;
+    }
+
+    connection->state = TCP_TIME_WAIT;
+    remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+}
+
+/* A connection's timer fired: either the handshake did not complete in time,
+   or the peer never closed its side after we closed ours. Remove the 
+   connection. */
+
+void
+tcp_connection_timeout(Timer *timer, void *arg)
+{
+    TCP_Connection *connection = arg;
+    uint32_t        net_dst_ip = htonl(connection->dst_ip);
+    char            dst_ip[INET_ADDRSTRLEN]; 
+
+    if (connection->state != TCP_FIN_WAIT_2)
+    {
+        inet_ntop(AF_INET, &net_dst_ip, dst_ip, INET_ADDRSTRLEN);
+        printf("\n    NOTIFICATION: a connection with %s on port %d was not established in time.\n\n", dst_ip, connection->dst_port);
+        fflush(stdout);
+    }
+
+    remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+}
+
+/* Destination sends a fin-ack and closes the connection. Send an ACK, then wait in
+   CLOSE_WAIT for the application to close its socket. Without a socket, send a 
+   FIN-ACK at once. */
+
+void 
+dest_closes_connection(TCP_Connection *connection)
+{
+    update_connection_seq_ack(connection, 0, 1);
+    send_ack(connection);
+
+    if (connection->socket != NULL)
+    {
+        connection->state = TCP_CLOSE_WAIT;
+        tcp_socket_notify(connection, TCP_SOCKET_HUP);
+        return;
+    }
+
+    send_fin_ack(connection);
+    connection->state = TCP_LAST_ACK;
+}
+
+/* Update a TCP connection's sequence and ack numbers. */
+
+void
+update_connection_seq_ack(TCP_Connection *connection, uint32_t seq_num_increment, uint32_t ack_num_increment)
+{
+    connection->seq_number += seq_num_increment;
+    connection->ack_number += ack_num_increment; 
+}
+
+/*
+    CONSTRUCTING AND SENDING FUNCTIONS
+*/
+
+/* Send len bytes of the send buffer from seq as MSS-sized segments, in software
+   (segmentation offload). The headers are built once, and only the sequence 
+   number, flags, lengths, IP id and checksums are patched for each segment. 
+   flags are those of the last segment; SYN, FIN and PSH are left off the 
+   others. A segment without data (an ACK, SYN or FIN) has len 0. The frames go
+   out TCP_TSO_MAX_SEGMENTS at a time as one burst, which holds the interface's
+   write lock until it is all written, so in threaded modes it cannot 
+   interleave with the frames workers send on the same interface. Returns -1 
+   if the peer has no ARP entry. */
+
+int
+tcp_transmit(TCP_Connection *connection, uint32_t seq, uint32_t len, TCP_Flags flags)
+{
+    TCP_TSO_Batch *batch = TCP_CONNECTIONS_LIST->tso;
+    uint8_t        header[TCP_TSO_HEADER_LEN];
+    const uint8_t *mac_dst;
+    uint16_t       header_len, seg_len;
+    uint32_t       sum;
+    TCP_Flags      seg_flags;
+    int            num_frames = 0;
+
+    /* ARP translation failed: no ARP for given IP address. */
+
+    if ((mac_dst = find_arp_mac_address(connection->dst_ip)) == NULL)
+    {
+        return -1;
+    }
+
+    header_len = build_tcp_template(connection, flags, len < connection->mss ? len : connection->mss, mac_dst, header, &sum);
+
+    do
+    {
+        seg_len   = len < connection->mss ? len : connection->mss;
+        seg_flags = seg_len == len ? flags : flags & ~(TCP_SYN | TCP_FIN | TCP_PSH);
+
+        batch->frame_lens[num_frames] = build_tcp_frame(connection, header, header_len, sum, seq, seg_flags, seg_len, 
+                                                        batch->frames[num_frames]);
+        batch->frame_ptrs[num_frames] = batch->frames[num_frames];
+        seq                          += seg_len;
+        len                          -= seg_len;
+
+        if (++num_frames == TCP_TSO_MAX_SEGMENTS || len == 0)
+        {
+            send_ethernet_burst(ROUTER_INTERFACES[0].fds[1], batch->frame_ptrs, batch->frame_lens, num_frames);
+            num_frames = 0;
+        }
+    } while (len > 0);
+
+    /* Every segment carries the ACK, so nothing is left to delay. */
+
+    connection->ack_sent = connection->ack_number;
+
+    if (connection->ack_pending > 0)
+    {
+        connection->ack_pending = 0;
+        cancel_timer(&TIMER_WHEEL, &connection->ack_timer);
+    }
+
+    return 0;
+}
+
+/* Build the Ethernet, IP and TCP headers (with options) shared by the segments 
+   of a burst into header, and return their length. The sequence number, flags,
+   lengths and checksums are left 0 for build_tcp_frame. sum is set to the 
+   partial TCP checksum of the pseudo-header and the fixed header fields. 
+   max_payload is the largest payload the options must leave room for. */
+
+uint16_t
+build_tcp_template(TCP_Connection *connection, TCP_Flags flags, uint32_t max_payload, const uint8_t *mac_dst, 
+                   uint8_t *header, uint32_t *sum)
+{
+    Ethernet_Header  *ethernet_hdr = (Ethernet_Header *)header;
+    IP_Header        *ip_packet    = (IP_Header *)(ethernet_hdr + 1);
+    TCP_Header       *tcp_segment  = (TCP_Header *)(ip_packet + 1);
+    TCP_Pseudoheader  pseudo_header;
+    uint8_t           options_len, wscale;
+    uint32_t          window;
+
+    /* Set Ethernet fields. */
+
+    ethernet_hdr->type = htons(IP_TYPE);
+
+    memcpy(ethernet_hdr->source, ROUTER_INTERFACES[0].mac_address, 6);
+    memcpy(ethernet_hdr->destination, mac_dst, 6);
+
+    /* Set IP fields. */
+
+    ip_packet->version_and_IHL  = 0x45;
+    ip_packet->service_type     = 0x00;
+    ip_packet->total_length     = 0;
+    ip_packet->id               = 0;
+    ip_packet->flags_and_offset = 0;
+    ip_packet->ttl              = DEFAULT_TTL;
+    ip_packet->protocol         = TCP_PROTOCOL;
+    ip_packet->checksum         = 0;
+    ip_packet->source           = htonl(connection->src_ip);
+    ip_packet->destination      = htonl(connection->dst_ip);
+
+    /* Set TCP fields. Options go where they fit beside the payload. */
+
+    options_len = build_tcp_options(connection, flags, (uint8_t *)(tcp_segment + 1), 
+                                    TCP_MAX_MSS - max_payload < TCP_MAX_OPTIONS_LEN ? TCP_MAX_MSS - max_payload : TCP_MAX_OPTIONS_LEN);
+
+    tcp_segment->src_port                = htons(connection->src_port);
+    tcp_segment->dst_port                = htons(connection->dst_port);
+    tcp_segment->seq_number              = 0;
+    tcp_segment->ack_number              = htonl(connection->ack_number);
+    tcp_segment->offset_reserved_control = htons(((sizeof(TCP_Header) + options_len) / 4) << 12);
+    tcp_segment->checksum                = 0;
+    tcp_segment->urgent_pointer          = 0;
+
+    /* The window of a SYN is never scaled (RFC 7323 2.2). */
+
+    wscale                               = (flags & TCP_SYN) ? 0 : connection->rcv_wscale;
+    window                               = tcp_socket_window(connection) >> wscale;
+    tcp_segment->window_size             = htons(window > UINT16_MAX ? UINT16_MAX : window);
+
+    /* Sum the pseudo-header without its length, and the header with its data 
+       offset but no flags. */
+
+    pseudo_header.src_address = ip_packet->source;
+    pseudo_header.dst_address = ip_packet->destination;
+    pseudo_header.zero        = 0;
+    pseudo_header.protocol    = TCP_PROTOCOL;
+    pseudo_header.tcp_length  = 0;
+
+    *sum = RFC1071_sum(&pseudo_header, sizeof(TCP_Pseudoheader), 0);
+    *sum = RFC1071_sum(tcp_segment, sizeof(TCP_Header) + options_len, *sum);
+
+    return sizeof(Ethernet_Header) + sizeof(IP_Header) + sizeof(TCP_Header) + options_len;
+}
+
+/* Build one segment of a burst into frame from the headers of build_tcp_template
+   and payload_len bytes of the send buffer at seq. Returns the frame length, 
+   which includes any padding and the FCS. */
+
+uint16_t
+build_tcp_frame(TCP_Connection *connection, const uint8_t *header, uint16_t header_len, uint32_t sum, 
+                uint32_t seq, TCP_Flags flags, uint16_t payload_len, uint8_t *frame)
+{
+    IP_Header  *ip_packet   = (IP_Header *)(frame + sizeof(Ethernet_Header));
+    TCP_Header *tcp_segment = (TCP_Header *)(ip_packet + 1);
+    uint16_t    ip_len      = header_len - sizeof(Ethernet_Header) + payload_len;
+    uint16_t    frame_len   = sizeof(Ethernet_Header) + ip_len;
+    uint16_t    tcp_len     = ip_len - sizeof(IP_Header);
+    uint16_t    orc;
+    uint32_t    fcs;
+
+    memcpy(frame, header, header_len);
+
+    /* The data of a SYN follows the sequence number the SYN takes. */
+
+    if (payload_len > 0)
+    {
+        read_send_buffer(connection, (flags & TCP_SYN) ? seq + 1 : seq, frame + header_len, payload_len);
+    }
+
+    /* Patch the IP header. */
+
+    ip_packet->total_length = htons(ip_len);
+    ip_packet->id           = htons(TCP_CONNECTIONS_LIST->ip_id++);
+    ip_packet->checksum     = RFC1071_checksum(ip_packet, sizeof(IP_Header));
+
+    /* Patch the TCP header, and add what was patched to the checksum. */
+
+    orc                                  = ntohs(tcp_segment->offset_reserved_control) | flags;
+    tcp_segment->seq_number              = htonl(seq);
+    tcp_segment->offset_reserved_control = htons(orc);
+
+    sum                   += htons(tcp_len) + htons(flags);
+    sum                    = RFC1071_sum(&tcp_segment->seq_number, sizeof(uint32_t), sum);
+    sum                    = RFC1071_sum(frame + header_len, payload_len, sum);
+    tcp_segment->checksum  = RFC1071_fold(sum);
+
+    /* Pad short frames, and append the FCS. */
+
+    if (frame_len < ETHERNET_MIN_FRAME_LEN - ETHERNET_FCS_LEN)
+    {
+        memset(frame + frame_len, 0, ETHERNET_MIN_FRAME_LEN - ETHERNET_FCS_LEN - frame_len);
+        frame_len = ETHERNET_MIN_FRAME_LEN - ETHERNET_FCS_LEN;
+    }
+
+    fcs = crc32(0, frame, frame_len);
+    memcpy(frame + frame_len, &fcs, ETHERNET_FCS_LEN);
+
+    return frame_len + ETHERNET_FCS_LEN;
+}
+
+/* Send a SYN packet. It takes a sequence number and is kept until acknowledged.
+   With a Fast Open cookie for the peer, it carries as much of the queued data
+   as the peer's MSS takes beside the options (RFC 7413 4.2.1). */
+
+int 
 send_syn(TCP_Connection *connection)
 {
-    TCP_Flags *flags; 
+    TCP_Fastopen_Entry *entry;
+    uint32_t            len = 0;
+
+    if (connection->fastopen && (entry = find_fastopen_entry(connection->dst_ip)) != NULL)
+    {
+        connection->mss = entry->mss - TCP_MAX_OPTIONS_LEN;
+        len             = connection->snd_end - connection->seq_number - 1;
+        len             = len > connection->mss ? connection->mss : len;
+    }
+
+    return send_tcp_segment(connection, TCP_SYN, len);
+}
+
+
+/* Send a SYN-ACK packet. It takes a sequence number and is kept until acknowledged. */
+
+int 
+send_syn_ack(TCP_Connection *connection)
+{
+    return send_tcp_segment(connection, TCP_SYN | TCP_ACK, 0);
+}
+
+/* Queue a FIN-ACK packet behind the queued data. It takes a sequence number and
+   is kept until acknowledged. */
+
+int 
+send_fin_ack(TCP_Connection *connection)
+{
+    connection->fin_queued = 1;
+    tcp_output(connection);
+
+    return 0;
+}
+
+/* Send an ACK packet. */
+
+int
+send_ack(TCP_Connection *connection)
+{
+    return tcp_transmit(connection, connection->seq_number, 0, TCP_ACK);
+}
+
+/*
+    REASSEMBLY FUNCTIONS
+*/
+
+/* Receive the data and FIN of a run of segments. Each is received as if it 
+   came alone, but the run is acknowledged once: at once if any segment was 
+   old, out of order or filled a gap, and delayed if not, counting each 
+   in-order segment towards the next ACK. Returns 1 if the FIN of the last 
+   segment is the next sequence number, in which case the caller acknowledges
+   it. */
+
+int
+tcp_receive(TCP_Connection *connection, uint32_t seq, const TCP_GRO_Run *run, TCP_Flags flags)
+{
+    int ack_now = 0, in_order = 0, last;
+
+    for (int i = 0; i < run->num_segments; i++)
+    {
+        last = i == run->num_segments - 1;
+
+        switch (tcp_receive_segment(connection, seq, run->buffers[i], run->payloads[i], run->lens[i], 
+                                    last ? flags : flags & ~TCP_FIN))
+        {
+            case TCP_RECV_FIN:
+
+                return 1;
+
+            case TCP_RECV_ACK_NOW:
+
+                ack_now = 1;
+                break;
+
+            case TCP_RECV_DATA:
+
+                in_order++;
+                break;
+        }
+
+        seq += run->lens[i];
+    }
+
+    if (ack_now)
+    {
+        send_ack(connection);
+    }
+    else if (in_order > 0)
+    {
+        connection->ack_pending += in_order - 1;
+        delay_tcp_ack(connection);
+    }
+
+    return 0;
+}
+
+/* Receive the data and FIN of a segment. Data outside the receive window is 
+   trimmed. In-order data is delivered, with any held data it makes contiguous;
+   out-of-order data is held, for a duplicate ACK to tell the peer where the 
+   gap is. Returns TCP_RECV_FIN if the segment's FIN is the next sequence 
+   number, and otherwise how the segment is to be acknowledged. buffer holds 
+   the payload, or is NULL if nothing does. */
+
+int
+tcp_receive_segment(TCP_Connection *connection, uint32_t seq, Packet_Buffer *buffer, uint8_t *payload, uint32_t len, 
+                    TCP_Flags flags)
+{
+    TCP_Interval *interval;
+    uint32_t      wnd_end = connection->ack_number + tcp_socket_window(connection);
+    uint32_t      offset, first;
+    int           filled  = connection->ooo_head != NULL;
+
+    if (len == 0 && !(flags & TCP_FIN))
+    {
+        return TCP_RECV_NOTHING;
+    }
+
+    /* Trim what was already received, and what is beyond the window (along with
+       the FIN, which then is not next). A resent FIN may follow data already 
+       received. */
+
+    if (SEQ_LT(seq, connection->ack_number))
+    {
+        if (SEQ_LT(seq + len, connection->ack_number) || (seq + len == connection->ack_number && !(flags & TCP_FIN)))
+        {
+            return TCP_RECV_ACK_NOW;
+        }
+
+        payload += connection->ack_number - seq;
+        len     -= connection->ack_number - seq;
+        seq      = connection->ack_number;
+    }
+
+    if (SEQ_GT(seq + len, wnd_end))
+    {
+        if (SEQ_GEQ(seq, wnd_end))
+        {
+            return TCP_RECV_ACK_NOW;
+        }
+
+        len    = wnd_end - seq;
+        flags &= ~TCP_FIN;
+    }
+
+    /* Out of order: hold the data. A FIN after a gap is dropped, and taken 
+       when the peer sends it again. */
+
+    if (seq != connection->ack_number)
+    {
+        if (len > 0 && (connection->rcv_buf != NULL || (connection->rcv_buf = malloc(TCP_RECV_BUFFER_SIZE)) != NULL))
+        {
+            offset = seq & (TCP_RECV_BUFFER_SIZE - 1);
+            first  = len > TCP_RECV_BUFFER_SIZE - offset ? TCP_RECV_BUFFER_SIZE - offset : len;
+
+            memcpy(connection->rcv_buf + offset, payload, first);
+            memcpy(connection->rcv_buf, payload + first, len - first);
+
+            insert_ooo_interval(connection, seq, seq + len);
+            connection->ooo_last = seq;
+        }
+
+        return TCP_RECV_ACK_NOW;
+    }
+
+    /* In order: deliver it, then whatever held data now follows. */
+
+    if (len > 0)
+    {
+        tcp_socket_deliver(connection, buffer, payload, len);
+        connection->ack_number += len;
+    }
+
+    while ((interval = connection->ooo_head) != NULL && SEQ_LEQ(interval->start, connection->ack_number))
+    {
+        if (SEQ_GT(interval->end, connection->ack_number))
+        {
+            deliver_recv_buffer(connection, connection->ack_number, interval->end);
+            connection->ack_number = interval->end;
+            flags                 &= ~TCP_FIN;
+        }
+
+        connection->ooo_head = interval->next;
+        connection->ooo_count--;
+        slab_free(&TCP_CONNECTIONS_LIST->interval_cache, interval);
+    }
+
+    if (flags & TCP_FIN)
+    {
+        return TCP_RECV_FIN;
+    }
+
+    return filled ? TCP_RECV_ACK_NOW : TCP_RECV_DATA;
+}
+
+/* Acknowledge in-order data later (RFC 1122 4.2.3.2): every second segment 
+   is acknowledged at once, and the others after TCP_DELACK_TIMEOUT unless a
+   segment sent before then carries the ACK. */
+
+void
+delay_tcp_ack(TCP_Connection *connection)
+{
+    if (++connection->ack_pending >= TCP_DELACK_SEGMENTS)
+    {
+        send_ack(connection);
+    }
+    else if (!timer_pending(&connection->ack_timer))
+    {
+        arm_timer(&TIMER_WHEEL, &connection->ack_timer, TCP_DELACK_TIMEOUT);
+    }
+}
+
+/* The delayed ACK timer fired with data still unacknowledged. */
+
+void
+tcp_delack_timeout(Timer *timer, void *arg)
+{
+    TCP_Connection *connection = arg;
+
+    if (connection->ack_pending > 0)
+    {
+        send_ack(connection);
+    }
+}
+
+/* Record a range of held data, merging it with the ranges it overlaps or 
+   touches. Returns -1 if it needs a new range and TCP_MAX_OOO_INTERVALS are 
+   already held, or the interval cache cannot grow; the data is then dropped. */
+
+int
+insert_ooo_interval(TCP_Connection *connection, uint32_t start, uint32_t end)
+{
+    TCP_Interval **link = &connection->ooo_head;
+    TCP_Interval  *curr, *next;
+
+    /* Skip the ranges that end before this one starts. */
+
+    while ((curr = *link) != NULL && SEQ_LT(curr->end, start))
+    {
+        link = &curr->next;
+    }
+
+    /* Extend the range it meets, then absorb the ranges that now meet it. */
+
+    if (curr != NULL && SEQ_LEQ(curr->start, end))
+    {
+        curr->start = SEQ_LT(start, curr->start) ? start : curr->start;
+        curr->end   = SEQ_GT(end, curr->end) ? end : curr->end;
+
+        while ((next = curr->next) != NULL && SEQ_LEQ(next->start, curr->end))
+        {
+            curr->end  = SEQ_GT(next->end, curr->end) ? next->end : curr->end;
+            curr->next = next->next;
+            connection->ooo_count--;
+            slab_free(&TCP_CONNECTIONS_LIST->interval_cache, next);
+        }
+
+        return 1;
+    }
+
+    /* Otherwise insert a new range before curr. */
+
+    if (connection->ooo_count == TCP_MAX_OOO_INTERVALS || 
+        (next = slab_alloc(&TCP_CONNECTIONS_LIST->interval_cache)) == NULL)
+    {
+        return -1;
+    }
+
+    next->start = start;
+    next->end   = end;
+    next->next  = curr;
+    *link       = next;
+    connection->ooo_count++;
+
+    return 1;
+}
+
+/* Deliver held data from start to end, in at most two pieces where it wraps 
+   around the receive buffer. */
+
+void
+deliver_recv_buffer(TCP_Connection *connection, uint32_t start, uint32_t end)
+{
+    uint32_t offset = start & (TCP_RECV_BUFFER_SIZE - 1);
+    uint32_t len    = end - start;
+    uint32_t first  = len > TCP_RECV_BUFFER_SIZE - offset ? TCP_RECV_BUFFER_SIZE - offset : len;
+
+    tcp_socket_deliver(connection, NULL, connection->rcv_buf + offset, first);
+
+    if (len > first)
+    {
+        tcp_socket_deliver(connection, NULL, connection->rcv_buf, len - first);
+    }
+}
+
+/* Free every held range of a connection. */
+
+void
+free_ooo_intervals(TCP_Connection *connection)
+{
+    TCP_Interval *interval, *next;
+
+    for (interval = connection->ooo_head; interval != NULL; interval = next)
+    {
+        next = interval->next;
+        slab_free(&TCP_CONNECTIONS_LIST->interval_cache, interval);
+    }
+
+    connection->ooo_head  = NULL;
+    connection->ooo_count = 0;
+}
+
+/*
+    SEND BUFFER AND WINDOW FUNCTIONS
+*/
+
+/* Queue data on a connection's send buffer and send what the window allows. The
+   buffer is allocated on first use, so idle connections do not hold one. Returns
+   the number of bytes queued, which is less than len if the buffer fills, or -1
+   if the connection is closing or malloc fails. */
+
+ssize_t
+tcp_send(TCP_Connection *connection, const void *data, ssize_t len)
+{
+    uint32_t space, offset, first;
+
+    if (connection->fin_queued)
+    {
+        return -1;
+    }
+
+    if (connection->snd_buf == NULL && (connection->snd_buf = malloc(TCP_SEND_BUFFER_SIZE)) == NULL)
+    {
+        return -1;
+    }
+
+    /* Copy what fits, wrapping around the end of the ring. */
+
+    space  = TCP_SEND_BUFFER_SIZE - (connection->snd_end - connection->snd_una);
+    len    = len > space ? space : len;
+    offset = connection->snd_end & (TCP_SEND_BUFFER_SIZE - 1);
+    first  = len > TCP_SEND_BUFFER_SIZE - offset ? TCP_SEND_BUFFER_SIZE - offset : len;
+
+    memcpy(connection->snd_buf + offset, data, first);
+    memcpy(connection->snd_buf, (const uint8_t *)data + first, len - first);
+
+    connection->snd_end += len;
+
+    tcp_output(connection);
+
+    return len;
+}
+
+/* Send queued data, then a queued FIN, in segments of up to one MSS while the 
+   data in flight stays within min(cwnd, snd_wnd). If the peer's window is zero
+   and nothing is in flight, one byte is sent anyway as a window probe; the 
+   retransmission timer resends it until the window opens. The segments are 
+   queued one by one and sent together by tcp_transmit. */
+
+void
+tcp_output(TCP_Connection *connection)
+{
+    uint32_t  window, in_flight, unsent, len, start = connection->seq_number;
+    TCP_Flags flags, last = 0;
+
+    /* Data is only sent once the connection is synchronized, until our FIN. */
+
+    if (connection->state != TCP_ESTABLISHED && connection->state != TCP_CLOSE_WAIT &&
+        connection->state != TCP_FIN_WAIT_1  && connection->state != TCP_CLOSING    &&
+        connection->state != TCP_LAST_ACK)
+    {
+        return;
+    }
+
+    window = connection->cwnd < connection->snd_wnd ? connection->cwnd : connection->snd_wnd;
+
+    while (SEQ_LEQ(connection->seq_number, connection->snd_end))
+    {
+        in_flight = connection->seq_number - connection->snd_una;
+        unsent    = connection->snd_end - connection->seq_number;
+        len       = unsent > connection->mss ? connection->mss : unsent;
+
+        /* Shrink the segment to the window, or probe a closed one. */
+
+        if (in_flight + len > window)
+        {
+            if (in_flight < window)
+            {
+                len = window - in_flight;
+            }
+            else if (in_flight == 0 && unsent > 0)
+            {
+                len = 1;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        /* Nagle (RFC 896): hold back a short tail of the queue while data is
+           in flight, so small writes coalesce. A queued FIN sends it out. */
+
+        if (len > 0 && len == unsent && len < connection->mss && !connection->fin_queued &&
+            ((connection->nagle & TCP_NAGLE_CORK) || (in_flight > 0 && !(connection->nagle & TCP_NAGLE_OFF))))
+        {
+            break;
+        }
+
+        flags = TCP_ACK;
+
+        if (len > 0 && len == unsent)
+        {
+            flags |= TCP_PSH;
+        }
+
+        if (len == unsent && connection->fin_queued)
+        {
+            flags |= TCP_FIN;
+        }
+
+        if ((len == 0 && !(flags & TCP_FIN)) || queue_tcp_segment(connection, flags, len) == NULL)
+        {
+            break;
+        }
+
+        last = flags;
+    }
+
+    /* Send what was queued in one burst. Every segment but the last is full. */
+
+    if (connection->seq_number != start)
+    {
+        tcp_transmit(connection, start, connection->seq_number - start - ((last & TCP_FIN) ? 1 : 0), last);
+    }
+}
+
+/* Copy len bytes starting at sequence number seq out of the send buffer. */
+
+void
+read_send_buffer(const TCP_Connection *connection, uint32_t seq, uint8_t *dst, uint16_t len)
+{
+    uint32_t offset = seq & (TCP_SEND_BUFFER_SIZE - 1);
+    uint32_t first  = len > TCP_SEND_BUFFER_SIZE - offset ? TCP_SEND_BUFFER_SIZE - offset : len;
+
+    memcpy(dst, connection->snd_buf + offset, first);
+    memcpy(dst + first, connection->snd_buf, len - first);
+}
+
+/* Take the peer's window from an acceptable ACK, unless the segment is older 
+   than the one the window was last taken from (RFC 793, SND.WL1 and SND.WL2). 
+   During the handshake any acceptable ACK sets the window. */
+
+void
+update_send_window(TCP_Connection *connection, uint32_t seq, uint32_t ack, uint32_t window)
+{
+    if (SEQ_LT(ack, connection->snd_una) || SEQ_GT(ack, connection->seq_number))
+    {
+        return;
+    }
+
+    if (connection->state == TCP_SYN_SENT || connection->state == TCP_SYN_RECEIVED ||
+        SEQ_LT(connection->snd_wl1, seq) || 
+        (connection->snd_wl1 == seq && SEQ_LEQ(connection->snd_wl2, ack)))
+    {
+        connection->snd_wnd = window;
+        connection->snd_wl1 = seq;
+        connection->snd_wl2 = ack;
+    }
+}
+
+/* Turn Nagle's algorithm off (on = 1) or back on for a connection. */
+
+void
+tcp_set_nodelay(TCP_Connection *connection, int on)
+{
+    if (on)
+    {
+        connection->nagle |= TCP_NAGLE_OFF;
+        tcp_output(connection);
+    }
+    else
+    {
+        connection->nagle &= ~TCP_NAGLE_OFF;
+    }
+}
+
+/* Cork a connection, so that only full segments are sent, or uncork it and
+   send what was held. */
+
+void
+tcp_set_cork(TCP_Connection *connection, int on)
+{
+    if (on)
+    {
+        connection->nagle |= TCP_NAGLE_CORK;
+    }
+    else
+    {
+        connection->nagle &= ~TCP_NAGLE_CORK;
+        tcp_output(connection);
+    }
+}
+
+/*
+    RETRANSMISSION FUNCTIONS
+*/
+
+/* Send a segment that takes sequence space (SYN or SYN-ACK) and put it on the 
+   retransmission queue until it is acknowledged. A failed send (e.g. no ARP 
+   entry) is left to the retransmission timer. If the segment cache cannot 
+   grow, return -1. */
+
+int
+send_tcp_segment(TCP_Connection *connection, TCP_Flags flags, uint16_t payload_len)
+{
+    TCP_Segment *segment;
+
+    if ((segment = queue_tcp_segment(connection, flags, payload_len)) == NULL)
+    {
+        return -1;
+    }
+
+    transmit_tcp_segment(connection, segment);
+
+    return 0;
+}
+
+/* Put a segment that takes sequence space (data, SYN or FIN) on the 
+   retransmission queue, to be sent by the caller. Its payload is the next 
+   payload_len bytes of the send buffer, and the sequence number is advanced 
+   past it. Returns NULL if the segment cache cannot grow. */
+
+TCP_Segment *
+queue_tcp_segment(TCP_Connection *connection, TCP_Flags flags, uint16_t payload_len)
+{
+    TCP_Segment *segment;
+
+    if ((segment = slab_alloc(&TCP_CONNECTIONS_LIST->segment_cache)) == NULL)
+    {
+        return NULL;
+    }
+
+    segment->next        = NULL;
+    segment->seq         = connection->seq_number;
+    segment->len         = payload_len;
+    segment->flags       = flags;
+    segment->retransmits = 0;
+    segment->sacked      = 0;
+    segment->sent        = timer_wheel_clock(&TIMER_WHEEL);
+
+    /* Append to the queue and advance the sequence number. */
+
+    if (connection->rtx_tail == NULL)
+    {
+        connection->rtx_head       = segment;
+    }
+    else
+    {
+        connection->rtx_tail->next = segment;
+    }
+
+    connection->rtx_tail    = segment;
+    connection->seq_number += tcp_segment_seq_len(segment);
+
+    /* Start the timer unless older segments are already being timed (RFC 6298 5.1). */
+
+    if (!timer_pending(&connection->rtx_timer))
+    {
+        arm_timer(&TIMER_WHEEL, &connection->rtx_timer, connection->rto);
+    }
+
+    return segment;
+}
+
+/* Send a segment of the retransmission queue again. */
+
+int
+transmit_tcp_segment(TCP_Connection *connection, const TCP_Segment *segment)
+{
+    return tcp_transmit(connection, segment->seq, segment->len, segment->flags);
+}
+
+/* Return the sequence space a segment takes: its payload, plus one each for SYN and FIN. */
+
+uint32_t
+tcp_segment_seq_len(const TCP_Segment *segment)
+{
+    return segment->len + ((segment->flags & TCP_SYN) ? 1 : 0) + ((segment->flags & TCP_FIN) ? 1 : 0);
+}
+
+/* Return 1 if everything queued on a connection, including a FIN, has been sent
+   and acknowledged. */
+
+int
+tcp_all_acked(const TCP_Connection *connection)
+{
+    return connection->snd_una == connection->seq_number && 
+           SEQ_GEQ(connection->seq_number, connection->snd_end + connection->fin_queued);
+}
+
+/* Process the acknowledgement number of an incoming segment. Acknowledged segments
+   are freed, and a partly acknowledged one is trimmed. The RTT is sampled from the 
+   newest freed segment that was never sent again (Karn's algorithm). Returns the 
+   number of newly acknowledged sequence numbers, or 0 for duplicate, old, or 
+   invalid ACKs. */
+
+uint32_t
+process_tcp_ack(TCP_Connection *connection, uint32_t ack)
+{
+    TCP_Segment *segment;
+    uint64_t     now     = timer_wheel_clock(&TIMER_WHEEL);
+    uint32_t     acked, trim;
+    int64_t      rtt     = -1;
+
+    if (SEQ_LEQ(ack, connection->snd_una) || SEQ_GT(ack, connection->seq_number))
+    {
+        return 0;
+    }
+
+    acked               = ack - connection->snd_una;
+    connection->snd_una = ack;
+
+    while ((segment = connection->rtx_head) != NULL)
+    {
+        /* Drop the acknowledged front of a partly acknowledged segment. */
+
+        if (SEQ_GT(segment->seq + tcp_segment_seq_len(segment), ack))
+        {
+            if (SEQ_GT(ack, segment->seq))
+            {
+                trim = ack - segment->seq;
+
+                /* What is left of a SYN is its data, sent with an ACK. */
+
+                if (segment->flags & TCP_SYN)
+                {
+                    segment->flags = (segment->flags & ~TCP_SYN) | TCP_ACK;
+                    trim--;
+                }
+
+                segment->len -= trim;
+                segment->seq  = ack;
+            }
+            break;
+        }
+
+        if (segment->retransmits == 0)
+        {
+            rtt = now - segment->sent;
+        }
+
+        connection->rtx_head = segment->next;
+        slab_free(&TCP_CONNECTIONS_LIST->segment_cache, segment);
+    }
+
+    if (connection->rtx_head == NULL)
+    {
+        connection->rtx_tail = NULL;
+    }
+
+    if (rtt >= 0 && !(connection->opt_flags & TCP_OPT_TIMESTAMPS))
+    {
+        update_tcp_rto(connection, rtt);
+    }
+
+    /* Restart the timer for what is left, or stop it (RFC 6298 5.2 and 5.3). */
+
+    if (connection->rtx_head == NULL)
+    {
+        cancel_timer(&TIMER_WHEEL, &connection->rtx_timer);
+    }
+    else
+    {
+        arm_timer(&TIMER_WHEEL, &connection->rtx_timer, connection->rto);
+    }
+
+    return acked;
+}
+
+/* Update SRTT and RTTVAR with an RTT sample (in ticks) and recompute the RTO,
+   as in RFC 6298 section 2. Both are kept scaled, as in BSD, so the 1/8 and 
+   1/4 gains need no division. A new RTO also ends any backoff. */
+
+void
+update_tcp_rto(TCP_Connection *connection, uint32_t rtt)
+{
+    TCP_RTT_Histogram *histogram = TCP_CONNECTIONS_LIST->rtt_histogram;
+    int32_t            delta;
+
+    if (histogram != NULL)
+    {
+        histogram->counts[rtt < TCP_RTT_HISTOGRAM_LEN ? rtt : TCP_RTT_HISTOGRAM_LEN - 1]++;
+        histogram->samples++;
+    }
+    
+    if (connection->srtt == 0)
+    {
+        /* First sample: SRTT = R, RTTVAR = R/2. */
+
+        connection->srtt   = rtt << TCP_RTT_SHIFT;
+        connection->rttvar = rtt << (TCP_RTTVAR_SHIFT - 1);
+    }
+    else
+    {
+        /* SRTT += (R - SRTT) / 8, RTTVAR += (|R - SRTT| - RTTVAR) / 4. */
+
+        delta               = (int32_t)(rtt << TCP_RTT_SHIFT) - (int32_t)connection->srtt;
+        connection->srtt   += delta >> TCP_RTT_SHIFT;
+        delta               = (delta < 0 ? -delta : delta) >> (TCP_RTT_SHIFT - TCP_RTTVAR_SHIFT);
+        connection->rttvar += (delta - (int32_t)connection->rttvar) >> TCP_RTTVAR_SHIFT;
+    }
+
+    /* RTO = SRTT + max(G, 4 * RTTVAR), where the scaled rttvar already is 4 * RTTVAR. */
+
+    connection->rto = (connection->srtt >> TCP_RTT_SHIFT) + (connection->rttvar > 1 ? connection->rttvar : 1);
+    connection->rto = connection->rto < TCP_MIN_RTO ? TCP_MIN_RTO : connection->rto;
+    connection->rto = connection->rto > TCP_MAX_RTO ? TCP_MAX_RTO : connection->rto;
+}
+
+/* The retransmission timer fired: send the oldest unacknowledged segment again 
+   and back off the RTO (RFC 6298 5.4 to 5.6). The connection is dropped after
+   TCP_MAX_RETRANSMITS attempts, unless the segment is probing a zero window, 
+   which is kept up for as long as the peer advertises one. */
+
+void
+tcp_retransmit_timeout(Timer *timer, void *arg)
+{
+    TCP_Connection *connection = arg;
+    TCP_Segment    *segment    = connection->rtx_head;
+    uint32_t        net_dst_ip = htonl(connection->dst_ip);
+    char            dst_ip[INET_ADDRSTRLEN]; 
+
+    if (segment == NULL)
+    {
+        return;
+    }
+
+    if (segment->retransmits >= TCP_MAX_RETRANSMITS && connection->snd_wnd != 0)
+    {
+        inet_ntop(AF_INET, &net_dst_ip, dst_ip, INET_ADDRSTRLEN);
+        printf("\n    NOTIFICATION: a connection with %s on port %d was dropped (no acknowledgement).\n\n", dst_ip, connection->dst_port);
+        fflush(stdout);
+        remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+        return;
+    }
+
+    connection->rto = connection->rto * 2 > TCP_MAX_RTO ? TCP_MAX_RTO : connection->rto * 2;
+
+    /* A SYN with data may be dropped on the way for carrying it: send the SYN
+       alone, with the data to follow the handshake, and ask for a new cookie 
+       next time (RFC 7413 4.2.2). */
+
+    if ((segment->flags & TCP_SYN) && segment->len > 0)
+    {
+        connection->seq_number = segment->seq + 1;
+        segment->len           = 0;
+        forget_fastopen_cookie(connection->dst_ip);
+    }
+
+    /* The peer may have discarded what it SACKed, so start over from the oldest segment (RFC 2018 8). */
+
+    for (segment = connection->rtx_head; segment != NULL; segment = segment->next)
+    {
+        segment->sacked = 0;
+    }
+
+    connection->high_sacked = connection->snd_una;
+    connection->high_rxt    = connection->snd_una;
+
+    tcp_congestion_timeout(connection);
+    retransmit_tcp_segment(connection);
+    arm_timer(&TIMER_WHEEL, &connection->rtx_timer, connection->rto);
+}
+
+/* Send the oldest unacknowledged segment again. With SACK, send the first one 
+   past high_rxt that the peer does not hold instead, but only if it is the 
+   oldest or the peer holds data after it (RFC 6675 NextSeg()). Returns 1 if a
+   segment was sent. */
+
+int
+retransmit_tcp_segment(TCP_Connection *connection)
+{
+    TCP_Segment *segment = connection->rtx_head;
+
+    if (connection->opt_flags & TCP_OPT_SACK_PERMITTED)
+    {
+        while (segment != NULL && (segment->sacked || SEQ_LT(segment->seq, connection->high_rxt)))
+        {
+            segment = segment->next;
+        }
+
+        if (segment != NULL && segment != connection->rtx_head && SEQ_GEQ(segment->seq, connection->high_sacked))
+        {
+            segment = NULL;
+        }
+    }
+
+    if (segment == NULL)
+    {
+        return 0;
+    }
+
+    segment->retransmits += segment->retransmits < TCP_MAX_RETRANSMITS;
+    connection->high_rxt  = segment->seq + tcp_segment_seq_len(segment);
+    connection->retransmits++;
+    transmit_tcp_segment(connection, segment);
+
+    return 1;
+}
+
+/* Free every segment on a connection's retransmission queue. */
+
+void
+free_tcp_segments(TCP_Connection *connection)
+{
+    TCP_Segment *segment, *next;
+
+    for (segment = connection->rtx_head; segment != NULL; segment = next)
+    {
+        next = segment->next;
+        slab_free(&TCP_CONNECTIONS_LIST->segment_cache, segment);
+    }
+
+    connection->rtx_head = NULL;
+    connection->rtx_tail = NULL;
+}
+
+/*
+    OPTIONS FUNCTIONS
+*/
+
+/* Parse the options of a segment into options. Unknown kinds are skipped. 
+   Returns -1 if an option runs past the header or has a bad length. */
+
+int
+parse_tcp_options(TCP_Header *tcp_header, ssize_t header_len, TCP_Options *options)
+{
+    uint8_t *option = (uint8_t *)(tcp_header + 1);
+    uint8_t *end    = (uint8_t *)tcp_header + header_len;
+    uint8_t  kind, len;
+
+    memset(options, 0, sizeof(TCP_Options));
+
+    while (option < end)
+    {
+        kind = option[0];
+
+        if (kind == TCP_OPTION_END)
+        {
+            break;
+        }
+
+        if (kind == TCP_OPTION_NOP)
+        {
+            option++;
+            continue;
+        }
+
+        /* Every other option has a length byte, which counts kind and length. */
+
+        if (end - option < 2 || (len = option[1]) < 2 || len > end - option)
+        {
+            return -1;
+        }
+
+        switch (kind)
+        {
+            case TCP_OPTION_MSS:
+
+                if (len != 4)
+                {
+                    return -1;
+                }
+
+                options->mss      = option[2] << 8 | option[3];
+                options->present |= TCP_OPT_MSS;
+                break;
+
+            case TCP_OPTION_WSCALE:
+
+                if (len != 3)
+                {
+                    return -1;
+                }
+
+                options->wscale   = option[2];
+                options->present |= TCP_OPT_WSCALE;
+                break;
+
+            case TCP_OPTION_SACK_PERMITTED:
+
+                if (len != 2)
+                {
+                    return -1;
+                }
+
+                options->present |= TCP_OPT_SACK_PERMITTED;
+                break;
+
+            case TCP_OPTION_SACK:
+
+                if ((len - 2) % 8 != 0)
+                {
+                    return -1;
+                }
+
+                for (int i = 2; i < len && options->num_sacks < 4; i += 8)
+                {
+                    memcpy(&options->sacks[options->num_sacks].start, option + i, 4);
+                    memcpy(&options->sacks[options->num_sacks].end, option + i + 4, 4);
+
+                    options->sacks[options->num_sacks].start = ntohl(options->sacks[options->num_sacks].start);
+                    options->sacks[options->num_sacks].end   = ntohl(options->sacks[options->num_sacks].end);
+                    options->num_sacks++;
+                }
+
+                options->present |= TCP_OPT_SACK;
+                break;
+
+            case TCP_OPTION_TIMESTAMPS:
+
+                if (len != 10)
+                {
+                    return -1;
+                }
+
+                memcpy(&options->ts_val, option + 2, 4);
+                memcpy(&options->ts_ecr, option + 6, 4);
+
+                options->ts_val   = ntohl(options->ts_val);
+                options->ts_ecr   = ntohl(options->ts_ecr);
+                options->present |= TCP_OPT_TIMESTAMPS;
+                break;
+
+            case TCP_OPTION_FASTOPEN:
+
+                if (len != 2 && (len - 2 < TCP_FASTOPEN_MIN_COOKIE_LEN || len - 2 > TCP_FASTOPEN_MAX_COOKIE_LEN || len % 2 != 0))
+                {
+                    return -1;
+                }
+
+                options->cookie_len = len - 2;
+                options->present   |= TCP_OPT_FASTOPEN;
+                memcpy(options->cookie, option + 2, len - 2);
+                break;
+        }
+
+        option += len;
+    }
+
+    return 0;
+}
+
+/* Write the options of an outgoing segment, in no more than max_len bytes, and
+   return their length (a multiple of 4). A SYN offers everything we support, 
+   and a SYN-ACK answers with what the peer offered; either may carry a Fast 
+   Open cookie. Other segments carry a timestamp and, while data is held out of
+   order, SACK blocks. */
+
+uint8_t
+build_tcp_options(TCP_Connection *connection, TCP_Flags flags, uint8_t *options, ssize_t max_len)
+{
+    uint8_t  mask = (flags & TCP_SYN) && !(flags & TCP_ACK) ? TCP_OPT_OFFERED : connection->opt_flags;
+    uint8_t  len  = 0;
+    uint32_t ts_val, ts_ecr;
+
+    if (flags & TCP_SYN)
+    {
+        options[len++] = TCP_OPTION_MSS;
+        options[len++] = 4;
+        options[len++] = TCP_MAX_MSS >> 8;
+        options[len++] = TCP_MAX_MSS & 0xff;
+
+        /* SACK-permitted takes the place of the NOPs that align the timestamps. */
+
+        if (mask & TCP_OPT_SACK_PERMITTED)
+        {
+            options[len++] = TCP_OPTION_SACK_PERMITTED;
+            options[len++] = 2;
+        }
+
+        if (!(mask & TCP_OPT_SACK_PERMITTED) != !(mask & TCP_OPT_TIMESTAMPS))
+        {
+            options[len++] = TCP_OPTION_NOP;
+            options[len++] = TCP_OPTION_NOP;
+        }
+    }
+    else if (mask & TCP_OPT_TIMESTAMPS)
+    {
+        options[len++] = TCP_OPTION_NOP;
+        options[len++] = TCP_OPTION_NOP;
+    }
+
+    if (mask & TCP_OPT_TIMESTAMPS)
+    {
+        ts_val         = htonl((uint32_t)timer_wheel_clock(&TIMER_WHEEL));
+        ts_ecr         = htonl(connection->ts_recent);
+        options[len++] = TCP_OPTION_TIMESTAMPS;
+        options[len++] = 10;
+
+        memcpy(options + len, &ts_val, 4);
+        memcpy(options + len + 4, &ts_ecr, 4);
+        len           += 8;
+    }
+
+    if (flags & TCP_SYN)
+    {
+        if (mask & TCP_OPT_WSCALE)
+        {
+            options[len++] = TCP_OPTION_NOP;
+            options[len++] = TCP_OPTION_WSCALE;
+            options[len++] = 3;
+            options[len++] = TCP_WSCALE;
+        }
+
+        if (connection->fastopen)
+        {
+            len += build_fastopen_option(connection, flags, options + len);
+        }
+    }
+    else if (mask & TCP_OPT_SACK_PERMITTED && connection->ooo_head != NULL)
+    {
+        len += build_sack_option(connection, options + len, max_len - len);
+    }
+
+    return len;
+}
+
+/* Write a SACK option with the held out-of-order ranges, the one holding the 
+   latest data first (RFC 2018 4), and return its length. As many blocks as fit
+   in max_len are sent. */
+
+uint8_t
+build_sack_option(TCP_Connection *connection, uint8_t *options, ssize_t max_len)
+{
+    TCP_Interval *interval, *first = NULL, *blocks[4];
+    uint32_t      edges[2];
+    int           num_blocks = 0, max_blocks = max_len < 12 ? 0 : (max_len - 4) / 8;
+
+    max_blocks = max_blocks > 4 ? 4 : max_blocks;
+
+    if (max_blocks == 0)
+    {
+        return 0;
+    }
+
+    for (interval = connection->ooo_head; interval != NULL; interval = interval->next)
+    {
+        if (SEQ_GEQ(connection->ooo_last, interval->start) && SEQ_LT(connection->ooo_last, interval->end))
+        {
+            first                = interval;
+            blocks[num_blocks++] = interval;
+        }
+    }
+
+    for (interval = connection->ooo_head; interval != NULL && num_blocks < max_blocks; interval = interval->next)
+    {
+        if (interval != first)
+        {
+            blocks[num_blocks++] = interval;
+        }
+    }
+
+    options[0] = TCP_OPTION_NOP;
+    options[1] = TCP_OPTION_NOP;
+    options[2] = TCP_OPTION_SACK;
+    options[3] = 2 + num_blocks * 8;
+
+    for (int i = 0; i < num_blocks; i++)
+    {
+        edges[0] = htonl(blocks[i]->start);
+        edges[1] = htonl(blocks[i]->end);
+
+        memcpy(options + 4 + i * 8, edges, 8);
+    }
+
+    return 4 + num_blocks * 8;
+}
+
+/* Agree on the options of a connection from the peer's SYN or SYN-ACK. Each 
+   option is used only if both sides sent it. The MSS leaves room for the 
+   timestamps, which every segment then carries. */
+
+void
+tcp_syn_options(TCP_Connection *connection, const TCP_Options *options)
+{
+    uint16_t mss = (options->present & TCP_OPT_MSS) && options->mss > 0 ? options->mss : TCP_DEFAULT_MSS;
+
+    connection->opt_flags = TCP_OPT_OFFERED & options->present;
+    mss                   = mss > TCP_MAX_MSS ? TCP_MAX_MSS : mss;
+
+    if (connection->opt_flags & TCP_OPT_TIMESTAMPS)
+    {
+        mss                  -= mss > 2 * TCP_TIMESTAMPS_LEN ? TCP_TIMESTAMPS_LEN : 0;
+        connection->ts_recent = options->ts_val;
+    }
+
+    if (connection->opt_flags & TCP_OPT_WSCALE)
+    {
+        connection->snd_wscale  = options->wscale > TCP_MAX_WSCALE ? TCP_MAX_WSCALE : options->wscale;
+        connection->rcv_wscale  = TCP_WSCALE;
+        connection->window_size = TCP_SCALED_WINDOW_SIZE;
+    }
+
+    connection->mss  = mss;
+    connection->cwnd = TCP_INITIAL_CWND(mss);
+}
+
+/* Protect against wrapped sequence numbers (PAWS, RFC 7323 5): a segment with
+   a timestamp older than the last one is a duplicate, and only gets an ACK. 
+   Otherwise remember the timestamp to echo if the segment is not beyond our 
+   last ACK. Returns 0 if the segment is dropped. */
+
+int
+check_tcp_timestamps(TCP_Connection *connection, uint32_t seq, const TCP_Options *options)
+{
+    if (!(connection->opt_flags & TCP_OPT_TIMESTAMPS) || !(options->present & TCP_OPT_TIMESTAMPS))
+    {
+        return 1;
+    }
+
+    if (SEQ_LT(options->ts_val, connection->ts_recent))
+    {
+        send_ack(connection);
+        return 0;
+    }
+
+    if (SEQ_LEQ(seq, connection->ack_sent))
+    {
+        connection->ts_recent = options->ts_val;
+    }
+
+    return 1;
+}
+
+/* Mark the segments the peer reports holding. Blocks below snd_una (D-SACK) 
+   or beyond what was sent are ignored. */
+
+void
+process_sack_blocks(TCP_Connection *connection, const TCP_Options *options)
+{
+    const TCP_Sack_Block *block;
+    TCP_Segment          *segment;
+    uint32_t              end;
+
+    if (!(connection->opt_flags & TCP_OPT_SACK_PERMITTED) || !(options->present & TCP_OPT_SACK))
+    {
+        return;
+    }
+
+    for (int i = 0; i < options->num_sacks; i++)
+    {
+        block = &options->sacks[i];
+
+        if (SEQ_LEQ(block->end, connection->snd_una) || SEQ_GT(block->end, connection->seq_number) || 
+            SEQ_GEQ(block->start, block->end))
+        {
+            continue;
+        }
+
+        for (segment = connection->rtx_head; segment != NULL && SEQ_LT(segment->seq, block->end); segment = segment->next)
+        {
+            end = segment->seq + tcp_segment_seq_len(segment);
+
+            if (SEQ_GEQ(segment->seq, block->start) && SEQ_LEQ(end, block->end))
+            {
+                segment->sacked = 1;
+
+                if (SEQ_GT(end, connection->high_sacked))
+                {
+                    connection->high_sacked = end;
+                }
+            }
+        }
+    }
+}
+
+/*
+    SYN COOKIE FUNCTIONS
+*/
+
+/* Answer a SYN without keeping any state. The SYN-ACK's sequence number is a 
+   cookie the peer's ACK returns, holding the largest MSS no greater than the
+   peer's. A temporary connection, never added to the table, builds the SYN-ACK.
+   Window scaling and SACK are not offered, since the cookie has no room to 
+   remember them; timestamps are, since the peer echoes its own back. */
+
+void
+send_syn_cookie(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, 
+                uint32_t peer_isn, const TCP_Options *options)
+{
+    TCP_Connection *connection;
+    TCP_Options     offered = *options;
+    uint32_t        count   = timer_wheel_clock(&TIMER_WHEEL) / TCP_COOKIE_PERIOD;
+    uint16_t        mss     = (options->present & TCP_OPT_MSS) && options->mss > 0 ? options->mss : TCP_DEFAULT_MSS;
+    uint32_t        index   = 0, cookie;
+
+    while (index + 1 < NUM_COOKIE_MSS && TCP_COOKIE_MSS[index + 1] <= mss)
+    {
+        index++;
+    }
+
+    cookie = (count << TCP_COOKIE_TIME_SHIFT) | (index << TCP_COOKIE_MSS_SHIFT) | 
+             (tcp_cookie_hash(src_ip, dst_ip, src_port, dst_port, peer_isn, count) & TCP_COOKIE_HASH_MASK);
+
+    if ((connection = create_tcp_connection(src_ip, dst_ip, src_port, dst_port, DEFAULT_WINDOW_SIZE, 
+                                            cookie, peer_isn + 1, TCP_SYN_RECEIVED)) == NULL)
+    {
+        return;
+    }
+
+    offered.present &= TCP_OPT_MSS | TCP_OPT_TIMESTAMPS;
+    tcp_syn_options(connection, &offered);
+    tcp_transmit(connection, cookie, 0, TCP_SYN | TCP_ACK);
+    slab_free(&TCP_CONNECTIONS_LIST->cache, connection);
+}
+
+/* Check the ACK of a cookie SYN-ACK. A cookie is accepted for TCP_COOKIE_MAX_AGE
+   periods after the one it was sent in. If it is valid, create the connection
+   it stands for in SYN_RECEIVED, with the MSS it holds and timestamps if the 
+   ACK carries them, for the ACK to establish. Returns NULL if the cookie is not
+   valid or the connection cannot be created. */
+
+TCP_Connection *
+check_syn_cookie(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, 
+                 TCP_Header *tcp_header, const TCP_Options *options)
+{
+    TCP_Connection *connection;
+    TCP_Options     agreed;
+    uint32_t        cookie   = ntohl(tcp_header->ack_number) - 1;
+    uint32_t        peer_isn = ntohl(tcp_header->seq_number) - 1;
+    uint32_t        count    = timer_wheel_clock(&TIMER_WHEEL) / TCP_COOKIE_PERIOD;
+    uint32_t        age      = (count - (cookie >> TCP_COOKIE_TIME_SHIFT)) & (UINT32_MAX >> TCP_COOKIE_TIME_SHIFT);
+
+    if (age > TCP_COOKIE_MAX_AGE || (cookie & TCP_COOKIE_HASH_MASK) != 
+        (tcp_cookie_hash(src_ip, dst_ip, src_port, dst_port, peer_isn, count - age) & TCP_COOKIE_HASH_MASK))
+    {
+        return NULL;
+    }
+
+    connection = create_tcp_connection(src_ip, dst_ip, src_port, dst_port, DEFAULT_WINDOW_SIZE, 
+                                       cookie + 1, peer_isn + 1, TCP_SYN_RECEIVED);
+
+    if (connection == NULL || add_tcp_connection(TCP_CONNECTIONS_LIST, connection) == -1)
+    {
+        slab_free(&TCP_CONNECTIONS_LIST->cache, connection);
+        return NULL;
+    }
+
+    /* The SYN-ACK is acknowledged, so nothing is queued. */
+
+    connection->snd_end = connection->seq_number;
+
+    agreed.present = TCP_OPT_MSS | (options->present & TCP_OPT_TIMESTAMPS);
+    agreed.mss     = TCP_COOKIE_MSS[(cookie >> TCP_COOKIE_MSS_SHIFT) & (NUM_COOKIE_MSS - 1)];
+    agreed.ts_val  = options->ts_val;
+    tcp_syn_options(connection, &agreed);
+
+    return connection;
+}
+
+/* Keyed hash of a 4-tuple, the peer's initial sequence number and a time count,
+   folding each word into the secret with the splitmix64 finalizer. */
+
+uint32_t
+tcp_cookie_hash(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, uint32_t peer_isn, uint32_t count)
+{
+    uint64_t hash     = TCP_CONNECTIONS_LIST->cookie_secret;
+    uint64_t words[3] = { ((uint64_t)src_ip << 32) | dst_ip, 
+                          ((uint64_t)src_port << 48) | ((uint64_t)dst_port << 32) | peer_isn, 
+                          count };
+
+    for (int i = 0; i < 3; i++)
+    {
+        hash ^= words[i];
+        hash ^= hash >> 30;
+        hash *= 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 27;
+        hash *= 0x94D049BB133111EBULL;
+        hash ^= hash >> 31;
+    }
+
+    return hash >> 32;
+}
+
+/*
+    FAST OPEN FUNCTIONS
+*/
+
+/* The cookie we give a client: a keyed hash of its IP (RFC 7413 4.1.2). */
+
+uint64_t
+tcp_fastopen_cookie(uint32_t ip)
+{
+    uint64_t hash = TCP_CONNECTIONS_LIST->fastopen_secret ^ ip;
+
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+
+    return hash;
+}
+
+/* Returns 1 if a SYN carries the cookie we gave its sender. */
+
+int
+valid_fastopen_cookie(const TCP_Connection *connection, const TCP_Options *options)
+{
+    uint64_t cookie = tcp_fastopen_cookie(connection->dst_ip);
+
+    return options->cookie_len == TCP_FASTOPEN_COOKIE_LEN && memcmp(options->cookie, &cookie, TCP_FASTOPEN_COOKIE_LEN) == 0;
+}
+
+/* Take the data of a SYN with a valid cookie. The SYN-ACK acknowledges it, and
+   the connection is established and handed to the listener at once, so the 
+   data reaches the application, and its answer can leave, a round trip before
+   the handshake would have completed (RFC 7413 4.1.3). Our SYN-ACK waits on
+   the retransmission queue like any segment. The peer's window comes from its
+   SYN, unscaled. */
+
+void
+accept_fastopen_data(TCP_Connection *connection, TCP_Header *tcp_header, Packet_Buffer *buffer, uint8_t *payload, 
+                     uint32_t len)
+{
+    TCP_Socket *listener = find_tcp_listener(connection->src_ip, connection->src_port);
+    uint32_t    window   = tcp_socket_window(connection);
 
-    /* Malloc space for flags. */
+    len                     = len > window ? window : len;
+    connection->ack_number += len;
+    connection->snd_wnd     = ntohs(tcp_header->window_size);
+    connection->snd_wl1     = ntohl(tcp_header->seq_number);
+    connection->snd_wl2     = connection->seq_number;
 
-    if ((flags = malloc(sizeof(TCP_Flags))) == NULL)  
+    send_syn_ack(connection);
+    establish_tcp_connection(connection);
+    tcp_socket_deliver(connection, buffer, payload, len);
+
+    if (listener != NULL)
     {
-        return -1;
+        listener->stats.fastopen++;
     }
+}
 
-    /* Set flags */
+/* Write the Fast Open option of a SYN or SYN-ACK, and return its length, 
+   aligned to 4 with NOPs. A SYN carries the cookie cached for the server, or
+   asks for one; a SYN-ACK carries the client's cookie. */
 
-    memset(flags, 0, sizeof(TCP_Flags));
-    flags->SYN_FLAG_SET = 1;
+uint8_t
+build_fastopen_option(TCP_Connection *connection, TCP_Flags flags, uint8_t *options)
+{
+    TCP_Fastopen_Entry *entry;
+    const uint8_t      *cookie     = NULL;
+    uint8_t             cookie_len = 0, len = 0;
+    uint64_t            ours;
 
-    /* Construct and send packet. Increase the sequence number by 1 if successful. */
+    if (flags & TCP_ACK)
+    {
+        ours       = tcp_fastopen_cookie(connection->dst_ip);
+        cookie     = (const uint8_t *)&ours;
+        cookie_len = TCP_FASTOPEN_COOKIE_LEN;
+    }
+    else if ((entry = find_fastopen_entry(connection->dst_ip)) != NULL)
+    {
+        cookie     = entry->cookie;
+        cookie_len = entry->cookie_len;
+    }
 
-    if (construct_and_send_tcp_packet(flags, connection, NULL, 0) == -1)
+    while ((len + 2 + cookie_len) % 4 != 0)
     {
-        free(flags);
-        return -1;
+        options[len++] = TCP_OPTION_NOP;
     }
 
-    connection->seq_number += 1; 
-    free(flags);
-    
-    return 0;
+    options[len++] = TCP_OPTION_FASTOPEN;
+    options[len++] = 2 + cookie_len;
+
+    if (cookie_len > 0)
+    {
+        memcpy(options + len, cookie, cookie_len);
+    }
+
+    return len + cookie_len;
 }
 
+/* Find the cached cookie of a server. Returns NULL if there is none. */
 
-/* Send a SYN-ACK packet. */
+TCP_Fastopen_Entry *
+find_fastopen_entry(uint32_t ip)
+{
+    TCP_Fastopen_Entry *entry = &TCP_CONNECTIONS_LIST->fastopen_cache[tcp_fastopen_slot(ip)];
 
-int 
-send_syn_ack(TCP_Connection *connection)
+    return entry->ip == ip && ip != 0 ? entry : NULL;
+}
+
+/* Remember the cookie and MSS of a server's SYN-ACK, replacing whatever shares
+   its slot, or forget the server's cookie if it sent none. */
+
+void
+cache_fastopen_cookie(uint32_t ip, const TCP_Options *options)
+{
+    TCP_Fastopen_Entry *entry = &TCP_CONNECTIONS_LIST->fastopen_cache[tcp_fastopen_slot(ip)];
+    uint16_t            mss   = (options->present & TCP_OPT_MSS) && options->mss > 0 ? options->mss : TCP_DEFAULT_MSS;
+
+    if (!(options->present & TCP_OPT_FASTOPEN) || options->cookie_len == 0)
+    {
+        forget_fastopen_cookie(ip);
+        return;
+    }
+
+    entry->ip         = ip;
+    entry->mss        = mss < TCP_DEFAULT_MSS ? TCP_DEFAULT_MSS : mss > TCP_MAX_MSS ? TCP_MAX_MSS : mss;
+    entry->cookie_len = options->cookie_len;
+    memcpy(entry->cookie, options->cookie, options->cookie_len);
+}
+
+/* Forget the cached cookie of a server, if there is one. */
+
+void
+forget_fastopen_cookie(uint32_t ip)
+{
+    TCP_Fastopen_Entry *entry;
+
+    if ((entry = find_fastopen_entry(ip)) != NULL)
+    {
+        entry->ip = 0;
+    }
+}
+
+/* Slot of a server in the cookie cache. */
+
+uint32_t
+tcp_fastopen_slot(uint32_t ip)
 {
-    TCP_Flags *flags; 
+    return (ip * 0x9E3779B1u) >> (32 - __builtin_ctz(TCP_FASTOPEN_CACHE_SIZE));
+}
+
+/*
+    TIME_WAIT FUNCTIONS
+*/
+
+/* Add a bucket for a connection entering TIME_WAIT, and start the timer if 
+   the ring was empty. The ring and chains are allocated the first time. 
+   Returns NULL if the ring is full or cannot be allocated. */
 
-    /* Malloc space for flags. */
+TCP_TW_Bucket *
+add_tw_bucket(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+              uint32_t snd_nxt, uint32_t rcv_nxt, uint32_t ts_recent)
+{
+    TCP_TW_Table  *tw = &TCP_CONNECTIONS_LIST->tw;
+    TCP_TW_Bucket *bucket;
+    uint32_t       index, hash;
 
-    if ((flags = malloc(sizeof(TCP_Flags))) == NULL)  
+    if (tw->ring == NULL)
     {
-        return -1;
+        tw->ring   = malloc(TCP_MAX_TW_BUCKETS * sizeof(TCP_TW_Bucket));
+        tw->chains = malloc(TCP_TW_HASH_SIZE * sizeof(uint32_t));
+
+        if (tw->ring == NULL || tw->chains == NULL)
+        {
+            free(tw->ring);
+            free(tw->chains);
+            tw->ring   = NULL;
+            tw->chains = NULL;
+            return NULL;
+        }
+
+        memset(tw->chains, 0xFF, TCP_TW_HASH_SIZE * sizeof(uint32_t));
+    }
+
+    if (tw->count == TCP_MAX_TW_BUCKETS)
+    {
+        return NULL;
     }
 
-    /* Set flags */
+    index  = (tw->head + tw->count) & (TCP_MAX_TW_BUCKETS - 1);
+    hash   = tcp_connection_hash(TCP_CONNECTIONS_LIST, src_ip, dst_ip, src_port, dst_port) & (TCP_TW_HASH_SIZE - 1);
+    bucket = &tw->ring[index];
 
-    memset(flags, 0, sizeof(TCP_Flags));
-    flags->SYN_FLAG_SET = 1;
-    flags->ACK_FLAG_SET = 1;
+    bucket->src_ip    = src_ip;
+    bucket->dst_ip    = dst_ip;
+    bucket->src_port  = src_port;
+    bucket->dst_port  = dst_port;
+    bucket->snd_nxt   = snd_nxt;
+    bucket->rcv_nxt   = rcv_nxt;
+    bucket->ts_recent = ts_recent;
+    bucket->expires   = (uint32_t)timer_wheel_clock(&TIMER_WHEEL) + TCP_CONNECTION_TIMEOUT * 1000;
+    bucket->next      = tw->chains[hash];
+    tw->chains[hash]  = index;
 
-    /* Construct and send packet. Increase the sequence number by 1 if successful. */
+    tw->count++;
+    tw->live++;
 
-    if (construct_and_send_tcp_packet(flags, connection, NULL, 0) == -1)
+    if (!timer_pending(&tw->timer))
     {
-        free(flags);
-        return -1;
+        arm_timer(&TIMER_WHEEL, &tw->timer, TCP_CONNECTION_TIMEOUT * 1000);
+    }
+
+    return bucket;
+}
+
+/* Find the bucket of a 4-tuple in TIME_WAIT. Returns NULL if there is none. */
+
+TCP_TW_Bucket *
+find_tw_bucket(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
+{
+    TCP_TW_Table  *tw = &TCP_CONNECTIONS_LIST->tw;
+    TCP_TW_Bucket *bucket;
+    uint32_t       index;
+
+    if (tw->live == 0)
+    {
+        return NULL;
+    }
+
+    index = tw->chains[tcp_connection_hash(TCP_CONNECTIONS_LIST, src_ip, dst_ip, src_port, dst_port) & (TCP_TW_HASH_SIZE - 1)];
+
+    for (; index != TCP_TW_NONE; index = bucket->next)
+    {
+        bucket = &tw->ring[index];
+
+        if (bucket->src_ip == src_ip && bucket->dst_ip == dst_ip && bucket->src_port == src_port && bucket->dst_port == dst_port)
+        {
+            return bucket;
+        }
+    }
+
+    return NULL;
+}
+
+/* Take a bucket out of its chain before it expires, freeing its 4-tuple. It
+   stays in the ring until the ones before it expire. */
+
+void
+recycle_tw_bucket(TCP_TW_Bucket *bucket)
+{
+    TCP_TW_Table *tw    = &TCP_CONNECTIONS_LIST->tw;
+    uint32_t      index = bucket - tw->ring;
+    uint32_t     *link  = &tw->chains[tcp_connection_hash(TCP_CONNECTIONS_LIST, bucket->src_ip, bucket->dst_ip, 
+                                                         bucket->src_port, bucket->dst_port) & (TCP_TW_HASH_SIZE - 1)];
+
+    while (*link != index)
+    {
+        link = &tw->ring[*link].next;
+    }
+
+    *link            = bucket->next;
+    bucket->src_port = 0;
+    tw->live--;
+}
+
+/* Handle a segment for a connection in TIME_WAIT. A resent FIN means our last
+   ACK was lost: it is acknowledged again and the wait restarts. A SYN may take
+   the 4-tuple over if it is from a newer connection, which its timestamp shows
+   when both connections use them (RFC 6191), and otherwise its sequence number
+   beyond the old connection's (RFC 1122 4.2.2.13); an older one is answered 
+   with an ACK. Resets are ignored, so one cannot cut the wait short 
+   (RFC 1337), and other segments get an ACK if they carry data. Returns 1 if
+   the bucket was recycled for a SYN, which then opens a connection as if the 
+   4-tuple were free, or 0 if the segment was handled. */
+
+int
+handle_tw_segment(TCP_TW_Bucket *bucket, TCP_Header *tcp_header, TCP_Flags flags, 
+                  const TCP_Options *options, ssize_t tcp_payload_len)
+{
+    TCP_TW_Bucket *renewed;
+    uint32_t       seq = ntohl(tcp_header->seq_number);
+    int            ts  = bucket->ts_recent != 0 && (options->present & TCP_OPT_TIMESTAMPS);
+
+    if (flags & TCP_RST)
+    {
+        return 0;
+    }
+
+    if ((flags & (TCP_SYN | TCP_ACK)) == TCP_SYN)
+    {
+        if (ts ? SEQ_GT(options->ts_val, bucket->ts_recent) : SEQ_GT(seq, bucket->rcv_nxt))
+        {
+            recycle_tw_bucket(bucket);
+            TCP_CONNECTIONS_LIST->tw.recycled++;
+            return 1;
+        }
+
+        send_tw_ack(bucket);
+        return 0;
     }
 
-    connection->seq_number += 1; 
-    free(flags);
+    if (ts && SEQ_GEQ(options->ts_val, bucket->ts_recent))
+    {
+        bucket->ts_recent = options->ts_val;
+    }
+
+    /* Restart the wait by moving the bucket to the end of the ring. */
+
+    if (flags & TCP_FIN)
+    {
+        if ((renewed = add_tw_bucket(bucket->src_ip, bucket->dst_ip, bucket->src_port, bucket->dst_port, 
+                                     bucket->snd_nxt, bucket->rcv_nxt, bucket->ts_recent)) != NULL)
+        {
+            recycle_tw_bucket(bucket);
+            bucket = renewed;
+        }
+
+        send_tw_ack(bucket);
+    }
+    else if (tcp_payload_len > 0)
+    {
+        send_tw_ack(bucket);
+    }
 
     return 0;
 }
 
-/* Send a FIN-ACK packet. */
+/* Returns 1 if our own connect may take over a bucket's 4-tuple: the old 
+   connection used timestamps, and the bucket is TCP_TW_REUSE_DELAY old, so 
+   the new connection's timestamps are all later than the old one's. */
 
-int 
-send_fin_ack(TCP_Connection *connection)
+int
+tcp_tw_reusable(const TCP_TW_Bucket *bucket)
 {
-    TCP_Flags *flags; 
-    
-    /* Malloc space for flags. */
+    uint32_t entered = bucket->expires - TCP_CONNECTION_TIMEOUT * 1000;
+
+    return bucket->ts_recent != 0 && (int32_t)((uint32_t)timer_wheel_clock(&TIMER_WHEEL) - entered) >= TCP_TW_REUSE_DELAY;
+}
+
+/* Send the ACK of a connection in TIME_WAIT from a temporary connection, never
+   added to the table, as for a SYN cookie. */
+
+void
+send_tw_ack(const TCP_TW_Bucket *bucket)
+{
+    TCP_Connection *connection;
 
-    if ((flags = malloc(sizeof(TCP_Flags))) == NULL)  
+    if ((connection = create_tcp_connection(bucket->src_ip, bucket->dst_ip, bucket->src_port, bucket->dst_port, 
+                                            DEFAULT_WINDOW_SIZE, bucket->snd_nxt, bucket->rcv_nxt, TCP_TIME_WAIT)) == NULL)
     {
-        return -1;
+        return;
+    }
+
+    if (bucket->ts_recent != 0)
+    {
+        connection->opt_flags = TCP_OPT_TIMESTAMPS;
+        connection->ts_recent = bucket->ts_recent;
+    }
+
+    send_ack(connection);
+    slab_free(&TCP_CONNECTIONS_LIST->cache, connection);
+}
+
+/* The TIME_WAIT timer fired: drop the buckets that have expired, oldest first,
+   and wait for the next one. */
+
+void
+tcp_tw_timeout(Timer *timer, void *arg)
+{
+    TCP_TW_Table  *tw  = arg;
+    uint32_t       now = (uint32_t)timer_wheel_clock(&TIMER_WHEEL);
+    TCP_TW_Bucket *bucket;
+
+    while (tw->count > 0 && (int32_t)((bucket = &tw->ring[tw->head])->expires - now) <= 0)
+    {
+        if (bucket->src_port != 0)
+        {
+            recycle_tw_bucket(bucket);
+        }
+
+        tw->head = (tw->head + 1) & (TCP_MAX_TW_BUCKETS - 1);
+        tw->count--;
+    }
+
+    if (tw->count > 0)
+    {
+        arm_timer(&TIMER_WHEEL, timer, tw->ring[tw->head].expires - now);
     }
+}
 
-    /* Set flags */
+/*
+    RECEIVE OFFLOAD FUNCTIONS
+*/
 
-    memset(flags, 0, sizeof(TCP_Flags));
-    flags->FIN_FLAG_SET = 1;
-    flags->ACK_FLAG_SET = 1;
+/* Start a run with one segment, once its length and checksum are verified.
+   buffer holds the packet, or is NULL if nothing does. Returns -1 if the 
+   segment is bad. */
 
-    /* Construct and send packet. */
+int
+init_tcp_gro_run(TCP_GRO_Run *run, IP_Header *ip_packet, ssize_t ip_packet_len, Packet_Buffer *buffer)
+{
+    uint8_t     ihl        = (ip_packet->version_and_IHL & 0x0F) * 4;
+    TCP_Header *tcp_header = (TCP_Header *)((uint8_t *)ip_packet + ihl);
+    ssize_t     header_len = (ntohs(tcp_header->offset_reserved_control) >> 12) * 4;
 
-    if (construct_and_send_tcp_packet(flags, connection, NULL, 0) == -1)
+    if (!valid_tcp_packet(tcp_header, ntohl(ip_packet->source), ntohl(ip_packet->destination), 
+                          ip_packet_len - ihl - sizeof(TCP_Header), header_len))
     {
-        free(flags);
         return -1;
     }
 
-    free(flags);
+    run->ip_packet    = ip_packet;
+    run->tcp_header   = tcp_header;
+    run->len          = ip_packet_len - ihl - header_len;
+    run->next_seq     = ntohl(tcp_header->seq_number) + run->len;
+    run->num_segments = 1;
+    run->buffers[0]   = buffer;
+    run->payloads[0]  = (uint8_t *)tcp_header + header_len;
+    run->lens[0]      = run->len;
 
     return 0;
 }
 
-/* Send an ACK packet. */
+/* Returns 1 if a run may take more segments: it carries data and sets nothing
+   but ACK. A PSH ends a run. */
 
 int
-send_ack(TCP_Connection *connection)
+tcp_gro_mergeable(const TCP_GRO_Run *run)
 {
-    TCP_Flags *flags;
-    
-    /* Malloc space for flags. */
+    return run->len > 0 && get_tcp_flags(run->tcp_header) == TCP_ACK;
+}
+
+/* Returns 1 if two runs are of the same flow. */
+
+int
+same_tcp_flow(const TCP_GRO_Run *run, const TCP_GRO_Run *other)
+{
+    return run->ip_packet->source == other->ip_packet->source && 
+           run->ip_packet->destination == other->ip_packet->destination &&
+           run->tcp_header->src_port == other->tcp_header->src_port && 
+           run->tcp_header->dst_port == other->tcp_header->dst_port;
+}
+
+/* Append a one-segment run to the run of its flow, if its data comes next, its
+   ACK is no older, and it sets nothing but an ACK and a PSH. Its options must
+   be the same but for timestamps, so no SACK block is lost. Returns -1 if it
+   cannot join. */
+
+int
+merge_tcp_gro_run(TCP_GRO_Run *run, const TCP_GRO_Run *segment)
+{
+    TCP_Header *head        = run->tcp_header, *tcp_header = segment->tcp_header;
+    uint8_t    *options     = (uint8_t *)(head + 1), *segment_options = (uint8_t *)(tcp_header + 1);
+    ssize_t     options_len = (ntohs(head->offset_reserved_control) >> 12) * 4 - sizeof(TCP_Header);
+
+    if (!tcp_gro_mergeable(run) || run->num_segments == TCP_GRO_MAX_SEGMENTS || segment->len == 0 ||
+        (get_tcp_flags(tcp_header) & ~TCP_PSH) != TCP_ACK || ntohl(tcp_header->seq_number) != run->next_seq ||
+        SEQ_LT(ntohl(tcp_header->ack_number), ntohl(head->ack_number)) || 
+        (ntohs(tcp_header->offset_reserved_control) >> 12) != (ntohs(head->offset_reserved_control) >> 12))
+    {
+        return -1;
+    }
+
+    /* Timestamps may differ in the layout we send them in, NOP NOP TIMESTAMPS. */
 
-    if ((flags = malloc(sizeof(TCP_Flags))) == NULL)  
+    if (memcmp(options, segment_options, options_len) != 0 &&
+        (options_len != 12 || memcmp(options, segment_options, 4) != 0 || options[0] != TCP_OPTION_NOP ||
+         options[1] != TCP_OPTION_NOP || options[2] != TCP_OPTION_TIMESTAMPS))
     {
         return -1;
     }
 
-    /* Set flags */
+    /* The head takes the latest ACK, window, options and PSH. */
+
+    head->ack_number               = tcp_header->ack_number;
+    head->window_size              = tcp_header->window_size;
+    head->offset_reserved_control |= tcp_header->offset_reserved_control & htons(TCP_PSH);
+    memcpy(options, segment_options, options_len);
+
+    run->buffers[run->num_segments]  = segment->buffers[0];
+    run->payloads[run->num_segments] = segment->payloads[0];
+    run->lens[run->num_segments]     = segment->lens[0];
+    run->num_segments++;
+    run->len                        += segment->len;
+    run->next_seq                   += segment->len;
+
+    return 0;
+}
+
+/* Hand a run to the state machine, and release its buffers. */
+
+void
+flush_tcp_gro_run(TCP_GRO_Run *run)
+{
+    handle_tcp_run(run);
+
+    if (run->num_segments > 1 && TCP_CONNECTIONS_LIST != NULL)
+    {
+        TCP_CONNECTIONS_LIST->gro_segments += run->num_segments;
+        TCP_CONNECTIONS_LIST->gro_runs++;
+    }
+
+    for (int i = 0; i < run->num_segments; i++)
+    {
+        release_packet_buffer(run->buffers[i]);
+    }
+}
+
+/* Take a flushed run out of the open runs, moving the last open one, and the
+   scratch slot after it, down in its place. */
+
+void
+remove_tcp_gro_run(TCP_GRO_Run *runs, int *num_runs, int index)
+{
+    (*num_runs)--;
+
+    if (index != *num_runs)
+    {
+        runs[index] = runs[*num_runs];
+    }
+
+    runs[*num_runs] = runs[*num_runs + 1];
+}
+
+/*
+    GRAPH NODES
+*/
 
-    memset(flags, 0, sizeof(TCP_Flags));
-    flags->ACK_FLAG_SET = 1;
+/* Plug the TCP local delivery node into a graph. Returns -1 on failure. */
 
-    /* Construct and send packet. */
+int 
+register_tcp_nodes(Graph *graph)
+{
+    int node;
 
-    if (construct_and_send_tcp_packet(flags, connection, NULL, 0) == -1)
+    if ((node = register_graph_node(graph, "tcp-local", tcp_local_node)) == -1)
     {
-        free(flags);
         return -1;
     }
 
-    free(flags);
+    return register_ip_protocol_node(graph, TCP_PROTOCOL, node);
+}
 
-    return 0;
+/* TCP local node. Hands the segments for the router to the TCP state machine,
+   merging the in-order data segments of each flow into runs first (software
+   GRO). A segment that cannot join its flow's run ends it, and the run goes
+   before it, so each flow stays in order. The last slot of runs is scratch
+   for the segment at hand. */
+
+void 
+tcp_local_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    TCP_GRO_Run  runs[TCP_GRO_MAX_FLOWS + 1];
+    TCP_GRO_Run *segment;
+    IP_Header   *ip_packet;
+    int          num_runs = 0, j;
+
+    for (int i = 0; i < num_buffers; i++)
+    {
+        ip_packet = (IP_Header *)(buffers[i]->data + sizeof(Ethernet_Header));
+        segment   = &runs[num_runs];
+
+        if (init_tcp_gro_run(segment, ip_packet, ntohs(ip_packet->total_length), buffers[i]) == -1)
+        {
+            release_packet_buffer(buffers[i]);
+            continue;
+        }
+
+        /* Join the run of the segment's flow, or end it. */
+
+        for (j = 0; j < num_runs && !same_tcp_flow(&runs[j], segment); j++);
+
+        if (j < num_runs)
+        {
+            if (merge_tcp_gro_run(&runs[j], segment) == 0)
+            {
+                continue;
+            }
+
+            flush_tcp_gro_run(&runs[j]);
+            remove_tcp_gro_run(runs, &num_runs, j);
+            segment = &runs[num_runs];
+        }
+
+        /* Start a run, making room if every slot is open, or go alone. */
+
+        if (!tcp_gro_mergeable(segment))
+        {
+            flush_tcp_gro_run(segment);
+            continue;
+        }
+
+        if (num_runs == TCP_GRO_MAX_FLOWS)
+        {
+            flush_tcp_gro_run(&runs[0]);
+            remove_tcp_gro_run(runs, &num_runs, 0);
+        }
+
+        num_runs++;
+    }
+
+    for (j = 0; j < num_runs; j++)
+    {
+        flush_tcp_gro_run(&runs[j]);
+    }
 }
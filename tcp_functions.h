@@ -10,6 +10,8 @@
 #include "c_headers.h"
 #include "ip.h"
 #include "tcp.h"
+#include "tcp_socket.h"
+#include "graph.h"
 
 /* 
     TCP FUNCTIONS
@@ -17,17 +19,17 @@
 
 /* Utility */
 
-TCP_Flags            *get_tcp_flags(TCP_Header *tcp_header);
+TCP_Flags             get_tcp_flags(TCP_Header *tcp_header);
 uint32_t              get_random_sequence_number();
 uint16_t              get_random_port_number();
-int                   is_listening_port(uint16_t port_num);
 uint16_t              calculate_tcp_checksum(TCP_Header *tcp_header, uint8_t *payload, ssize_t payload_len, uint32_t ip_src, uint32_t ip_dst);
 void                  print_connection_info(TCP_Connection *connection, int conn_num);
 int                   extract_ip_and_port(char *input, uint32_t *ip, uint16_t *port);
 
 /* Segment handler */
 
-void                  handle_tcp_segment(IP_Header *ip_packet, ssize_t ip_packet_len);
+void                  handle_tcp_segment(IP_Header *ip_packet, ssize_t ip_packet_len, Packet_Buffer *buffer);
+void                  handle_tcp_run(TCP_GRO_Run *run);
 int                   valid_tcp_packet(TCP_Header *tcp_header, uint32_t ip_src, uint32_t ip_dst, ssize_t payload_len, ssize_t calculated_segment_len);
 
 /* Connection implementation */
@@ -35,7 +37,13 @@ int                   valid_tcp_packet(TCP_Header *tcp_header, uint32_t ip_src,
 int                   init_tcp_connections_list();
 void                  free_tcp_connections_list(TCP_Connections_List *connections_list);
 TCP_Connection       *create_tcp_connection(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, 
-                                            uint16_t window_size, uint32_t seq_number, uint32_t ack_number, TCP_State state);
+                                            uint32_t window_size, uint32_t seq_number, uint32_t ack_number, TCP_State state);
+uint32_t              tcp_connection_hash(const TCP_Connections_List *connections_list, uint32_t src_ip, uint32_t dst_ip, 
+                                          uint16_t src_port, uint16_t dst_port);
+void                  insert_tcp_table_slot(TCP_Connections_List *connections_list, uint32_t hash, TCP_Connection *connection);
+int                   grow_tcp_table(TCP_Connections_List *connections_list);
+int64_t               find_tcp_table_slot(const TCP_Connections_List *connections_list, uint32_t src_ip, uint32_t dst_ip, 
+                                          uint16_t src_port, uint16_t dst_port);
 int                   add_tcp_connection(TCP_Connections_List *connections_list, TCP_Connection *connection);
 TCP_Connection       *find_tcp_connection(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
 int                   remove_tcp_connection(TCP_Connections_List *connections_list, TCP_Connection *connection);
@@ -47,27 +55,131 @@ int                   handle_input(char *input, ssize_t input_len);
 void                  show_help();
 void                  show_all_connections();
 int                   switch_to_connection(int conn_num);
-int                   active_create_connection(uint32_t ip_dst, uint16_t dst_port);
 int                   close_connection(int conn_num);
-int                   active_create_connection(uint32_t ip_dst, uint16_t dst_port);
+TCP_Socket           *active_create_connection(uint32_t ip_dst, uint16_t dst_port, const char *data, size_t len);
 void                  change_active_port(uint16_t port);
+int                   change_congestion_control(char *args);
+int                   trace_congestion_to(char *path);
+int                   change_send_coalescing(char *args, uint8_t option);
+void                  show_listeners();
+int                   change_listener(char *args, int on);
+int                   listen_on_ports();
+void                  accept_cli_connections(TCP_Socket *listener, uint8_t events, void *arg);
+void                  handle_cli_socket(TCP_Socket *socket, uint8_t events, void *arg);
+void                  close_cli_socket(TCP_Socket *socket);
+TCP_Socket           *cli_socket(TCP_Connection *connection);
+void                  print_connection_notification(TCP_Socket *socket, const char *event);
+void                  display_tcp_data(TCP_Socket *socket, const uint8_t *payload, ssize_t payload_len);
 
 /* State machine */
 
-void                  handle_tcp_connection(TCP_Header *tcp_header, TCP_Flags *flags, TCP_Connection *connection, ssize_t tcp_payload_len);
-void                  establish_conn_and_print(TCP_Connection *connection, char *dst_ip);
-void                  remove_conn_and_print(TCP_Connection *connection, char *dst_ip);
+void                  handle_tcp_connection(TCP_Header *tcp_header, TCP_Flags flags, TCP_Connection *connection, 
+                                            const TCP_Options *options, const TCP_GRO_Run *run);
+void                  establish_tcp_connection(TCP_Connection *connection);
+void                  enter_time_wait(TCP_Connection *connection);
+void                  tcp_connection_timeout(Timer *timer, void *arg);
 void                  dest_closes_connection(TCP_Connection *connection);
 void                  update_connection_seq_ack(TCP_Connection *connection, uint32_t seq_num_increment, uint32_t ack_num_increment);
-void                  display_tcp_data(TCP_Header *tcp_header, ssize_t payload_len, TCP_Connection *connection);
 
 /* Constructing and sending */
 
-uint8_t              *construct_tcp_packet(TCP_Connection *connection, TCP_Flags *flags, uint16_t id, void *payload, ssize_t payload_len);
-int                   construct_and_send_tcp_packet(TCP_Flags *flags, TCP_Connection *connection, void *payload, ssize_t payload_len);
+int                   tcp_transmit(TCP_Connection *connection, uint32_t seq, uint32_t len, TCP_Flags flags);
+uint16_t              build_tcp_template(TCP_Connection *connection, TCP_Flags flags, uint32_t max_payload, const uint8_t *mac_dst, 
+                                         uint8_t *header, uint32_t *sum);
+uint16_t              build_tcp_frame(TCP_Connection *connection, const uint8_t *header, uint16_t header_len, uint32_t sum, 
+                                      uint32_t seq, TCP_Flags flags, uint16_t payload_len, uint8_t *frame);
 int                   send_syn(TCP_Connection *connection);
 int                   send_syn_ack(TCP_Connection *connection);
 int                   send_fin_ack(TCP_Connection *connection);
 int                   send_ack(TCP_Connection *connection);
 
+/* Send buffer and window */
+
+ssize_t               tcp_send(TCP_Connection *connection, const void *data, ssize_t len);
+void                  tcp_output(TCP_Connection *connection);
+void                  read_send_buffer(const TCP_Connection *connection, uint32_t seq, uint8_t *dst, uint16_t len);
+void                  update_send_window(TCP_Connection *connection, uint32_t seq, uint32_t ack, uint32_t window);
+void                  tcp_set_nodelay(TCP_Connection *connection, int on);
+void                  tcp_set_cork(TCP_Connection *connection, int on);
+
+/* Reassembly */
+
+int                   tcp_receive(TCP_Connection *connection, uint32_t seq, const TCP_GRO_Run *run, TCP_Flags flags);
+int                   tcp_receive_segment(TCP_Connection *connection, uint32_t seq, Packet_Buffer *buffer, uint8_t *payload, 
+                                          uint32_t len, TCP_Flags flags);
+int                   insert_ooo_interval(TCP_Connection *connection, uint32_t start, uint32_t end);
+void                  deliver_recv_buffer(TCP_Connection *connection, uint32_t start, uint32_t end);
+void                  free_ooo_intervals(TCP_Connection *connection);
+void                  delay_tcp_ack(TCP_Connection *connection);
+void                  tcp_delack_timeout(Timer *timer, void *arg);
+
+/* Retransmission */
+
+int                   send_tcp_segment(TCP_Connection *connection, TCP_Flags flags, uint16_t payload_len);
+TCP_Segment          *queue_tcp_segment(TCP_Connection *connection, TCP_Flags flags, uint16_t payload_len);
+int                   transmit_tcp_segment(TCP_Connection *connection, const TCP_Segment *segment);
+uint32_t              tcp_segment_seq_len(const TCP_Segment *segment);
+int                   tcp_all_acked(const TCP_Connection *connection);
+uint32_t              process_tcp_ack(TCP_Connection *connection, uint32_t ack);
+void                  update_tcp_rto(TCP_Connection *connection, uint32_t rtt);
+void                  tcp_retransmit_timeout(Timer *timer, void *arg);
+int                   retransmit_tcp_segment(TCP_Connection *connection);
+void                  free_tcp_segments(TCP_Connection *connection);
+
+/* Options */
+
+int                   parse_tcp_options(TCP_Header *tcp_header, ssize_t header_len, TCP_Options *options);
+uint8_t               build_tcp_options(TCP_Connection *connection, TCP_Flags flags, uint8_t *options, ssize_t max_len);
+uint8_t               build_sack_option(TCP_Connection *connection, uint8_t *options, ssize_t max_len);
+void                  tcp_syn_options(TCP_Connection *connection, const TCP_Options *options);
+int                   check_tcp_timestamps(TCP_Connection *connection, uint32_t seq, const TCP_Options *options);
+void                  process_sack_blocks(TCP_Connection *connection, const TCP_Options *options);
+
+/* SYN cookies */
+
+void                  send_syn_cookie(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, 
+                                      uint32_t peer_isn, const TCP_Options *options);
+TCP_Connection       *check_syn_cookie(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, 
+                                       TCP_Header *tcp_header, const TCP_Options *options);
+uint32_t              tcp_cookie_hash(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port, 
+                                      uint32_t peer_isn, uint32_t count);
+
+/* Fast Open */
+
+uint64_t              tcp_fastopen_cookie(uint32_t ip);
+int                   valid_fastopen_cookie(const TCP_Connection *connection, const TCP_Options *options);
+void                  accept_fastopen_data(TCP_Connection *connection, TCP_Header *tcp_header, Packet_Buffer *buffer, 
+                                           uint8_t *payload, uint32_t len);
+uint8_t               build_fastopen_option(TCP_Connection *connection, TCP_Flags flags, uint8_t *options);
+TCP_Fastopen_Entry   *find_fastopen_entry(uint32_t ip);
+void                  cache_fastopen_cookie(uint32_t ip, const TCP_Options *options);
+void                  forget_fastopen_cookie(uint32_t ip);
+uint32_t              tcp_fastopen_slot(uint32_t ip);
+
+/* TIME_WAIT */
+
+TCP_TW_Bucket        *add_tw_bucket(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+                                    uint32_t snd_nxt, uint32_t rcv_nxt, uint32_t ts_recent);
+TCP_TW_Bucket        *find_tw_bucket(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
+void                  recycle_tw_bucket(TCP_TW_Bucket *bucket);
+int                   handle_tw_segment(TCP_TW_Bucket *bucket, TCP_Header *tcp_header, TCP_Flags flags, 
+                                        const TCP_Options *options, ssize_t tcp_payload_len);
+int                   tcp_tw_reusable(const TCP_TW_Bucket *bucket);
+void                  send_tw_ack(const TCP_TW_Bucket *bucket);
+void                  tcp_tw_timeout(Timer *timer, void *arg);
+
+/* Receive offload */
+
+int                   init_tcp_gro_run(TCP_GRO_Run *run, IP_Header *ip_packet, ssize_t ip_packet_len, Packet_Buffer *buffer);
+int                   tcp_gro_mergeable(const TCP_GRO_Run *run);
+int                   same_tcp_flow(const TCP_GRO_Run *run, const TCP_GRO_Run *other);
+int                   merge_tcp_gro_run(TCP_GRO_Run *run, const TCP_GRO_Run *segment);
+void                  flush_tcp_gro_run(TCP_GRO_Run *run);
+void                  remove_tcp_gro_run(TCP_GRO_Run *runs, int *num_runs, int index);
+
+/* Graph nodes */
+
+int                   register_tcp_nodes(Graph *graph);
+void                  tcp_local_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
 #endif /* TCP_FUNCTIONS__H */
@@ -0,0 +1,155 @@
+/*
+ * tcp_socket.h
+ */
+
+#ifndef TCP_SOCKET__H
+#define TCP_SOCKET__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "tcp.h"
+#include "slab.h"
+
+/*
+    TCP SOCKET CONSTANTS
+*/
+
+/* Readiness events, as a mask passed to a socket's callback. */
+
+#define TCP_SOCKET_ACCEPTABLE        0x1    /* A connection waits to be accepted. */
+#define TCP_SOCKET_CONNECTED         0x2    /* tcp_socket_connect() completed.    */
+#define TCP_SOCKET_READABLE          0x4    /* Received data waits to be read.    */
+#define TCP_SOCKET_WRITABLE          0x8    /* A short send has room again.       */
+#define TCP_SOCKET_HUP               0x10   /* Peer closed its side.              */
+#define TCP_SOCKET_CLOSED            0x20   /* Connection is gone (timed out, or
+                                               the handshake failed).             */
+
+#define TCP_SOCKET_RECV_BUFFER_SIZE  TCP_RECV_BUFFER_SIZE  /* Power of 2, at least
+                                                              the largest window. */
+#define TCP_SOCKET_DEFAULT_BACKLOG   128
+#define TCP_EPHEMERAL_PORT_MIN       49152  /* RFC 6335 dynamic ports.            */
+
+/* Received data is kept in the packet buffers it arrived in, unless it is
+   shorter than the copy break, or sockets already hold their share of buffers
+   and it is copied to the socket's ring instead. */
+
+#define TCP_SOCKET_COPY_BREAK        256
+#define TCP_SOCKET_MAX_HELD_BUFFERS  256    /* A quarter of a buffer pool.        */
+
+/* Listener table. */
+
+#define TCP_ANY_IP                   0      /* Bind on every interface.           */
+#define TCP_NUM_PORTS                (MAX_VALID_PORT + 1)
+#define TCP_PORT_PAGE_SHIFT          8      /* 256 ports a page.                  */
+#define TCP_PORT_PAGE_SIZE           (1 << TCP_PORT_PAGE_SHIFT)
+
+/* Head of the listeners of a port, whose page must be allocated. */
+
+#define TCP_PORT_SLOT(table, port)   ((table)->port_pages[(port) >> TCP_PORT_PAGE_SHIFT][(port) & (TCP_PORT_PAGE_SIZE - 1)])
+
+/*
+    TCP SOCKET STRUCTS
+*/
+
+struct TCP_Socket;
+struct Packet_Buffer;
+
+/* Counters of a listener. */
+
+typedef struct TCP_Listener_Stats
+{
+    uint64_t               syns_queued;      /* SYNs let into the SYN queue.       */
+    uint64_t               cookies_sent;     /* SYNs answered with a cookie.       */
+    uint64_t               cookies_accepted; /* ACKs with a valid cookie.          */
+    uint64_t               established;      /* Connections queued to be accepted. */
+    uint64_t               overflows;        /* Refused, accept queue full.        */
+    uint64_t               fastopen;         /* SYNs whose data was taken.         */
+} TCP_Listener_Stats;
+
+/* A piece of received data, in a packet buffer it holds or in the socket's
+   ring. Its bytes count against the window until it is released. */
+
+typedef struct TCP_Recv_Chunk
+{
+    struct TCP_Recv_Chunk *next;
+    struct Packet_Buffer  *buffer;      /* NULL for data in the socket's ring.     */
+    const uint8_t         *data;        /* Bytes not yet read.                     */
+    uint32_t               len;
+    uint32_t               size;        /* Bytes held, read or not.                */
+    uint8_t                taken;       /* Handed to the application.              */
+    uint8_t                released;
+} TCP_Recv_Chunk;
+
+typedef void (*TCP_Socket_Callback)(struct TCP_Socket *socket, uint8_t events, void *arg);
+
+/* A listener, or an endpoint of one connection. Events are collected as the
+   connection runs and handed to the callback from the event loop, so callbacks
+   never run inside the state machine and may send, receive and close freely.
+   Received data is held until read, and the window advertised to the peer
+   shrinks as it fills. It is queued as chunks in arrival order; rcv_next is
+   the first one not yet handed to the application, and chunks are only freed
+   from the head once released, so the ring is reclaimed in order whatever
+   order the application releases them in. */
+
+typedef struct TCP_Socket
+{
+    TCP_Connection        *connection;  /* NULL for a listener, or once gone.      */
+    struct TCP_Socket     *next;        /* Next listener on the port, or in the
+                                           accept queue.                           */
+    struct TCP_Socket     *next_ready;  /* Next socket with events to dispatch.    */
+    TCP_Socket_Callback    callback;    /* NULL until accepted.                    */
+    void                  *arg;
+    uint32_t               src_ip;      /* IP bound, or TCP_ANY_IP, for a listener.*/
+    uint32_t               dst_ip;
+    uint16_t               src_port;    /* Port listened on, for a listener.       */
+    uint16_t               dst_port;
+    uint8_t                events;      /* Events not yet dispatched.              */
+    uint8_t                ready;       /* On the ready list.                      */
+    uint8_t                closed;      /* Closed while on the ready list.         */
+    uint8_t                want_write;  /* A send came up short.                   */
+    uint8_t                eof;         /* Peer's FIN received.                    */
+
+    /* Listener. */
+
+    uint16_t               backlog;     /* Most connections waiting to be accepted.*/
+    uint16_t               queued;
+    uint16_t               syn_backlog; /* Most connections half open.             */
+    uint16_t               syn_queued;
+    uint8_t                fastopen;    /* Takes data in SYNs with a cookie.       */
+    struct TCP_Socket     *accept_head;
+    struct TCP_Socket     *accept_tail;
+    TCP_Listener_Stats     stats;
+
+    /* Received data. Copied data takes rcv_len bytes of a ring from offset
+       rcv_start. */
+
+    TCP_Recv_Chunk        *rcv_head;
+    TCP_Recv_Chunk        *rcv_tail;
+    TCP_Recv_Chunk        *rcv_next;
+    uint32_t               rcv_held;    /* Bytes of all chunks, for the window.    */
+    uint8_t               *rcv_buf;     /* NULL until data is copied.              */
+    uint32_t               rcv_start;
+    uint32_t               rcv_len;
+} TCP_Socket;
+
+/* Listeners and sockets with events. TCP runs on the control thread only, so
+   sockets are too. A port's listeners hang off its slot in a page of 256 ports,
+   and the bitmap marks the ports that have any, so finding the listener for a
+   segment costs the same however many ports are listened on. Pages are only
+   allocated for ranges that are listened on. */
+
+typedef struct TCP_Socket_Table
+{
+    uint64_t               port_bitmap[TCP_NUM_PORTS / 64];
+    TCP_Socket           **port_pages[TCP_NUM_PORTS / TCP_PORT_PAGE_SIZE];
+    uint32_t               num_listeners;
+    TCP_Socket            *ready_head;
+    TCP_Socket            *ready_tail;
+    Slab_Cache             cache;       /* Sockets of the table.                   */
+    Slab_Cache             chunk_cache; /* Received chunks of the sockets.         */
+    uint32_t               held_buffers;/* Packet buffers held by chunks.          */
+    uint16_t               next_port;   /* Next ephemeral port to try.             */
+} TCP_Socket_Table;
+
+#endif /* TCP_SOCKET__H */
@@ -0,0 +1,1012 @@
+/*
+ * tcp_socket_functions.c
+ */
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "router.h"
+#include "router_functions.h"
+#include "tcp.h"
+#include "tcp_functions.h"
+#include "tcp_socket.h"
+#include "tcp_socket_functions.h"
+#include "slab_functions.h"
+#include "buffer_functions.h"
+#include "timer_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/*
+    API FUNCTIONS
+*/
+
+/* Initialize the socket table. The first ephemeral port is random, so ports
+   are not reused in the same order after a restart. */
+
+int
+init_tcp_sockets()
+{
+    memset(TCP_SOCKETS.port_bitmap, 0, sizeof(TCP_SOCKETS.port_bitmap));
+    memset(TCP_SOCKETS.port_pages, 0, sizeof(TCP_SOCKETS.port_pages));
+
+    TCP_SOCKETS.num_listeners = 0;
+    TCP_SOCKETS.ready_head    = NULL;
+    TCP_SOCKETS.ready_tail    = NULL;
+    TCP_SOCKETS.held_buffers  = 0;
+    TCP_SOCKETS.next_port     = TCP_EPHEMERAL_PORT_MIN + get_random_port_number() % (MAX_VALID_PORT + 1 - TCP_EPHEMERAL_PORT_MIN);
+
+    if (init_slab_cache(&TCP_SOCKETS.cache, "tcp-socket", sizeof(TCP_Socket)) == -1)
+    {
+        return -1;
+    }
+
+    return init_slab_cache(&TCP_SOCKETS.chunk_cache, "tcp-recv-chunk", sizeof(TCP_Recv_Chunk));
+}
+
+/* Listen on a port of one interface's IP, or of every interface with
+   TCP_ANY_IP. Connections established on it wait to be accepted, and the
+   callback is told with TCP_SOCKET_ACCEPTABLE. Once backlog connections are
+   waiting, new ones are refused. A listener bound to an IP takes the port's
+   segments to that IP ahead of a wildcard one. Returns NULL if the IP is not
+   the router's, the IP and port are already listened on or memory runs out. */
+
+TCP_Socket *
+tcp_socket_listen(uint32_t ip, uint16_t port, uint16_t backlog, TCP_Socket_Callback callback, void *arg)
+{
+    TCP_Socket *listener;
+
+    if (port == 0 || (ip != TCP_ANY_IP && find_local_interface(ip) == NULL) || find_bound_tcp_listener(ip, port) != NULL)
+    {
+        printf("Cannot listen on port %d. \n", port);
+        return NULL;
+    }
+
+    if ((listener = create_tcp_socket(NULL, callback, arg)) == NULL)
+    {
+        return NULL;
+    }
+
+    listener->src_ip      = ip;
+    listener->src_port    = port;
+    listener->backlog     = backlog > 0 ? backlog : 1;
+    listener->syn_backlog = TCP_SYN_BACKLOG;
+
+    if (bind_tcp_listener(listener) == -1)
+    {
+        free_tcp_socket(listener);
+        return NULL;
+    }
+
+    return listener;
+}
+
+/* Take the oldest established connection off a listener's queue, and give it
+   a callback. Events that came before it was accepted are dispatched then.
+   Returns NULL if no connection is waiting. */
+
+TCP_Socket *
+tcp_socket_accept(TCP_Socket *listener, TCP_Socket_Callback callback, void *arg)
+{
+    TCP_Socket *socket;
+
+    if ((socket = listener->accept_head) == NULL)
+    {
+        return NULL;
+    }
+
+    if ((listener->accept_head = socket->next) == NULL)
+    {
+        listener->accept_tail = NULL;
+    }
+
+    listener->queued--;
+    socket->next     = NULL;
+    socket->callback = callback;
+    socket->arg      = arg;
+
+    raise_tcp_socket_events(socket, 0);
+
+    return socket;
+}
+
+/* Open a connection to an IP and port, from src_port, or from a free ephemeral
+   port if it is 0. The callback is told with TCP_SOCKET_CONNECTED once it is
+   established, or TCP_SOCKET_CLOSED if it is not in time. Data sent before
+   then is queued. Returns NULL if the 4-tuple is in use, or in TIME_WAIT and
+   not yet reusable, or the SYN cannot be sent. */
+
+TCP_Socket *
+tcp_socket_connect(uint32_t ip_dst, uint16_t dst_port, uint16_t src_port, TCP_Socket_Callback callback, void *arg)
+{
+    return tcp_socket_connect_data(ip_dst, dst_port, src_port, NULL, 0, callback, arg);
+}
+
+/* Open a connection as tcp_socket_connect does, with len bytes of data to send
+   first, using TCP Fast Open (RFC 7413): with a cookie from an earlier
+   connection to the server, the data goes in the SYN and the server may answer
+   a round trip sooner; without one, the SYN asks for a cookie and the data
+   follows the handshake. The server may act on the data of a SYN more than 
+   once, so it must be safe to repeat. Returns NULL as tcp_socket_connect does,
+   or if the data does not fit the send buffer. */
+
+TCP_Socket *
+tcp_socket_connect_data(uint32_t ip_dst, uint16_t dst_port, uint16_t src_port, const void *data, ssize_t len,
+                        TCP_Socket_Callback callback, void *arg)
+{
+    TCP_Connection *connection;
+    TCP_TW_Bucket  *bucket;
+    TCP_Socket     *socket;
+    uint32_t        ip_src = ROUTER_INTERFACES[0].ip_address;
+
+    /* Initialize the connections list. */
+
+    if (TCP_CONNECTIONS_LIST == NULL && init_tcp_connections_list() == -1)
+    {
+        return NULL;
+    }
+
+    /* Pick the source port. */
+
+    if (src_port == 0 && (src_port = get_ephemeral_port(ip_src, ip_dst, dst_port)) == 0)
+    {
+        printf("\nNo ephemeral port is free. \n\n");
+        return NULL;
+    }
+
+    if (find_tcp_connection(ip_src, ip_dst, src_port, dst_port) != NULL)
+    {
+        printf("\nConnection already exists. \n\n");
+        return NULL;
+    }
+
+    /* A connection in TIME_WAIT gives way to us if it is safe to. */
+
+    if ((bucket = find_tw_bucket(ip_src, ip_dst, src_port, dst_port)) != NULL)
+    {
+        if (!tcp_tw_reusable(bucket))
+        {
+            printf("\nConnection is in TIME_WAIT. \n\n");
+            return NULL;
+        }
+
+        recycle_tw_bucket(bucket);
+        TCP_CONNECTIONS_LIST->tw.recycled++;
+    }
+
+    /* Create the connection and its socket. */
+
+    connection = create_tcp_connection(ip_src, ip_dst, src_port, dst_port, DEFAULT_WINDOW_SIZE, get_random_sequence_number(), 0, TCP_LISTEN);
+
+    if (connection == NULL || add_tcp_connection(TCP_CONNECTIONS_LIST, connection) == -1)
+    {
+        slab_free(&TCP_CONNECTIONS_LIST->cache, connection);
+        return NULL;
+    }
+
+    if ((socket = create_tcp_socket(connection, callback, arg)) == NULL)
+    {
+        remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+        return NULL;
+    }
+
+    /* Queue the data, and send the SYN, with as much of it as may go. */
+
+    if (len > 0)
+    {
+        connection->fastopen = 1;
+
+        if (tcp_send(connection, data, len) != len)
+        {
+            printf("\nData does not fit the send buffer. \n\n");
+            connection->socket = NULL;
+            free_tcp_socket(socket);
+            remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+            return NULL;
+        }
+    }
+
+    if (send_syn(connection) == -1)
+    {
+        printf("\nFailed to send SYN packet. \n\n");
+        connection->socket = NULL;
+        free_tcp_socket(socket);
+        remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+        return NULL;
+    }
+
+    connection->state = TCP_SYN_SENT;
+    arm_timer(&TIMER_WHEEL, &connection->timer, TCP_HANDSHAKE_TIMEOUT * 1000);
+
+    return socket;
+}
+
+/* Let a listener take data in SYNs with TCP Fast Open, or stop it. Such data
+   is handed to the application before the handshake completes, and a SYN may
+   be replayed, so only turn it on where acting on a request twice is safe. */
+
+void
+tcp_socket_set_fastopen(TCP_Socket *listener, int on)
+{
+    listener->fastopen = on != 0;
+}
+
+/* Queue data to send on a socket's connection. Returns the number of bytes
+   queued, or -1 if the connection is gone or closing. If fewer than len are
+   queued, the callback is told with TCP_SOCKET_WRITABLE once ACKs make room. */
+
+ssize_t
+tcp_socket_send(TCP_Socket *socket, const void *data, ssize_t len)
+{
+    ssize_t queued;
+
+    if (socket->connection == NULL)
+    {
+        return -1;
+    }
+
+    if ((queued = tcp_send(socket->connection, data, len)) < len)
+    {
+        socket->want_write = 1;
+    }
+
+    return queued;
+}
+
+/* Read up to len bytes of received data. Returns the number of bytes read, 0
+   once the peer has closed and everything is read, or -1 if there is nothing
+   to read yet or the connection is gone. */
+
+ssize_t
+tcp_socket_recv(TCP_Socket *socket, void *data, ssize_t len)
+{
+    TCP_Recv_Chunk *chunk;
+    uint32_t        copy;
+    ssize_t         read = 0;
+
+    if (socket->rcv_next == NULL)
+    {
+        return socket->eof ? 0 : -1;
+    }
+
+    /* Copy from the chunks not yet handed out, releasing each one read to the
+       end. */
+
+    while (read < len && (chunk = socket->rcv_next) != NULL)
+    {
+        copy = len - read > chunk->len ? chunk->len : len - read;
+
+        memcpy((uint8_t *)data + read, chunk->data, copy);
+
+        chunk->data += copy;
+        chunk->len  -= copy;
+        read        += copy;
+
+        if (chunk->len == 0)
+        {
+            chunk->released  = 1;
+            socket->rcv_next = chunk->next;
+        }
+    }
+
+    reclaim_tcp_recv_chunks(socket);
+
+    return read;
+}
+
+/* Take the next chunk of received data without copying it. *chunk is set to
+   it, and its data stays in place, counting against the window, until it is
+   passed to tcp_socket_release(). Chunks may be kept and released in any 
+   order; closing the socket releases those still held. Returns the length of
+   the chunk, 0 once the peer has closed and every chunk is taken, or -1 if 
+   there is nothing to take yet or the connection is gone. */
+
+ssize_t
+tcp_socket_recv_chunk(TCP_Socket *socket, TCP_Recv_Chunk **chunk)
+{
+    if ((*chunk = socket->rcv_next) == NULL)
+    {
+        return socket->eof ? 0 : -1;
+    }
+
+    socket->rcv_next = (*chunk)->next;
+    (*chunk)->taken  = 1;
+
+    return (*chunk)->len;
+}
+
+/* Give back a chunk taken with tcp_socket_recv_chunk(). Its packet buffer is 
+   returned to its pool, or its ring space reused, once the chunks received 
+   before it are released too. */
+
+void
+tcp_socket_release(TCP_Socket *socket, TCP_Recv_Chunk *chunk)
+{
+    chunk->released = 1;
+
+    reclaim_tcp_recv_chunks(socket);
+}
+
+/* Close a socket. A listener stops listening, and closes the connections still
+   waiting to be accepted. A connection is closed on our side and finishes
+   without the socket; one still connecting is dropped. The socket is freed,
+   and its callback is not called again. */
+
+void
+tcp_socket_close(TCP_Socket *socket)
+{
+    TCP_Connection *connection = socket->connection;
+    TCP_Socket     *queued;
+
+    /* Listener. */
+
+    if (socket->backlog > 0)
+    {
+        unbind_tcp_listener(socket);
+
+        while ((queued = tcp_socket_accept(socket, NULL, NULL)) != NULL)
+        {
+            tcp_socket_close(queued);
+        }
+    }
+
+    /* Connection. */
+
+    if (connection != NULL)
+    {
+        connection->socket = NULL;
+
+        switch (connection->state)
+        {
+            case TCP_ESTABLISHED:
+
+                send_fin_ack(connection);
+                connection->state = TCP_FIN_WAIT_1;
+                break;
+
+            case TCP_CLOSE_WAIT:
+
+                send_fin_ack(connection);
+                connection->state = TCP_LAST_ACK;
+                break;
+
+            default:
+
+                remove_tcp_connection(TCP_CONNECTIONS_LIST, connection);
+                break;
+        }
+    }
+
+    /* Free it now, or once it is off the ready list. */
+
+    if (socket->ready)
+    {
+        socket->closed = 1;
+    }
+    else
+    {
+        free_tcp_socket(socket);
+    }
+}
+
+/* Returns 1 if sockets have events to dispatch. */
+
+int
+tcp_sockets_ready()
+{
+    return TCP_SOCKETS.ready_head != NULL;
+}
+
+/* Hand each socket with events to its callback. Events raised by the callbacks
+   are dispatched on the next call, so a callback that keeps raising them does
+   not hold up the event loop. A socket that is not yet accepted keeps its
+   events until it is. */
+
+void
+dispatch_tcp_sockets()
+{
+    TCP_Socket *socket = TCP_SOCKETS.ready_head, *next;
+    uint8_t     events;
+
+    TCP_SOCKETS.ready_head = NULL;
+    TCP_SOCKETS.ready_tail = NULL;
+
+    for (; socket != NULL; socket = next)
+    {
+        next          = socket->next_ready;
+        socket->ready = 0;
+
+        if (socket->closed)
+        {
+            free_tcp_socket(socket);
+            continue;
+        }
+
+        if (socket->callback == NULL)
+        {
+            continue;
+        }
+
+        events         = socket->events;
+        socket->events = 0;
+        socket->callback(socket, events, socket->arg);
+    }
+}
+
+/*
+    LISTENER TABLE FUNCTIONS
+*/
+
+/* Search for the listener a segment to an IP and port goes to: the one bound to
+   the IP, or else the wildcard one. A port has at most one listener for each
+   interface and a wildcard one, so the cost does not depend on how many ports
+   are listened on. Returns NULL if there is none. */
+
+TCP_Socket *
+find_tcp_listener(uint32_t ip, uint16_t port)
+{
+    TCP_Socket *listener, *wildcard = NULL;
+
+    if (!tcp_port_listened(port))
+    {
+        return NULL;
+    }
+
+    for (listener = TCP_PORT_SLOT(&TCP_SOCKETS, port); listener != NULL; listener = listener->next)
+    {
+        if (listener->src_ip == ip)
+        {
+            return listener;
+        }
+
+        if (listener->src_ip == TCP_ANY_IP)
+        {
+            wildcard = listener;
+        }
+    }
+
+    return wildcard;
+}
+
+/* Search for the listener bound to exactly an IP, or TCP_ANY_IP, and port.
+   Returns NULL if not found. */
+
+TCP_Socket *
+find_bound_tcp_listener(uint32_t ip, uint16_t port)
+{
+    TCP_Socket *listener;
+
+    if (!tcp_port_listened(port))
+    {
+        return NULL;
+    }
+
+    for (listener = TCP_PORT_SLOT(&TCP_SOCKETS, port); listener != NULL; listener = listener->next)
+    {
+        if (listener->src_ip == ip)
+        {
+            return listener;
+        }
+    }
+
+    return NULL;
+}
+
+/* Walk the listeners in port order. Returns the one after listener, the first
+   if listener is NULL, or NULL after the last. */
+
+TCP_Socket *
+next_tcp_listener(const TCP_Socket *listener)
+{
+    uint32_t port = 0;
+    uint64_t bits;
+
+    if (listener != NULL)
+    {
+        if (listener->next != NULL)
+        {
+            return listener->next;
+        }
+
+        port = listener->src_port + 1u;
+    }
+
+    /* Skip to the next port listened on, a word of the bitmap at a time. */
+
+    while (port < TCP_NUM_PORTS)
+    {
+        if ((bits = TCP_SOCKETS.port_bitmap[port / 64] >> (port % 64)) != 0)
+        {
+            port += __builtin_ctzll(bits);
+            return TCP_PORT_SLOT(&TCP_SOCKETS, port);
+        }
+
+        port = (port / 64 + 1) * 64;
+    }
+
+    return NULL;
+}
+
+/* Returns 1 if a port has a listener on any IP. */
+
+int
+tcp_port_listened(uint16_t port)
+{
+    return (TCP_SOCKETS.port_bitmap[port / 64] >> (port % 64)) & 1;
+}
+
+/* Add a listener to the slot of its port, allocating the port's page if none
+   of its ports were listened on yet. Returns -1 if it cannot be allocated. */
+
+int
+bind_tcp_listener(TCP_Socket *listener)
+{
+    uint16_t      port = listener->src_port;
+    TCP_Socket ***page = &TCP_SOCKETS.port_pages[port >> TCP_PORT_PAGE_SHIFT];
+
+    if (*page == NULL && (*page = calloc(TCP_PORT_PAGE_SIZE, sizeof(TCP_Socket *))) == NULL)
+    {
+        printf("Cannot listen on port %d. Out of memory.\n", port);
+        return -1;
+    }
+
+    listener->next                       = TCP_PORT_SLOT(&TCP_SOCKETS, port);
+    TCP_PORT_SLOT(&TCP_SOCKETS, port)    = listener;
+    TCP_SOCKETS.port_bitmap[port / 64]  |= 1ULL << (port % 64);
+    TCP_SOCKETS.num_listeners++;
+
+    return 1;
+}
+
+/* Take a listener out of the slot of its port, and clear the port's bit if it
+   was the last. The page is kept for the port to be listened on again. */
+
+void
+unbind_tcp_listener(TCP_Socket *listener)
+{
+    uint16_t     port = listener->src_port;
+    TCP_Socket **link;
+
+    for (link = &TCP_PORT_SLOT(&TCP_SOCKETS, port); *link != NULL; link = &(*link)->next)
+    {
+        if (*link == listener)
+        {
+            *link          = listener->next;
+            listener->next = NULL;
+            TCP_SOCKETS.num_listeners--;
+            break;
+        }
+    }
+
+    if (TCP_PORT_SLOT(&TCP_SOCKETS, port) == NULL)
+    {
+        TCP_SOCKETS.port_bitmap[port / 64] &= ~(1ULL << (port % 64));
+    }
+}
+
+/*
+    INTERNAL FUNCTIONS
+*/
+
+/* Create a socket for a connection, or a listener if connection is NULL.
+   Returns NULL if the cache cannot grow. */
+
+TCP_Socket *
+create_tcp_socket(TCP_Connection *connection, TCP_Socket_Callback callback, void *arg)
+{
+    TCP_Socket *socket;
+
+    if ((socket = slab_alloc(&TCP_SOCKETS.cache)) == NULL)
+    {
+        return NULL;
+    }
+
+    socket->connection  = connection;
+    socket->next        = NULL;
+    socket->next_ready  = NULL;
+    socket->callback    = callback;
+    socket->arg         = arg;
+    socket->src_ip      = connection != NULL ? connection->src_ip : 0;
+    socket->dst_ip      = connection != NULL ? connection->dst_ip : 0;
+    socket->src_port    = connection != NULL ? connection->src_port : 0;
+    socket->dst_port    = connection != NULL ? connection->dst_port : 0;
+    socket->events      = 0;
+    socket->ready       = 0;
+    socket->closed      = 0;
+    socket->want_write  = 0;
+    socket->eof         = 0;
+    socket->backlog     = 0;
+    socket->queued      = 0;
+    socket->syn_backlog = 0;
+    socket->syn_queued  = 0;
+    socket->fastopen    = 0;
+    socket->accept_head = NULL;
+    socket->accept_tail = NULL;
+    socket->rcv_head    = NULL;
+    socket->rcv_tail    = NULL;
+    socket->rcv_next    = NULL;
+    socket->rcv_held    = 0;
+    socket->rcv_buf     = NULL;
+    socket->rcv_start   = 0;
+    socket->rcv_len     = 0;
+
+    memset(&socket->stats, 0, sizeof(socket->stats));
+
+    if (connection != NULL)
+    {
+        connection->socket = socket;
+    }
+
+    return socket;
+}
+
+/* Free a socket, the chunks it still holds and its ring. */
+
+void
+free_tcp_socket(TCP_Socket *socket)
+{
+    TCP_Recv_Chunk *chunk;
+
+    while ((chunk = socket->rcv_head) != NULL)
+    {
+        socket->rcv_head = chunk->next;
+
+        if (chunk->buffer != NULL)
+        {
+            release_packet_buffer(chunk->buffer);
+            TCP_SOCKETS.held_buffers--;
+        }
+
+        slab_free(&TCP_SOCKETS.chunk_cache, chunk);
+    }
+
+    free(socket->rcv_buf);
+    slab_free(&TCP_SOCKETS.cache, socket);
+}
+
+/* Find an ephemeral port that is not listened on and not used for a connection
+   to the destination, nor by one in TIME_WAIT that cannot be reused yet, going
+   round the range from where the last search ended. Returns 0 if every port is
+   taken. */
+
+uint16_t
+get_ephemeral_port(uint32_t ip_src, uint32_t ip_dst, uint16_t dst_port)
+{
+    TCP_TW_Bucket *bucket;
+    uint16_t       port;
+
+    for (int i = TCP_EPHEMERAL_PORT_MIN; i <= MAX_VALID_PORT; i++)
+    {
+        port                  = TCP_SOCKETS.next_port;
+        TCP_SOCKETS.next_port = port == MAX_VALID_PORT ? TCP_EPHEMERAL_PORT_MIN : port + 1;
+
+        if (!tcp_port_listened(port) && find_tcp_connection(ip_src, ip_dst, port, dst_port) == NULL &&
+            ((bucket = find_tw_bucket(ip_src, ip_dst, port, dst_port)) == NULL || tcp_tw_reusable(bucket)))
+        {
+            return port;
+        }
+    }
+
+    return 0;
+}
+
+/* Add events to a socket, and put it on the ready list if it has any. */
+
+void
+raise_tcp_socket_events(TCP_Socket *socket, uint8_t events)
+{
+    socket->events |= events;
+
+    if (socket->ready || socket->events == 0)
+    {
+        return;
+    }
+
+    if (TCP_SOCKETS.ready_tail == NULL)
+    {
+        TCP_SOCKETS.ready_head = socket;
+    }
+    else
+    {
+        TCP_SOCKETS.ready_tail->next_ready = socket;
+    }
+
+    TCP_SOCKETS.ready_tail = socket;
+    socket->next_ready     = NULL;
+    socket->ready          = 1;
+}
+
+/* Queue a chunk of len bytes of received data at data, held in buffer or in
+   the ring. Returns NULL if the cache cannot grow. */
+
+TCP_Recv_Chunk *
+queue_tcp_recv_chunk(TCP_Socket *socket, struct Packet_Buffer *buffer, const uint8_t *data, uint32_t len)
+{
+    TCP_Recv_Chunk *chunk;
+
+    if ((chunk = slab_alloc(&TCP_SOCKETS.chunk_cache)) == NULL)
+    {
+        return NULL;
+    }
+
+    chunk->next     = NULL;
+    chunk->buffer   = buffer;
+    chunk->data     = data;
+    chunk->len      = len;
+    chunk->size     = len;
+    chunk->taken    = 0;
+    chunk->released = 0;
+
+    if (socket->rcv_tail == NULL)
+    {
+        socket->rcv_head = chunk;
+    }
+    else
+    {
+        socket->rcv_tail->next = chunk;
+    }
+
+    socket->rcv_tail  = chunk;
+    socket->rcv_held += len;
+
+    if (socket->rcv_next == NULL)
+    {
+        socket->rcv_next = chunk;
+    }
+
+    return chunk;
+}
+
+/* Copy received data to the end of the ring, growing the last chunk when it 
+   is in the ring just before and not yet handed out or read to its end. A 
+   chunk read to its end stays queued until the chunks before it are released,
+   and nothing would hand out bytes added to it. Returns -1 if the ring
+   cannot be allocated or a chunk is needed and the cache cannot grow; the 
+   data is then dropped. */
+
+int
+copy_tcp_recv_data(TCP_Socket *socket, const uint8_t *data, uint32_t len)
+{
+    TCP_Recv_Chunk *tail;
+    uint32_t        offset, piece;
+
+    if (socket->rcv_buf == NULL && (socket->rcv_buf = malloc(TCP_SOCKET_RECV_BUFFER_SIZE)) == NULL)
+    {
+        return -1;
+    }
+
+    /* At most two pieces, where the data wraps around the ring. */
+
+    while (len > 0)
+    {
+        offset = (socket->rcv_start + socket->rcv_len) & (TCP_SOCKET_RECV_BUFFER_SIZE - 1);
+        piece  = len > TCP_SOCKET_RECV_BUFFER_SIZE - offset ? TCP_SOCKET_RECV_BUFFER_SIZE - offset : len;
+        tail   = socket->rcv_tail;
+
+        if (tail != NULL && tail->buffer == NULL && !tail->taken && !tail->released && 
+            tail->data + tail->len == socket->rcv_buf + offset)
+        {
+            tail->len        += piece;
+            tail->size       += piece;
+            socket->rcv_held += piece;
+        }
+        else if (queue_tcp_recv_chunk(socket, NULL, socket->rcv_buf + offset, piece) == NULL)
+        {
+            return -1;
+        }
+
+        memcpy(socket->rcv_buf + offset, data, piece);
+
+        socket->rcv_len += piece;
+        data            += piece;
+        len             -= piece;
+    }
+
+    return 1;
+}
+
+/* Free the released chunks at the head of the queue, returning their packet
+   buffers and ring space. If that opens a window that had closed below two 
+   segments, the peer is told at once rather than waiting for its next probe. */
+
+void
+reclaim_tcp_recv_chunks(TCP_Socket *socket)
+{
+    TCP_Connection *connection = socket->connection;
+    TCP_Recv_Chunk *chunk;
+    uint32_t        before     = connection != NULL ? tcp_socket_window(connection) : 0;
+
+    while ((chunk = socket->rcv_head) != NULL && chunk->released)
+    {
+        socket->rcv_head  = chunk->next;
+        socket->rcv_held -= chunk->size;
+
+        if (chunk->buffer != NULL)
+        {
+            release_packet_buffer(chunk->buffer);
+            TCP_SOCKETS.held_buffers--;
+        }
+        else
+        {
+            socket->rcv_start = (socket->rcv_start + chunk->size) & (TCP_SOCKET_RECV_BUFFER_SIZE - 1);
+            socket->rcv_len  -= chunk->size;
+        }
+
+        slab_free(&TCP_SOCKETS.chunk_cache, chunk);
+    }
+
+    if (socket->rcv_head == NULL)
+    {
+        socket->rcv_tail = NULL;
+    }
+
+    if (connection != NULL && !socket->eof && before < 2u * connection->mss &&
+        tcp_socket_window(connection) >= 2u * connection->mss)
+    {
+        send_ack(connection);
+    }
+}
+
+/*
+    CONNECTION HOOK FUNCTIONS
+*/
+
+/* A connection is established. One we opened tells its socket; one a peer
+   opened gets a socket on the accept queue of the listener of its port.
+   Returns -1 if there is no listener or its queue is full. */
+
+int
+tcp_socket_established(TCP_Connection *connection)
+{
+    TCP_Socket *listener, *socket;
+
+    if (connection->socket != NULL)
+    {
+        raise_tcp_socket_events(connection->socket, TCP_SOCKET_CONNECTED);
+        return 1;
+    }
+
+    if ((listener = find_tcp_listener(connection->src_ip, connection->src_port)) == NULL)
+    {
+        return -1;
+    }
+
+    if (listener->queued >= listener->backlog || (socket = create_tcp_socket(connection, NULL, NULL)) == NULL)
+    {
+        listener->stats.overflows++;
+        return -1;
+    }
+
+    if (listener->accept_tail == NULL)
+    {
+        listener->accept_head = socket;
+    }
+    else
+    {
+        listener->accept_tail->next = socket;
+    }
+
+    listener->accept_tail = socket;
+    listener->queued++;
+    listener->stats.established++;
+
+    raise_tcp_socket_events(listener, TCP_SOCKET_ACCEPTABLE);
+
+    return 1;
+}
+
+/* Take a connection out of its listener's SYN queue, once it is established or
+   gone. */
+
+void
+tcp_socket_unqueue_syn(TCP_Connection *connection)
+{
+    TCP_Socket *listener;
+
+    if (!connection->syn_queued)
+    {
+        return;
+    }
+
+    connection->syn_queued = 0;
+
+    if ((listener = find_tcp_listener(connection->src_ip, connection->src_port)) != NULL && listener->syn_queued > 0)
+    {
+        listener->syn_queued--;
+    }
+}
+
+/* Hold in-order data for the application to read. Data in a packet buffer
+   is kept there, the buffer held until the application releases it, so large
+   transfers are not copied on the way; short data, data from the reassembly
+   buffer and data past TCP_SOCKET_MAX_HELD_BUFFERS are copied to the ring, so
+   held buffers never starve a pool of room for new frames. The advertised 
+   window keeps it all within TCP_SOCKET_RECV_BUFFER_SIZE. Data for a 
+   connection the application has closed is discarded. */
+
+void
+tcp_socket_deliver(TCP_Connection *connection, struct Packet_Buffer *buffer, const uint8_t *data, uint32_t len)
+{
+    TCP_Socket *socket = connection->socket;
+
+    if (socket == NULL || len == 0)
+    {
+        return;
+    }
+
+    len = len > TCP_SOCKET_RECV_BUFFER_SIZE - socket->rcv_held ? TCP_SOCKET_RECV_BUFFER_SIZE - socket->rcv_held : len;
+
+    if (buffer != NULL && len >= TCP_SOCKET_COPY_BREAK && TCP_SOCKETS.held_buffers < TCP_SOCKET_MAX_HELD_BUFFERS)
+    {
+        if (queue_tcp_recv_chunk(socket, buffer, data, len) == NULL)
+        {
+            printf("Dropping received data. Out of memory.\n");
+            return;
+        }
+
+        hold_packet_buffer(buffer);
+        TCP_SOCKETS.held_buffers++;
+    }
+    else if (copy_tcp_recv_data(socket, data, len) == -1)
+    {
+        printf("Dropping received data. Out of memory.\n");
+        return;
+    }
+
+    raise_tcp_socket_events(socket, TCP_SOCKET_READABLE);
+}
+
+/* Tell a connection's socket, if it has one, of events. TCP_SOCKET_WRITABLE is
+   only passed on after a short send. A closed connection is detached from its
+   socket. */
+
+void
+tcp_socket_notify(TCP_Connection *connection, uint8_t events)
+{
+    TCP_Socket *socket = connection->socket;
+
+    if (socket == NULL)
+    {
+        return;
+    }
+
+    if (events & TCP_SOCKET_WRITABLE)
+    {
+        events            &= socket->want_write ? 0xFF : ~TCP_SOCKET_WRITABLE;
+        socket->want_write = 0;
+    }
+
+    if (events & TCP_SOCKET_HUP)
+    {
+        socket->eof = 1;
+    }
+
+    if (events & TCP_SOCKET_CLOSED)
+    {
+        socket->connection = NULL;
+        connection->socket = NULL;
+    }
+
+    raise_tcp_socket_events(socket, events);
+}
+
+/* Window to advertise: what is left of the socket's receive buffer, up to the
+   connection's window. Data is only taken out of the buffer as it is read, so
+   the right edge of the window never moves back. */
+
+uint32_t
+tcp_socket_window(const TCP_Connection *connection)
+{
+    uint32_t space;
+
+    if (connection->socket == NULL)
+    {
+        return connection->window_size;
+    }
+
+    space = TCP_SOCKET_RECV_BUFFER_SIZE - connection->socket->rcv_held;
+
+    return space < connection->window_size ? space : connection->window_size;
+}
@@ -0,0 +1,63 @@
+/*
+ * tcp_socket_functions.h
+ */
+
+#ifndef TCP_SOCKET_FUNCTIONS__H
+#define TCP_SOCKET_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "tcp.h"
+#include "tcp_socket.h"
+
+/*
+    TCP SOCKET FUNCTIONS
+*/
+
+/* API */
+
+int                   init_tcp_sockets();
+TCP_Socket           *tcp_socket_listen(uint32_t ip, uint16_t port, uint16_t backlog, TCP_Socket_Callback callback, void *arg);
+TCP_Socket           *tcp_socket_accept(TCP_Socket *listener, TCP_Socket_Callback callback, void *arg);
+TCP_Socket           *tcp_socket_connect(uint32_t ip_dst, uint16_t dst_port, uint16_t src_port,
+                                         TCP_Socket_Callback callback, void *arg);
+TCP_Socket           *tcp_socket_connect_data(uint32_t ip_dst, uint16_t dst_port, uint16_t src_port, const void *data, 
+                                              ssize_t len, TCP_Socket_Callback callback, void *arg);
+void                  tcp_socket_set_fastopen(TCP_Socket *listener, int on);
+ssize_t               tcp_socket_send(TCP_Socket *socket, const void *data, ssize_t len);
+ssize_t               tcp_socket_recv(TCP_Socket *socket, void *data, ssize_t len);
+ssize_t               tcp_socket_recv_chunk(TCP_Socket *socket, TCP_Recv_Chunk **chunk);
+void                  tcp_socket_release(TCP_Socket *socket, TCP_Recv_Chunk *chunk);
+void                  tcp_socket_close(TCP_Socket *socket);
+int                   tcp_sockets_ready();
+void                  dispatch_tcp_sockets();
+
+/* Listener table */
+
+TCP_Socket           *find_tcp_listener(uint32_t ip, uint16_t port);
+TCP_Socket           *find_bound_tcp_listener(uint32_t ip, uint16_t port);
+TCP_Socket           *next_tcp_listener(const TCP_Socket *listener);
+int                   tcp_port_listened(uint16_t port);
+int                   bind_tcp_listener(TCP_Socket *listener);
+void                  unbind_tcp_listener(TCP_Socket *listener);
+
+/* Internal */
+
+TCP_Socket           *create_tcp_socket(TCP_Connection *connection, TCP_Socket_Callback callback, void *arg);
+void                  free_tcp_socket(TCP_Socket *socket);
+uint16_t              get_ephemeral_port(uint32_t ip_src, uint32_t ip_dst, uint16_t dst_port);
+void                  raise_tcp_socket_events(TCP_Socket *socket, uint8_t events);
+TCP_Recv_Chunk       *queue_tcp_recv_chunk(TCP_Socket *socket, struct Packet_Buffer *buffer, const uint8_t *data, uint32_t len);
+int                   copy_tcp_recv_data(TCP_Socket *socket, const uint8_t *data, uint32_t len);
+void                  reclaim_tcp_recv_chunks(TCP_Socket *socket);
+
+/* Connection hooks */
+
+int                   tcp_socket_established(TCP_Connection *connection);
+void                  tcp_socket_unqueue_syn(TCP_Connection *connection);
+void                  tcp_socket_deliver(TCP_Connection *connection, struct Packet_Buffer *buffer, const uint8_t *data, uint32_t len);
+void                  tcp_socket_notify(TCP_Connection *connection, uint8_t events);
+uint32_t              tcp_socket_window(const TCP_Connection *connection);
+
+#endif /* TCP_SOCKET_FUNCTIONS__H */
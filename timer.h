@@ -0,0 +1,66 @@
+/*
+ * timer.h
+ */
+
+#ifndef TIMER__H
+#define TIMER__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+
+/*
+    TIMER CONSTANTS
+*/
+
+#define TIMER_TICK_NS              1000000ULL   /* 1 ms ticks.                     */
+#define TIMER_WHEEL_BITS           6
+#define TIMER_WHEEL_SLOTS          (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK           (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS         4            /* Covers 2^24 ticks (4.6 hours).  */
+#define TIMER_EXPIRED_SLOT         (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)
+#define TIMER_NOT_ARMED            -1
+
+/*
+    TIMER STRUCTS
+*/
+
+struct Timer;
+
+typedef void (*Timer_Function)(struct Timer *timer, void *arg);
+
+/* A timer is embedded in the object it times, so arming one never allocates. 
+   It sits in a doubly linked slot list so cancelling is O(1). */
+
+typedef struct Timer
+{
+    struct Timer   *next;
+    struct Timer   *prev;
+    uint64_t        expires;            /* Tick the timer fires at.                */
+    int             slot;               /* Slot it is in, or TIMER_NOT_ARMED.      */
+    Timer_Function  function;           /* Called once when the timer fires.       */
+    void           *arg;
+} Timer;
+
+/* Hierarchical hashed timer wheel. Level 0 has a slot per tick; each level above
+   has slots 64 times as wide. A timer goes in the lowest level that reaches its 
+   expiry, and is moved down a level (cascaded) when the level below wraps, so 
+   arming and cancelling are O(1) and firing only touches due slots. Each level 
+   keeps a bitmap of non-empty slots, which gives the next tick worth waking 
+   up for without scanning. The owning thread sleeps on timer_fd, a timerfd 
+   armed for that tick. */
+
+typedef struct Timer_Wheel
+{
+    uint64_t        now;                /* Next tick to process.                   */
+    uint64_t        start_ns;           /* Monotonic time of tick 0.               */
+    uint64_t        occupied[TIMER_WHEEL_LEVELS];
+    Timer          *slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS + 1];
+    size_t          num_pending;        /* Armed timers.                           */
+    uint64_t        armed_tick;         /* Tick timer_fd fires at, or UINT64_MAX.  */
+    int             timer_fd;
+    uint64_t        fired;              /* Timers fired.                           */
+    uint64_t        cascaded;           /* Timers moved down a level.              */
+} Timer_Wheel;
+
+#endif /* TIMER__H */
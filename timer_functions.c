@@ -0,0 +1,374 @@
+/*
+ * timer_functions.c
+ */
+
+/* Implementation Headers */
+
+#include <sys/timerfd.h>
+#include <time.h>
+#include "c_headers.h"
+#include "timer.h"
+#include "timer_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/*
+    WHEEL FUNCTIONS
+*/
+
+/* Initialize an empty wheel starting at the current time. If the timerfd cannot
+   be created, return -1. */
+
+int
+init_timer_wheel(Timer_Wheel *wheel)
+{
+    struct timespec now;
+
+    memset(wheel, 0, sizeof(Timer_Wheel));
+
+    if ((wheel->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+    {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    wheel->start_ns   = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    wheel->armed_tick = UINT64_MAX;
+
+    return 1;
+}
+
+/* Close the timerfd of a wheel. Pending timers are forgotten. */
+
+void
+free_timer_wheel(Timer_Wheel *wheel)
+{
+    close(wheel->timer_fd);
+    wheel->timer_fd = -1;
+}
+
+/* Return the current tick of a wheel's clock. */
+
+uint64_t
+timer_wheel_clock(const Timer_Wheel *wheel)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec * 1000000000ULL + now.tv_nsec - wheel->start_ns) / TIMER_TICK_NS;
+}
+
+/* Return the first tick, from the next one to process, at which a level 0 slot 
+   fires or a slot of a higher level is cascaded. Only slots marked in the 
+   bitmaps are considered, so this is a few bit operations per level. Returns 
+   UINT64_MAX if no timer is pending. */
+
+uint64_t
+next_timer_tick(const Timer_Wheel *wheel)
+{
+    uint64_t next = UINT64_MAX, first, bits, tick;
+    int      level, shift, rotate;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if (wheel->occupied[level] == 0)
+        {
+            continue;
+        }
+
+        /* Slots of this level are cascaded on multiples of its width. Rotate 
+           the bitmap so bit 0 is the first such multiple not yet processed. */
+
+        shift  = level * TIMER_WHEEL_BITS;
+        first  = (wheel->now + (1ULL << shift) - 1) >> shift;
+        rotate = first & TIMER_WHEEL_MASK;
+        bits   = wheel->occupied[level];
+        bits   = rotate ? (bits >> rotate) | (bits << (TIMER_WHEEL_SLOTS - rotate)) : bits;
+        tick   = (first + __builtin_ctzll(bits)) << shift;
+
+        if (tick < next)
+        {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+/* Arm the timerfd for the next tick worth waking up for, or disarm it if no
+   timer is pending. Only makes the system call if that tick changed. */
+
+void
+update_timer_fd(Timer_Wheel *wheel)
+{
+    struct itimerspec when;
+    uint64_t          next = next_timer_tick(wheel), ns;
+
+    if (next == wheel->armed_tick)
+    {
+        return;
+    }
+
+    memset(&when, 0, sizeof(when));
+
+    if (next != UINT64_MAX)
+    {
+        ns                    = wheel->start_ns + next * TIMER_TICK_NS;
+        when.it_value.tv_sec  = ns / 1000000000ULL;
+        when.it_value.tv_nsec = ns % 1000000000ULL;
+    }
+
+    if (timerfd_settime(wheel->timer_fd, TFD_TIMER_ABSTIME, &when, NULL) == -1)
+    {
+        perror("timerfd_settime");
+        return;
+    }
+
+    wheel->armed_tick = next;
+}
+
+/* Move the timers of the current slot of a level down to the levels below. The
+   slot is detached first, since a timer far in the future may land in it again. */
+
+void
+cascade_timers(Timer_Wheel *wheel, int level)
+{
+    int    slot = level * TIMER_WHEEL_SLOTS + ((wheel->now >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+    Timer *timer, *next;
+
+    timer                = wheel->slots[slot];
+    wheel->slots[slot]   = NULL;
+    wheel->occupied[level] &= ~(1ULL << (slot & TIMER_WHEEL_MASK));
+
+    for (; timer != NULL; timer = next)
+    {
+        next = timer->next;
+        place_timer(wheel, timer);
+        wheel->cascaded++;
+    }
+}
+
+/* Process every tick up to the current time: cascade higher levels as level 0 
+   wraps and fire due timers. Ticks with nothing to do are skipped. Timers armed
+   by a callback are placed from the next tick, so they never fire in the same 
+   pass. Call when the timerfd is readable. Returns the number of timers fired. */
+
+int
+run_timer_wheel(Timer_Wheel *wheel)
+{
+    uint64_t target = timer_wheel_clock(wheel), next, count;
+    Timer   *timer;
+    int      index, level, fired = 0;
+
+    /* Clear the timerfd. Until the end of the pass, treat it as firing now so 
+       timers armed by callbacks do not reprogram it one by one. */
+
+    read(wheel->timer_fd, &count, sizeof(count));
+    wheel->armed_tick = 0;
+
+    while ((next = next_timer_tick(wheel)) <= target)
+    {
+        wheel->now = next;
+        index      = next & TIMER_WHEEL_MASK;
+
+        /* Cascade each level whose slot changes on this tick. */
+
+        for (level = 1; index == 0 && level < TIMER_WHEEL_LEVELS; level++)
+        {
+            cascade_timers(wheel, level);
+
+            if ((next >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK)
+            {
+                break;
+            }
+        }
+
+        wheel->now = next + 1;
+
+        if (!(wheel->occupied[0] & (1ULL << index)))
+        {
+            continue;
+        }
+
+        /* Move the slot to the expired list, so callbacks may cancel or arm any
+           timer while it is being run. */
+
+        wheel->slots[TIMER_EXPIRED_SLOT] = wheel->slots[index];
+        wheel->slots[index]              = NULL;
+        wheel->occupied[0]              &= ~(1ULL << index);
+
+        for (timer = wheel->slots[TIMER_EXPIRED_SLOT]; timer != NULL; timer = timer->next)
+        {
+            timer->slot = TIMER_EXPIRED_SLOT;
+        }
+
+        while ((timer = wheel->slots[TIMER_EXPIRED_SLOT]) != NULL)
+        {
+            cancel_timer(wheel, timer);
+            timer->function(timer, timer->arg);
+            wheel->fired++;
+            fired++;
+        }
+    }
+
+    if (wheel->now <= target)
+    {
+        wheel->now = target + 1;
+    }
+
+    update_timer_fd(wheel);
+
+    return fired;
+}
+
+/* Print pending timers and counters. */
+
+void
+show_timer_stats(const Timer_Wheel *wheel)
+{
+    uint64_t next = next_timer_tick(wheel);
+
+    printf("TIMERS (%llu ms ticks):\n", (unsigned long long)(TIMER_TICK_NS / 1000000));
+    printf("    %zu pending, %llu fired, %llu cascaded", wheel->num_pending,
+           (unsigned long long)wheel->fired, (unsigned long long)wheel->cascaded);
+
+    if (next != UINT64_MAX)
+    {
+        printf(", next wakeup in %lld ticks", (long long)(next - timer_wheel_clock(wheel)));
+    }
+
+    printf("\n\n");
+}
+
+/*
+    TIMER FUNCTIONS
+*/
+
+/* Initialize a timer that calls function(timer, arg) when it fires. */
+
+void
+init_timer(Timer *timer, Timer_Function function, void *arg)
+{
+    timer->next     = NULL;
+    timer->prev     = NULL;
+    timer->expires  = 0;
+    timer->slot     = TIMER_NOT_ARMED;
+    timer->function = function;
+    timer->arg      = arg;
+}
+
+/* Link a timer into the slot for its expiry: level 0 if it is due within 64 
+   ticks, otherwise the lowest level whose range reaches it. Timers beyond the 
+   top level go in its furthest slot and are placed again when cascaded. */
+
+void
+place_timer(Timer_Wheel *wheel, Timer *timer)
+{
+    uint64_t expires = timer->expires < wheel->now ? wheel->now : timer->expires;
+    uint64_t delta   = expires - wheel->now;
+    int      level   = 0, slot;
+
+    if (delta >= 1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS))
+    {
+        delta   = (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+        expires = wheel->now + delta;
+    }
+
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= 1ULL << ((level + 1) * TIMER_WHEEL_BITS))
+    {
+        level++;
+    }
+
+    slot = level * TIMER_WHEEL_SLOTS + ((expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+
+    /* Push onto the slot's list. */
+
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = wheel->slots[slot];
+
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer;
+    }
+
+    wheel->slots[slot]      = timer;
+    wheel->occupied[level] |= 1ULL << (slot & TIMER_WHEEL_MASK);
+}
+
+/* Unlink a timer from its slot, clearing the slot's bit if it empties. */
+
+void
+unlink_timer(Timer_Wheel *wheel, Timer *timer)
+{
+    if (timer->prev != NULL)
+    {
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        wheel->slots[timer->slot] = timer->next;
+    }
+
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer->prev;
+    }
+
+    if (wheel->slots[timer->slot] == NULL && timer->slot != TIMER_EXPIRED_SLOT)
+    {
+        wheel->occupied[timer->slot / TIMER_WHEEL_SLOTS] &= ~(1ULL << (timer->slot & TIMER_WHEEL_MASK));
+    }
+
+    timer->slot = TIMER_NOT_ARMED;
+}
+
+/* Arm a timer to fire after delay_ms, re-arming it if it is already pending.
+   The timerfd is only reprogrammed if the timer is due before it fires. */
+
+void
+arm_timer(Timer_Wheel *wheel, Timer *timer, uint64_t delay_ms)
+{
+    if (timer->slot != TIMER_NOT_ARMED)
+    {
+        unlink_timer(wheel, timer);
+        wheel->num_pending--;
+    }
+
+    timer->expires = timer_wheel_clock(wheel) + (delay_ms * 1000000ULL + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+
+    place_timer(wheel, timer);
+    wheel->num_pending++;
+
+    if (timer->expires < wheel->armed_tick)
+    {
+        update_timer_fd(wheel);
+    }
+}
+
+/* Cancel a timer. Does nothing if it is not pending. */
+
+void
+cancel_timer(Timer_Wheel *wheel, Timer *timer)
+{
+    if (timer->slot == TIMER_NOT_ARMED)
+    {
+        return;
+    }
+
+    unlink_timer(wheel, timer);
+    wheel->num_pending--;
+}
+
+/* Return 1 if a timer is armed and has not fired yet. */
+
+int
+timer_pending(const Timer *timer)
+{
+    return timer->slot != TIMER_NOT_ARMED;
+}
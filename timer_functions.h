@@ -0,0 +1,37 @@
+/*
+ * timer_functions.h
+ */
+
+#ifndef TIMER_FUNCTIONS__H
+#define TIMER_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "timer.h"
+
+/*
+    TIMER FUNCTIONS
+*/
+
+/* Wheel */
+
+int            init_timer_wheel(Timer_Wheel *wheel);
+void           free_timer_wheel(Timer_Wheel *wheel);
+uint64_t       timer_wheel_clock(const Timer_Wheel *wheel);
+uint64_t       next_timer_tick(const Timer_Wheel *wheel);
+void           update_timer_fd(Timer_Wheel *wheel);
+void           cascade_timers(Timer_Wheel *wheel, int level);
+int            run_timer_wheel(Timer_Wheel *wheel);
+void           show_timer_stats(const Timer_Wheel *wheel);
+
+/* Timers */
+
+void           init_timer(Timer *timer, Timer_Function function, void *arg);
+void           place_timer(Timer_Wheel *wheel, Timer *timer);
+void           unlink_timer(Timer_Wheel *wheel, Timer *timer);
+void           arm_timer(Timer_Wheel *wheel, Timer *timer, uint64_t delay_ms);
+void           cancel_timer(Timer_Wheel *wheel, Timer *timer);
+int            timer_pending(const Timer *timer);
+
+#endif /* TIMER_FUNCTIONS__H */
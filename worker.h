@@ -0,0 +1,116 @@
+/*
+ * worker.h
+ */
+
+#ifndef WORKER__H
+#define WORKER__H
+
+/* Implementation Headers */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "router.h"
+#include "buffer.h"
+#include "graph.h"
+#include "ring.h"
+#include "rss.h"
+#include "scheduler.h"
+
+/*
+    WORKER CONSTANTS
+*/
+
+#define WORKER_RING_SIZE           1024
+#define WORKER_MAX_FORWARDERS      64
+
+/*
+    WORKER STRUCTS
+*/
+
+struct Worker_Set;
+
+/* Lets a thread sleep on an eventfd when it has no work. Producers only write
+   to the eventfd while the sleeping flag is set. */
+
+typedef struct Worker_Wakeup
+{
+    int                 event_fd;         /* Readable when the thread is woken.   */
+    atomic_int          sleeping;         /* Set while the thread may block.      */
+} Worker_Wakeup;
+
+/* Sends frames for one egress interface (pipeline mode only). Each forwarding
+   worker has its own ring to every TX worker, so all rings are single-producer/
+   single-consumer. */
+
+typedef struct TX_Worker
+{
+    pthread_t           thread;
+    int                 cpu;              /* CPU pinned to, or SCHEDULER_NO_CPU.  */
+    const Interface    *interface;        /* Egress interface.                    */
+    int                 num_rings;        /* Rings feeding this worker.           */
+    SPSC_Ring         **rings;            /* Ring from each forwarding worker.    */
+    Worker_Wakeup       wakeup;           /* Wakes the worker when rings fill.    */
+    Busy_Poll           busy_poll;        /* Spin before sleeping on wakeup.      */
+    atomic_ullong       frames;           /* Frames sent.                         */
+    atomic_ullong       bursts;           /* Writes issued.                       */
+} TX_Worker;
+
+/* Reads frames from one interface and steers each to a forwarding worker by
+   the RSS hash of its flow, so a flow is always handled by the same worker.
+   In run-to-completion mode frames are steered as soon as they are read; in 
+   pipeline mode they are parsed first, and steered before lookup. */
+
+typedef struct RX_Worker
+{
+    pthread_t           thread;
+    int                 cpu;              /* CPU pinned to, or SCHEDULER_NO_CPU.  */
+    const Interface    *interface;        /* Interface read by this worker.       */
+    struct Worker_Set  *workers;          /* Set the worker belongs to.           */
+    Buffer_Pool         pool;             /* Buffers owned by this worker.        */
+    Graph               graph;            /* Dispatch graph run by this worker.   */
+    SPSC_Ring          *forward_rings;    /* One ring per forwarding worker.      */
+    atomic_ullong       ring_drops;       /* Frames dropped on full rings.        */
+    VDE_Reader          reader;           /* Buffered reader for the interface.   */
+    Busy_Poll           busy_poll;        /* Spin before blocking in poll.        */
+    RX_Queue_Stats      rx_stats;         /* Quota and queue depth counters.      */
+} RX_Worker;
+
+/* Runs the rest of the graph for the flows steered to it. In run-to-completion
+   mode that is the whole chain up to sending; in pipeline mode it is lookup 
+   and rewrite, and forwarded frames go to TX workers. Segments for the router
+   go to the control thread, which owns all TCP state. */
+
+typedef struct Forwarding_Worker
+{
+    pthread_t           thread;
+    int                 cpu;              /* CPU pinned to, or SCHEDULER_NO_CPU.  */
+    int                 index;            /* RSS queue served by this worker.     */
+    struct Worker_Set  *workers;          /* Set the worker belongs to.           */
+    Buffer_Pool         pool;             /* Buffers owned by this worker.        */
+    Graph               graph;            /* Forwarding graph run by this worker. */
+    int                 num_rings;        /* Rings feeding this worker.           */
+    SPSC_Ring         **rings;            /* Ring from each RX worker.            */
+    SPSC_Ring          *tx_rings;         /* One ring per egress interface.       */
+    SPSC_Ring           local_ring;       /* Local segments for control thread.   */
+    Worker_Wakeup       wakeup;           /* Wakes the worker when rings fill.    */
+    Busy_Poll           busy_poll;        /* Spin before sleeping on wakeup.      */
+    atomic_ullong       frames;           /* Frames steered to this worker.       */
+    atomic_ullong       ring_drops;       /* Frames dropped on full rings.        */
+} Forwarding_Worker;
+
+typedef struct Worker_Set
+{
+    Scheduler_Config    config;           /* Mode the set was started in.         */
+    int                 num_rx_workers;
+    int                 num_forwarding_workers;
+    int                 num_tx_workers;
+    RX_Worker          *rx_workers;
+    Forwarding_Worker  *forwarding_workers;
+    TX_Worker          *tx_workers;
+    Worker_Wakeup       control_wakeup;   /* Wakes the control thread.            */
+    RSS_Table           rss;              /* Steers flows to forwarding workers.  */
+} Worker_Set;
+
+#endif /* WORKER__H */
@@ -0,0 +1,826 @@
+/*
+ * worker_functions.c
+ */
+
+/* Implementation Headers */
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include "c_headers.h"
+#include "cs431vde.h"
+#include "router.h"
+#include "buffer.h"
+#include "buffer_functions.h"
+#include "graph.h"
+#include "graph_functions.h"
+#include "ring.h"
+#include "ring_functions.h"
+#include "rss.h"
+#include "rss_functions.h"
+#include "arp_functions.h"
+#include "icmp_functions.h"
+#include "tcp_functions.h"
+#include "worker.h"
+#include "worker_functions.h"
+#include "scheduler.h"
+#include "scheduler_functions.h"
+
+/*
+    FUNCTION IMPLEMENTATIONS
+*/
+
+/*
+    WAKEUP FUNCTIONS
+*/
+
+/* Initialize a wakeup. Returns -1 if the eventfd cannot be created. */
+
+int
+init_worker_wakeup(Worker_Wakeup *wakeup)
+{
+    if ((wakeup->event_fd = eventfd(0, 0)) == -1)
+    {
+        perror("eventfd");
+        return -1;
+    }
+
+    atomic_init(&wakeup->sleeping, 0);
+
+    return 1;
+}
+
+/* Wake a thread after publishing work to it. Only costs a system call if
+   the thread is (about to be) asleep. */
+
+void
+wake_worker(Worker_Wakeup *wakeup)
+{
+    uint64_t one = 1;
+
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (atomic_load_explicit(&wakeup->sleeping, memory_order_relaxed))
+    {
+        write(wakeup->event_fd, &one, sizeof(one));
+    }
+}
+
+/* Announce that the calling thread may sleep. The caller must check for work
+   again after this, and only then block. */
+
+void
+begin_worker_sleep(Worker_Wakeup *wakeup)
+{
+    atomic_store_explicit(&wakeup->sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void
+end_worker_sleep(Worker_Wakeup *wakeup)
+{
+    atomic_store_explicit(&wakeup->sleeping, 0, memory_order_relaxed);
+}
+
+/* Block until woken, consuming the wakeup. */
+
+void
+wait_for_wakeup(Worker_Wakeup *wakeup)
+{
+    uint64_t count;
+
+    read(wakeup->event_fd, &count, sizeof(count));
+}
+
+/*
+    WORKER SET FUNCTIONS
+*/
+
+/* Build the graph shared by every worker role. RX and forwarding workers build
+   the same nodes in the same order, so a node index means the same stage in 
+   both and a frame can resume at buffer->next_node after a handoff. */
+
+int
+init_worker_graph(Graph *graph, Buffer_Pool *pool, void *context)
+{
+    int handoff_node;
+
+    if (init_graph(graph, pool) == -1 ||
+        register_arp_nodes(graph) == -1 ||
+        register_icmp_nodes(graph) == -1 ||
+        (handoff_node = register_graph_node(graph, "control-handoff", control_handoff_node)) == -1)
+    {
+        return -1;
+    }
+
+    register_ip_protocol_node(graph, TCP_PROTOCOL, handoff_node);
+    graph->context = context;
+
+    return 1;
+}
+
+/* Build the graph for an RX worker. Every node from the stage boundary on 
+   belongs to the forwarding workers, so the RX worker steers frames reaching 
+   one of them: at ethernet-input in run-to-completion mode, or after parsing, 
+   at ip-lookup (or arp-input), in pipeline mode. */
+
+int
+init_rx_worker_graph(RX_Worker *worker)
+{
+    int boundary = NODE_ETHERNET_INPUT;
+    int i;
+
+    if (init_worker_graph(&worker->graph, &worker->pool, worker) == -1)
+    {
+        return -1;
+    }
+
+    if (worker->workers->config.mode == SCHEDULER_PIPELINE)
+    {
+        boundary = NODE_IP_LOOKUP;
+    }
+
+    for (i = boundary; i < worker->graph.num_nodes; i++)
+    {
+        replace_graph_node(&worker->graph, i, "rss-dispatch", rss_dispatch_node);
+    }
+
+    return 1;
+}
+
+/* Build the graph for a forwarding worker. In pipeline mode output goes to the
+   TX workers' rings, so each interface has one writer. In run-to-completion 
+   mode every worker writes straight to the interfaces, and the interface 
+   output node sends each vector's frames for an interface as one burst under
+   the interface's write lock, so bursts from different workers never 
+   interleave. */
+
+int
+init_forwarding_worker_graph(Forwarding_Worker *worker)
+{
+    if (init_worker_graph(&worker->graph, &worker->pool, worker) == -1)
+    {
+        return -1;
+    }
+
+    if (worker->workers->config.mode == SCHEDULER_PIPELINE)
+    {
+        replace_graph_node(&worker->graph, NODE_INTERFACE_OUTPUT, "tx-ring-output", tx_ring_output_node);
+    }
+
+    return 1;
+}
+
+/* Create an RX worker per interface, the forwarding workers and, in pipeline
+   mode, a TX worker per interface. Connect them with rings and start their 
+   threads. The calling thread becomes the control thread. Returns -1 on failure. */
+
+int
+start_worker_set(Worker_Set *workers, const Scheduler_Config *config)
+{
+    RX_Worker         *rx;
+    Forwarding_Worker *fwd;
+    TX_Worker         *tx;
+    int                num_forwarding_workers = config->num_forwarding_workers;
+    int                i, j, cpu = 0;
+
+    if (num_forwarding_workers < 1 || num_forwarding_workers > WORKER_MAX_FORWARDERS)
+    {
+        printf("Number of forwarding workers must be 1 to %d. \n", WORKER_MAX_FORWARDERS);
+        return -1;
+    }
+
+    workers->config                 = *config;
+    workers->num_rx_workers         = NUM_INTERFACES;
+    workers->num_forwarding_workers = num_forwarding_workers;
+    workers->num_tx_workers         = config->mode == SCHEDULER_PIPELINE ? NUM_INTERFACES : 0;
+
+    /* Allocate workers on cache line boundaries so rings don't share lines. */
+
+    if (posix_memalign((void **)&workers->rx_workers, CACHE_LINE_SIZE, NUM_INTERFACES * sizeof(RX_Worker)) != 0 ||
+        posix_memalign((void **)&workers->forwarding_workers, CACHE_LINE_SIZE, num_forwarding_workers * sizeof(Forwarding_Worker)) != 0 ||
+        posix_memalign((void **)&workers->tx_workers, CACHE_LINE_SIZE, NUM_INTERFACES * sizeof(TX_Worker)) != 0)
+    {
+        return -1;
+    }
+
+    if (init_worker_wakeup(&workers->control_wakeup) == -1 ||
+        init_rss_table(&workers->rss, RSS_DEFAULT_KEY, num_forwarding_workers) == -1)
+    {
+        return -1;
+    }
+
+    /* Initialize RX workers with a ring to every forwarding worker. */
+
+    for (i = 0; i < workers->num_rx_workers; i++)
+    {
+        rx            = &workers->rx_workers[i];
+        rx->interface = &ROUTER_INTERFACES[i];
+        rx->workers   = workers;
+        atomic_init(&rx->ring_drops, 0);
+        init_busy_poll(&rx->busy_poll, config->busy_poll_us);
+        init_rx_queue_stats(&rx->rx_stats);
+
+        if (posix_memalign((void **)&rx->forward_rings, CACHE_LINE_SIZE, num_forwarding_workers * sizeof(SPSC_Ring)) != 0)
+        {
+            return -1;
+        }
+
+        for (j = 0; j < num_forwarding_workers; j++)
+        {
+            if (init_spsc_ring(&rx->forward_rings[j], WORKER_RING_SIZE) == -1)
+            {
+                return -1;
+            }
+        }
+
+        if (init_buffer_pool(&rx->pool, BUFFER_POOL_SIZE) == -1 ||
+            init_rx_worker_graph(rx) == -1 ||
+            init_vde_reader(&rx->reader, rx->interface->fds[0]) == -1)
+        {
+            return -1;
+        }
+    }
+
+    /* Initialize forwarding workers with a ring to every TX worker. */
+
+    for (i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        fwd            = &workers->forwarding_workers[i];
+        fwd->index     = i;
+        fwd->workers   = workers;
+        fwd->num_rings = workers->num_rx_workers;
+        atomic_init(&fwd->frames, 0);
+        atomic_init(&fwd->ring_drops, 0);
+        init_busy_poll(&fwd->busy_poll, config->busy_poll_us);
+
+        if ((fwd->rings = malloc(fwd->num_rings * sizeof(SPSC_Ring *))) == NULL ||
+            posix_memalign((void **)&fwd->tx_rings, CACHE_LINE_SIZE, workers->num_tx_workers * sizeof(SPSC_Ring)) != 0)
+        {
+            return -1;
+        }
+
+        for (j = 0; j < fwd->num_rings; j++)
+        {
+            fwd->rings[j] = &workers->rx_workers[j].forward_rings[i];
+        }
+
+        for (j = 0; j < workers->num_tx_workers; j++)
+        {
+            if (init_spsc_ring(&fwd->tx_rings[j], WORKER_RING_SIZE) == -1)
+            {
+                return -1;
+            }
+        }
+
+        if (init_spsc_ring(&fwd->local_ring, WORKER_RING_SIZE) == -1 ||
+            init_buffer_pool(&fwd->pool, BUFFER_POOL_SIZE) == -1 ||
+            init_forwarding_worker_graph(fwd) == -1 ||
+            init_worker_wakeup(&fwd->wakeup) == -1)
+        {
+            return -1;
+        }
+    }
+
+    /* Initialize TX workers with a ring from every forwarding worker. */
+
+    for (i = 0; i < workers->num_tx_workers; i++)
+    {
+        tx            = &workers->tx_workers[i];
+        tx->interface = &ROUTER_INTERFACES[i];
+        tx->num_rings = workers->num_forwarding_workers;
+        atomic_init(&tx->frames, 0);
+        atomic_init(&tx->bursts, 0);
+        init_busy_poll(&tx->busy_poll, config->busy_poll_us);
+
+        if ((tx->rings = malloc(tx->num_rings * sizeof(SPSC_Ring *))) == NULL ||
+            init_worker_wakeup(&tx->wakeup) == -1)
+        {
+            return -1;
+        }
+
+        for (j = 0; j < tx->num_rings; j++)
+        {
+            tx->rings[j] = &workers->forwarding_workers[j].tx_rings[i];
+        }
+    }
+
+    /* Start consumers before producers. When pinning, forwarding workers take 
+       the first CPUs since they do most of the work. */
+
+    for (i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        fwd      = &workers->forwarding_workers[i];
+        fwd->cpu = SCHEDULER_NO_CPU;
+
+        if (pthread_create(&fwd->thread, NULL, forwarding_worker_loop, fwd) != 0)
+        {
+            return -1;
+        }
+        if (config->pin_cpus)
+        {
+            fwd->cpu = pin_thread_to_cpu(fwd->thread, cpu++);
+        }
+    }
+
+    for (i = 0; i < workers->num_tx_workers; i++)
+    {
+        tx      = &workers->tx_workers[i];
+        tx->cpu = SCHEDULER_NO_CPU;
+
+        if (pthread_create(&tx->thread, NULL, tx_worker_loop, tx) != 0)
+        {
+            return -1;
+        }
+        if (config->pin_cpus)
+        {
+            tx->cpu = pin_thread_to_cpu(tx->thread, cpu++);
+        }
+    }
+
+    for (i = 0; i < workers->num_rx_workers; i++)
+    {
+        rx      = &workers->rx_workers[i];
+        rx->cpu = SCHEDULER_NO_CPU;
+
+        if (pthread_create(&rx->thread, NULL, rx_worker_loop, rx) != 0)
+        {
+            return -1;
+        }
+        if (config->pin_cpus)
+        {
+            rx->cpu = pin_thread_to_cpu(rx->thread, cpu++);
+        }
+    }
+
+    return 1;
+}
+
+/* Run TCP segments handed off by the forwarding workers through the TCP local 
+   node. Called by the control thread. Returns the number of segments delivered. */
+
+int
+deliver_local_segments(Worker_Set *workers)
+{
+    Packet_Buffer *buffers[GRAPH_VECTOR_SIZE];
+    int            i, num_buffers, delivered = 0;
+
+    for (i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        num_buffers = spsc_ring_dequeue_burst(&workers->forwarding_workers[i].local_ring, (void **)buffers, GRAPH_VECTOR_SIZE);
+
+        if (num_buffers > 0)
+        {
+            tcp_local_node(NULL, buffers, num_buffers);
+            delivered += num_buffers;
+        }
+    }
+
+    return delivered;
+}
+
+/* Returns 1 if any forwarding worker has segments waiting for the control thread. */
+
+int
+local_segments_pending(Worker_Set *workers)
+{
+    for (int i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        if (spsc_ring_count(&workers->forwarding_workers[i].local_ring) > 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Print per-worker statistics, including how evenly RSS spreads flows over the
+   forwarding workers. Counters are read while workers run, so the values are 
+   approximate. */
+
+void
+show_worker_stats(Worker_Set *workers)
+{
+    RX_Worker          *rx;
+    Forwarding_Worker  *fwd;
+    TX_Worker          *tx;
+    unsigned long long  frames, bursts, total = 0, max = 0;
+    char                name[32];
+    int                 i;
+
+    printf("\nWORKERS (%s):\n", scheduler_mode_name(workers->config.mode));
+
+    for (i = 0; i < workers->num_rx_workers; i++)
+    {
+        rx = &workers->rx_workers[i];
+
+        printf("    RX worker R0_%d (CPU %d): free buffers %zu/%zu, ring drops %llu\n",
+               rx->interface->interface_num, rx->cpu, rx->pool.num_free, rx->pool.num_buffers,
+               (unsigned long long)atomic_load(&rx->ring_drops));
+
+        /* RX workers only run a stage of their own in pipeline mode. */
+
+        if (workers->config.mode == SCHEDULER_PIPELINE)
+        {
+            show_graph_stats(&rx->graph);
+        }
+    }
+
+    for (i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        frames = atomic_load(&workers->forwarding_workers[i].frames);
+        total += frames;
+        max    = frames > max ? frames : max;
+    }
+
+    for (i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        fwd    = &workers->forwarding_workers[i];
+        frames = atomic_load(&fwd->frames);
+
+        printf("    Forwarding worker %d (CPU %d): frames %llu (%.1f%%), ring drops %llu, local queue %zu\n",
+               i, fwd->cpu, frames, total ? 100.0 * frames / total : 0.0,
+               (unsigned long long)atomic_load(&fwd->ring_drops), spsc_ring_count(&fwd->local_ring));
+        show_graph_stats(&fwd->graph);
+    }
+
+    /* 1.0 is a perfect spread; N means one worker did all of the work. */
+
+    printf("    Flow imbalance (max/mean frames per forwarding worker): %.2f\n",
+           total ? (double)max * workers->num_forwarding_workers / total : 0.0);
+
+    for (i = 0; i < workers->num_tx_workers; i++)
+    {
+        tx     = &workers->tx_workers[i];
+        frames = atomic_load(&tx->frames);
+        bursts = atomic_load(&tx->bursts);
+
+        printf("    TX worker R0_%d (CPU %d): frames %llu, writes %llu, frames/write %.1f\n",
+               tx->interface->interface_num, tx->cpu, frames, bursts, bursts ? (double)frames / bursts : 0.0);
+    }
+
+    printf("\nRX QUOTA (%d frames per round):\n", workers->config.rx_quota);
+
+    for (i = 0; i < workers->num_rx_workers; i++)
+    {
+        snprintf(name, sizeof(name), "RX worker R0_%d", workers->rx_workers[i].interface->interface_num);
+        show_rx_queue_stats(name, &workers->rx_workers[i].rx_stats, &workers->rx_workers[i].reader);
+    }
+
+    /* Time idle threads spent spinning versus blocked in the kernel. */
+
+    printf("\nBUSY POLL (budget %d us):\n", workers->config.busy_poll_us);
+
+    for (i = 0; i < workers->num_rx_workers; i++)
+    {
+        snprintf(name, sizeof(name), "RX worker R0_%d", workers->rx_workers[i].interface->interface_num);
+        show_busy_poll_stats(name, &workers->rx_workers[i].busy_poll);
+    }
+
+    for (i = 0; i < workers->num_forwarding_workers; i++)
+    {
+        snprintf(name, sizeof(name), "Forwarding worker %d", i);
+        show_busy_poll_stats(name, &workers->forwarding_workers[i].busy_poll);
+    }
+
+    for (i = 0; i < workers->num_tx_workers; i++)
+    {
+        snprintf(name, sizeof(name), "TX worker R0_%d", workers->tx_workers[i].interface->interface_num);
+        show_busy_poll_stats(name, &workers->tx_workers[i].busy_poll);
+    }
+
+    printf("\n");
+}
+
+/*
+    THREAD LOOPS
+*/
+
+/* RX worker thread. Reads bursts from its interface and steers them to the
+   forwarding workers. */
+
+void *
+rx_worker_loop(void *arg)
+{
+    RX_Worker     *worker  = arg;
+    struct pollfd  poll_fd = { worker->interface->fds[0], POLLIN, 0 };
+    int            received;
+
+    claim_buffer_pool(&worker->pool);
+
+    while (1)
+    {
+        /* Only block once buffered frames are drained and the spin budget is 
+           spent. While spinning, the non-blocking read below is the poll. */
+
+        if (!vde_reader_has_frame(&worker->reader) && !busy_poll_spin(&worker->busy_poll))
+        {
+            busy_poll_begin_sleep(&worker->busy_poll);
+
+            if (poll(&poll_fd, 1, -1) == -1 && errno != EINTR)
+            {
+                perror("poll");
+                exit(EXIT_FAILURE);
+            }
+
+            busy_poll_end_sleep(&worker->busy_poll);
+        }
+
+        if ((received = receive_rx_quota(&worker->graph, &worker->reader, worker->interface,
+                                         worker->workers->config.rx_quota, &worker->rx_stats)) < 0)
+        {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+
+        if (received > 0)
+        {
+            busy_poll_work(&worker->busy_poll);
+        }
+
+        graph_dispatch(&worker->graph);
+    }
+
+    return NULL;
+}
+
+/* Forwarding worker thread. Runs the frames steered to it through its graph,
+   and sleeps when all of its rings are empty. */
+
+void *
+forwarding_worker_loop(void *arg)
+{
+    Forwarding_Worker *worker = arg;
+    Packet_Buffer     *buffers[GRAPH_VECTOR_SIZE];
+    int                i, num_buffers, pending;
+
+    claim_buffer_pool(&worker->pool);
+
+    while (1)
+    {
+        num_buffers = 0;
+
+        for (i = 0; i < worker->num_rings && num_buffers < GRAPH_VECTOR_SIZE; i++)
+        {
+            num_buffers += spsc_ring_dequeue_burst(worker->rings[i], (void **)buffers + num_buffers,
+                                                   GRAPH_VECTOR_SIZE - num_buffers);
+        }
+
+        /* Resume each frame at the node it was handed off from. */
+
+        if (num_buffers > 0)
+        {
+            for (i = 0; i < num_buffers; i++)
+            {
+                graph_enqueue(&worker->graph, buffers[i]->next_node, buffers[i]);
+            }
+
+            graph_dispatch(&worker->graph);
+            busy_poll_work(&worker->busy_poll);
+            continue;
+        }
+
+        /* Nothing to forward. Keep polling the rings within the spin budget; 
+           producers don't signal the eventfd while the worker isn't asleep. */
+
+        if (busy_poll_spin(&worker->busy_poll))
+        {
+            continue;
+        }
+
+        /* Sleep unless work arrived after announcing it. */
+
+        busy_poll_begin_sleep(&worker->busy_poll);
+        begin_worker_sleep(&worker->wakeup);
+
+        for (i = 0, pending = 0; i < worker->num_rings; i++)
+        {
+            pending |= spsc_ring_count(worker->rings[i]) > 0;
+        }
+
+        if (!pending)
+        {
+            wait_for_wakeup(&worker->wakeup);
+        }
+
+        end_worker_sleep(&worker->wakeup);
+        busy_poll_end_sleep(&worker->busy_poll);
+    }
+
+    return NULL;
+}
+
+/* TX worker thread. Drains the rings for its interface, writing each burst with
+   a single system call, and sleeps when all rings are empty. */
+
+void *
+tx_worker_loop(void *arg)
+{
+    TX_Worker     *worker = arg;
+    Packet_Buffer *buffers[VDE_MAX_BURST];
+    void          *frames[VDE_MAX_BURST];
+    uint16_t       lens[VDE_MAX_BURST];
+    int            i, num_buffers, pending;
+
+    while (1)
+    {
+        num_buffers = 0;
+
+        for (i = 0; i < worker->num_rings && num_buffers < VDE_MAX_BURST; i++)
+        {
+            num_buffers += spsc_ring_dequeue_burst(worker->rings[i], (void **)buffers + num_buffers,
+                                                   VDE_MAX_BURST - num_buffers);
+        }
+
+        if (num_buffers > 0)
+        {
+            for (i = 0; i < num_buffers; i++)
+            {
+                frames[i] = buffers[i]->data;
+                lens[i]   = buffers[i]->len;
+            }
+
+            send_ethernet_burst(worker->interface->fds[1], frames, lens, num_buffers);
+
+            /* Buffers go back to the RX workers' pools. */
+
+            for (i = 0; i < num_buffers; i++)
+            {
+                release_packet_buffer(buffers[i]);
+            }
+
+            atomic_fetch_add_explicit(&worker->frames, num_buffers, memory_order_relaxed);
+            atomic_fetch_add_explicit(&worker->bursts, 1, memory_order_relaxed);
+            busy_poll_work(&worker->busy_poll);
+            continue;
+        }
+
+        /* Nothing to send. Keep polling within the spin budget, then sleep 
+           unless work arrived after announcing it. */
+
+        if (busy_poll_spin(&worker->busy_poll))
+        {
+            continue;
+        }
+
+        busy_poll_begin_sleep(&worker->busy_poll);
+        begin_worker_sleep(&worker->wakeup);
+
+        for (i = 0, pending = 0; i < worker->num_rings; i++)
+        {
+            pending |= spsc_ring_count(worker->rings[i]) > 0;
+        }
+
+        if (!pending)
+        {
+            wait_for_wakeup(&worker->wakeup);
+        }
+
+        end_worker_sleep(&worker->wakeup);
+        busy_poll_end_sleep(&worker->busy_poll);
+    }
+
+    return NULL;
+}
+
+/*
+    GRAPH NODES
+*/
+
+/* RSS dispatch node. Stands in for the nodes RX workers hand off: frames are 
+   hashed on their flow and queued, grouped by worker, on the ring to the 
+   forwarding worker picked by the indirection table. The worker resumes them 
+   at the node that was handed off. */
+
+void
+rss_dispatch_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    RX_Worker         *worker = graph->context;
+    Worker_Set        *set    = worker->workers;
+    Forwarding_Worker *fwd;
+    Packet_Buffer     *sorted_buffers[GRAPH_VECTOR_SIZE];
+    uint8_t            queues[GRAPH_VECTOR_SIZE];
+    int                starts[WORKER_MAX_FORWARDERS + 1] = { 0 };
+    int                i, num_queued, enqueued;
+
+    /* Hash every frame, then sort the vector by queue in one counting pass. */
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        buffers[i]->hash      = rss_frame_hash(&set->rss, buffers[i]->data, buffers[i]->len);
+        buffers[i]->next_node = graph->current_node;
+        queues[i]             = rss_queue(&set->rss, buffers[i]->hash);
+        starts[queues[i] + 1]++;
+    }
+
+    for (i = 0; i < set->num_forwarding_workers; i++)
+    {
+        starts[i + 1] += starts[i];
+    }
+
+    for (i = 0; i < num_buffers; i++)
+    {
+        sorted_buffers[starts[queues[i]]++] = buffers[i];
+    }
+
+    /* starts[q] now marks the end of queue q's run. */
+
+    for (i = 0; i < set->num_forwarding_workers; i++)
+    {
+        int start = i == 0 ? 0 : starts[i - 1];
+
+        num_queued = starts[i] - start;
+
+        if (num_queued == 0)
+        {
+            continue;
+        }
+
+        fwd      = &set->forwarding_workers[i];
+        enqueued = spsc_ring_enqueue_burst(&worker->forward_rings[i], (void **)sorted_buffers + start, num_queued);
+
+        if (enqueued > 0)
+        {
+            atomic_fetch_add_explicit(&fwd->frames, enqueued, memory_order_relaxed);
+            wake_worker(&fwd->wakeup);
+        }
+
+        /* Drop what did not fit. */
+
+        for (; enqueued < num_queued; enqueued++)
+        {
+            release_packet_buffer(sorted_buffers[start + enqueued]);
+            atomic_fetch_add_explicit(&worker->ring_drops, 1, memory_order_relaxed);
+        }
+    }
+}
+
+/* TX ring output node. Replaces interface-output in forwarding worker graphs: 
+   frames are queued on the ring to each egress interface's TX worker. */
+
+void
+tx_ring_output_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Forwarding_Worker *worker = graph->context;
+    TX_Worker         *tx;
+    Packet_Buffer     *egress_buffers[GRAPH_VECTOR_SIZE];
+    int                i, j, num_egress, enqueued;
+
+    for (i = 0; i < worker->workers->num_tx_workers; i++)
+    {
+        tx         = &worker->workers->tx_workers[i];
+        num_egress = 0;
+
+        for (j = 0; j < num_buffers; j++)
+        {
+            if (buffers[j]->tx_interface == tx->interface)
+            {
+                egress_buffers[num_egress++] = buffers[j];
+            }
+        }
+
+        if (num_egress == 0)
+        {
+            continue;
+        }
+
+        enqueued = spsc_ring_enqueue_burst(&worker->tx_rings[i], (void **)egress_buffers, num_egress);
+
+        if (enqueued > 0)
+        {
+            wake_worker(&tx->wakeup);
+        }
+
+        /* Drop what did not fit. */
+
+        for (j = enqueued; j < num_egress; j++)
+        {
+            release_packet_buffer(egress_buffers[j]);
+        }
+
+        atomic_fetch_add_explicit(&worker->ring_drops, num_egress - enqueued, memory_order_relaxed);
+    }
+}
+
+/* Control handoff node. Queues TCP segments for the router to the control thread. */
+
+void
+control_handoff_node(Graph *graph, Packet_Buffer **buffers, int num_buffers)
+{
+    Forwarding_Worker *worker = graph->context;
+    int                enqueued, i;
+
+    enqueued = spsc_ring_enqueue_burst(&worker->local_ring, (void **)buffers, num_buffers);
+
+    if (enqueued > 0)
+    {
+        wake_worker(&worker->workers->control_wakeup);
+    }
+
+    for (i = enqueued; i < num_buffers; i++)
+    {
+        release_packet_buffer(buffers[i]);
+    }
+
+    atomic_fetch_add_explicit(&worker->ring_drops, num_buffers - enqueued, memory_order_relaxed);
+}
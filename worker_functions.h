@@ -0,0 +1,47 @@
+/*
+ * worker_functions.h
+ */
+
+#ifndef WORKER_FUNCTIONS__H
+#define WORKER_FUNCTIONS__H
+
+/* Implementation Headers */
+
+#include "c_headers.h"
+#include "worker.h"
+
+/*
+    WORKER FUNCTIONS
+*/
+
+/* Wakeups */
+
+int      init_worker_wakeup(Worker_Wakeup *wakeup);
+void     wake_worker(Worker_Wakeup *wakeup);
+void     begin_worker_sleep(Worker_Wakeup *wakeup);
+void     end_worker_sleep(Worker_Wakeup *wakeup);
+void     wait_for_wakeup(Worker_Wakeup *wakeup);
+
+/* Worker set */
+
+int      start_worker_set(Worker_Set *workers, const Scheduler_Config *config);
+int      init_worker_graph(Graph *graph, Buffer_Pool *pool, void *context);
+int      init_rx_worker_graph(RX_Worker *worker);
+int      init_forwarding_worker_graph(Forwarding_Worker *worker);
+int      deliver_local_segments(Worker_Set *workers);
+int      local_segments_pending(Worker_Set *workers);
+void     show_worker_stats(Worker_Set *workers);
+
+/* Thread loops */
+
+void    *rx_worker_loop(void *arg);
+void    *forwarding_worker_loop(void *arg);
+void    *tx_worker_loop(void *arg);
+
+/* Graph nodes */
+
+void     rss_dispatch_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+void     tx_ring_output_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+void     control_handoff_node(Graph *graph, Packet_Buffer **buffers, int num_buffers);
+
+#endif /* WORKER_FUNCTIONS__H */